@@ -0,0 +1,141 @@
+#include "rendering.h"
+#include <cassert> // assert
+#include <cerrno> // errno
+#include <cstdio> // fflush
+#include <cstring> // memcpy, strlen
+#include <unistd.h> // write
+
+// Longest escape sequence to switch colors:  ESC[38;2;rrr;ggg;bbb;48;2;rrr;ggg;bbbm
+#define MAX_COLOR_SEQUENCE_LENGTH 36
+// Longest escape sequence to move cursor:    ESC[yyyyy;xxxxxH
+#define MAX_MOVE_SEQUENCE_LENGTH 14
+
+bool AnsiBackend::init()
+{
+    // Anything printed with printf must go out before we start writing past stdio
+    fflush(stdout);
+
+    // Switch to the alternate screen (so the terminal contents is
+    // restored when we exit), hide cursor and clear screen
+    const char *setup = "\033[?1049h\033[?25l\033[0m\033[2J";
+    write_all(setup, strlen(setup));
+    current_pair = -1;
+    return true;
+}
+
+void AnsiBackend::shutdown()
+{
+    // Reset colors, show cursor, back to the normal screen
+    const char *restore = "\033[0m\033[?25h\033[?1049l";
+    write_all(restore, strlen(restore));
+}
+
+void AnsiBackend::resize(int width, int height)
+{
+    // Worst case every cell has its own cursor move and color switch,
+    // and is a block character (3 bytes of UTF-8)
+    out.resize((size_t)width * height * (MAX_MOVE_SEQUENCE_LENGTH + MAX_COLOR_SEQUENCE_LENGTH + 3) + 64);
+    out_length = 0;
+}
+
+void AnsiBackend::print_run(const FrameBuffer &fb, int y, int x_begin, int x_end)
+{
+    // Move cursor (rows and columns start at 1 in escape sequences)
+    append("\033[", 2);
+    append_uint(y + 1);
+    append(";", 1);
+    append_uint(x_begin + 1);
+    append("H", 1);
+
+    for (int x = x_begin; x < x_end; ++x)
+    {
+        const Cell &cell = fb.at(x, y);
+        if (cell.color_pair != current_pair)
+        {
+            RGB fg, bg;
+            if (color_pair_rgb(cell.color_pair, fg, bg))
+            {
+                append("\033[38;2;", 7);
+                append_uint(fg.r);
+                append(";", 1);
+                append_uint(fg.g);
+                append(";", 1);
+                append_uint(fg.b);
+                append(";48;2;", 6);
+                append_uint(bg.r);
+                append(";", 1);
+                append_uint(bg.g);
+                append(";", 1);
+                append_uint(bg.b);
+                append("m", 1);
+            }
+            else
+            {
+                // Terminal default colors
+                append("\033[0m", 4);
+            }
+            current_pair = cell.color_pair;
+        }
+        if (is_quadrant_glyph(cell.glyph))
+        {
+            append(quadrant_glyph_utf8(cell.glyph), 3);
+        }
+        else
+        {
+            out[out_length++] = cell.glyph;
+        }
+    }
+}
+
+void AnsiBackend::flush()
+{
+    write_all(out.data(), out_length);
+    out_length = 0;
+}
+
+void AnsiBackend::append(const char *text, size_t length)
+{
+    assert(out_length + length <= out.size()); // 'resize' not called with size of frame?
+    memcpy(&out[out_length], text, length);
+    out_length += length;
+}
+
+void AnsiBackend::append_uint(unsigned value)
+{
+    char digits[10];
+    int count = 0;
+    do
+    {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    assert(out_length + count <= out.size());
+    while (count > 0)
+    {
+        out[out_length++] = digits[--count];
+    }
+}
+
+void AnsiBackend::write_all(const char *data, size_t length)
+{
+    if (sink != nullptr)
+    {
+        sink->insert(sink->end(), data, data + length);
+        return;
+    }
+    while (length > 0)
+    {
+        ssize_t written = write(fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        length -= written;
+    }
+}
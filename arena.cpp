@@ -0,0 +1,130 @@
+#include "arena.h"
+#include <algorithm> // max
+#include <atomic> // atomic
+#include <cstdlib> // malloc, free, aligned_alloc
+#include <new> // bad_alloc, align_val_t
+
+// ---- COUNTING ALLOCATIONS: ----
+#ifdef COUNT_ALLOCATIONS
+
+static std::atomic<uint64_t> allocations(0);
+
+uint64_t allocation_count()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+// Replaces the standard library's operator new (the array and nothrow forms
+// call this one), so every allocation is counted, and operator delete to
+// free what it allocated.
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *memory = malloc(size ? size : 1);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t align = std::max((size_t)alignment, sizeof(void *));
+    // aligned_alloc wants the size to be a multiple of the alignment
+    void *memory = aligned_alloc(align, (std::max(size, (size_t)1) + align - 1) / align * align);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t, std::align_val_t) noexcept
+{
+    free(memory);
+}
+
+#endif
+
+// ---- FRAME ARENA: ----
+
+// In front of each overflow allocation, linking them together
+struct alignas(ARENA_ALIGNMENT) OverflowHeader
+{
+    void *next;
+};
+
+static size_t align_up(size_t bytes)
+{
+    return (bytes + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static void free_overflow(FrameArena &arena)
+{
+    while (arena.overflow != nullptr)
+    {
+        void *next = static_cast<OverflowHeader *>(arena.overflow)->next;
+        operator delete(arena.overflow, std::align_val_t(ARENA_ALIGNMENT));
+        arena.overflow = next;
+    }
+    arena.overflow_bytes = 0;
+}
+
+FrameArena::~FrameArena()
+{
+    free_overflow(*this);
+    operator delete(block, std::align_val_t(ARENA_ALIGNMENT));
+}
+
+void arena_reset(FrameArena &arena)
+{
+    size_t needed = arena.used + arena.overflow_bytes;
+    arena.peak = std::max(arena.peak, needed);
+    free_overflow(arena);
+    arena.used = 0;
+    if (arena.block == nullptr || needed > arena.size)
+    {
+        // Room for all of the last frame, with some to spare so a frame
+        // slowly getting bigger doesn't grow it every time
+        size_t size = std::max((size_t)ARENA_INITIAL_SIZE, align_up(needed + needed / 2));
+        operator delete(arena.block, std::align_val_t(ARENA_ALIGNMENT));
+        arena.block = static_cast<unsigned char *>(operator new(size, std::align_val_t(ARENA_ALIGNMENT)));
+        arena.size = size;
+    }
+}
+
+void *arena_alloc(FrameArena &arena, size_t bytes)
+{
+    bytes = align_up(bytes);
+    if (arena.used + bytes <= arena.size)
+    {
+        void *memory = arena.block + arena.used;
+        arena.used += bytes;
+        return memory;
+    }
+
+    // Doesn't fit this frame, the next reset makes room for it
+    unsigned char *memory = static_cast<unsigned char *>(
+        operator new(sizeof(OverflowHeader) + bytes, std::align_val_t(ARENA_ALIGNMENT)));
+    reinterpret_cast<OverflowHeader *>(memory)->next = arena.overflow;
+    arena.overflow = memory;
+    arena.overflow_bytes += bytes;
+    return memory + sizeof(OverflowHeader);
+}
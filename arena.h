@@ -0,0 +1,76 @@
+// arena.h - Memory for the frame loop. Once it is running, a frame shouldn't
+//           go to the heap at all: allocations take a lock in the allocator
+//           now and then, and show up as spikes in the frame time.
+//
+// ---- FRAME ARENA: ----
+// Scratch memory that is only needed for one frame is taken from a FrameArena
+// by bumping an offset into one block of memory, and all of it is given back
+// at once when the next frame starts ('arena_reset'). When a frame needs more
+// than the block has, the rest comes from the heap on the side, and the block
+// is made big enough for all of it at the next reset. Once frames stop
+// getting bigger, nothing is allocated.
+//
+// ---- COUNTING ALLOCATIONS: ----
+// Built with COUNT_ALLOCATIONS defined ('make bench'), every allocation
+// through operator new (std::vector, std::string, std::function, ...), on
+// any thread, is counted ('allocation_count'). The benchmarks check the count
+// doesn't go up while a frame is rendered and presented, once the first
+// frames have sized every buffer. Other builds leave operator new alone and
+// count nothing.
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+
+// Alignment of everything taken from a FrameArena, enough for SIMD loads
+#define ARENA_ALIGNMENT 32
+
+// Size of the block a FrameArena starts out with, in bytes
+#define ARENA_INITIAL_SIZE (64 * 1024)
+
+// Memory for one frame, see FRAME ARENA above. Only to be allocated from on
+// one thread at a time (memory taken from it can be used on any).
+struct FrameArena
+{
+    FrameArena() = default;
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+    ~FrameArena();
+
+    unsigned char *block = nullptr; // Memory bumped through
+    size_t size = 0;                // Bytes in 'block'
+    size_t used = 0;                // Bytes of 'block' taken this frame
+    void *overflow = nullptr;       // Heap allocations this frame that didn't fit (a list)
+    size_t overflow_bytes = 0;      // Bytes in them
+    size_t peak = 0;                // Most bytes taken in one frame so far
+};
+
+// Gives back everything taken from 'arena' since the last reset. Grows its
+// block if the frame before needed more than it has.
+void arena_reset(FrameArena &arena);
+
+// 'bytes' of memory (ARENA_ALIGNMENT aligned, not cleared) from 'arena', until its next reset
+void *arena_alloc(FrameArena &arena, size_t bytes);
+
+// Room for 'count' T's from 'arena', not constructed. Only for types that
+// don't need their destructor called, since it never is.
+template<typename T>
+T *arena_array(FrameArena &arena, size_t count)
+{
+    static_assert(alignof(T) <= ARENA_ALIGNMENT, "Type needs more alignment than the arena gives");
+    return static_cast<T *>(arena_alloc(arena, count * sizeof(T)));
+}
+
+#ifdef COUNT_ALLOCATIONS
+// Heap allocations made through operator new so far, on every thread
+uint64_t allocation_count();
+#else
+inline uint64_t allocation_count()
+{
+    return 0;
+}
+#endif
+
+#endif
@@ -0,0 +1,1318 @@
+#include "bench.h"
+#include "arena.h"
+#include "camera.h"
+#include "framebuffer.h"
+#include "globals.h"
+#include "light.h"
+#include "map.h"
+#include "physics.h"
+#include "profiler.h"
+#include "presenter.h"
+#include "raycast.h"
+#include "recording.h"
+#include "session.h"
+#include "simulation.h"
+#include "sprite.h"
+#include "subcell.h"
+#include "thread_pool.h"
+#include "view.h"
+#include <algorithm> // sort, min, max
+#include <chrono> // steady_clock
+#include <cmath> // sinf, cosf
+#include <cstdio> // printf
+#include <cstdint> // uint64_t, uint32_t
+#include <cstring> // memcmp
+#include <fcntl.h> // open
+#include <unistd.h> // close
+#include <utility> // pair
+
+// Position and angle of the camera at one point along the camera path
+struct Keyframe
+{
+    float x;
+    float y;
+    float a;
+};
+
+// Camera path through the built in map. Walks along the top corridor, turns
+// around, goes down through the gap into the middle room, walks across it
+// and does a full spin in place. Then goes down into the bottom corridor and
+// ends looking along it, at walls further away than MAX_DEPTH and out through
+// a hole in the outer wall (see 'open_bench_map'), so the last frame has
+// columns at the far end of the gradients and columns that hit nothing.
+// The camera moves at constant speed between two keyframes, each pair of
+// keyframes takes the same number of frames.
+static const Keyframe camera_path[] =
+{
+    { 1.5f, 1.5f,  1.57f},
+    {17.5f, 1.5f,  1.57f},
+    {17.5f, 1.5f, -1.57f},
+    { 7.5f, 1.5f, -1.57f},
+    { 7.5f, 1.5f,  0.0f },
+    { 7.5f, 8.5f,  0.0f },
+    { 7.5f, 8.5f,  1.57f},
+    {17.5f, 8.5f,  1.57f},
+    {17.5f, 8.5f,  1.57f + 2 * PI},
+    {17.5f, 8.5f,  2 * PI},
+    {17.5f, 17.5f, 2 * PI},
+    {17.5f, 17.5f, -1.57f + 2 * PI},
+};
+static const int num_keyframes = sizeof(camera_path) / sizeof(camera_path[0]);
+
+// The built in map with a hole in the outer wall at the end of the bottom
+// corridor, for the camera path to look out of
+static void open_bench_map(Map &map)
+{
+    create_default_map(map);
+    map.set(0, 17, CELL_EMPTY);
+    map.set(0, 18, CELL_EMPTY);
+}
+
+// Camera position and angle for frame number 'frame' out of 'num_frames'
+static Keyframe camera_at(int frame, int num_frames)
+{
+    float t = (num_frames > 1) ? (float)frame / (num_frames - 1) : 0.0f;
+    float segment_pos = t * (num_keyframes - 1);
+    int segment = std::min((int)segment_pos, num_keyframes - 2);
+    float f = segment_pos - segment;
+
+    const Keyframe &from = camera_path[segment];
+    const Keyframe &to = camera_path[segment + 1];
+    return Keyframe{from.x + (to.x - from.x) * f,
+                    from.y + (to.y - from.y) * f,
+                    from.a + (to.a - from.a) * f};
+}
+
+// FNV-1a hash of every cell in the frame, to tell if two runs rendered the same thing
+static uint64_t frame_checksum(const FrameBuffer &fb)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const Cell &cell : fb.cells)
+    {
+        unsigned char bytes[3] = {(unsigned char)cell.glyph,
+                                  (unsigned char)(cell.color_pair & 0xff),
+                                  (unsigned char)(cell.color_pair >> 8)};
+        for (unsigned char byte : bytes)
+        {
+            hash ^= byte;
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+bool parse_bench_sizes(const std::string &text, std::vector<BenchSize> &sizes)
+{
+    sizes.clear();
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        size_t end = text.find(',', pos);
+        if (end == std::string::npos)
+        {
+            end = text.size();
+        }
+        BenchSize size;
+        char trailing;
+        if (sscanf(text.substr(pos, end - pos).c_str(), "%dx%d%c", &size.width, &size.height, &trailing) != 2 ||
+            size.width <= 0 || size.height <= 0)
+        {
+            return false;
+        }
+        sizes.push_back(size);
+        pos = end + 1;
+    }
+    return !sizes.empty();
+}
+
+// Number of rays in each fan of rays cast by the raycast benchmark
+#define BENCH_FAN_WIDTH 400
+
+// True if 'a' and 'b' are the same, bit for bit
+static bool same_hit(const RayHit &a, const RayHit &b)
+{
+    return a.hit == b.hit && a.mapX == b.mapX && a.mapY == b.mapY && a.cell == b.cell && a.face == b.face &&
+           memcmp(&a.distance, &b.distance, sizeof(float)) == 0 &&
+           memcmp(&a.texX, &b.texX, sizeof(float)) == 0;
+}
+
+// Casts the same set of rays with every raycaster the CPU supports, and
+// compares how fast they are and that they hit the same walls.
+// The rays come in fans, like the rays of the screen columns seen from a
+// random spot in the map looking in a random direction.
+static int run_raycast_bench(const BenchOptions &options)
+{
+    Map map;
+    if (options.map_path.empty())
+    {
+        int map_size = (options.map_size > 0) ? options.map_size : 2048;
+        generate_map(map, map_size, map_size, 1);
+    }
+    else
+    {
+        std::string error;
+        if (!load_map(options.map_path, map, error))
+        {
+            printf("Could not load map: %s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    // Fans of rays from random empty cells (same every run)
+    struct Fan
+    {
+        float x, y;
+        std::vector<float> rayX, rayY;
+    };
+    int num_fans = std::max(1, options.rays / BENCH_FAN_WIDTH);
+    std::vector<Fan> fans;
+    fans.reserve(num_fans);
+    Camera camera;
+    camera_resize(camera, BENCH_FAN_WIDTH, (options.fov > 0.0f) ? options.fov : (float)FOV);
+    uint32_t state = 12345;
+    auto next_random = [&state]() -> float
+    {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    };
+    while ((int)fans.size() < num_fans)
+    {
+        float x = next_random() * map.width;
+        float y = next_random() * map.height;
+        if (map.is_wall((int)x, (int)y))
+        {
+            continue;
+        }
+        camera_set_angle(camera, next_random() * 2 * PI);
+        fans.push_back(Fan{x, y, camera.rayX, camera.rayY});
+    }
+    size_t num_rays = (size_t)num_fans * BENCH_FAN_WIDTH;
+
+    printf("Raycast benchmark: %zu rays in fans of %d on %dx%d map, max ray depth %d, auto picks %s\n",
+           num_rays, BENCH_FAN_WIDTH, map.width, map.height, MAX_RAY_DEPTH,
+           raycaster_name(select_raycaster(map, RAYCASTER_AUTO)));
+
+    // RAYCASTER_SCALAR goes first, the others are checked against it
+    const Raycaster raycasters[] = {RAYCASTER_SCALAR, RAYCASTER_SKIP, RAYCASTER_SSE, RAYCASTER_AVX2};
+    std::vector<RayHit> reference;
+    std::vector<RayHit> hits(num_rays);
+    for (Raycaster raycaster : raycasters)
+    {
+        if (!raycaster_supported(raycaster))
+        {
+            printf("  %-7s  not supported by this CPU\n", raycaster_name(raycaster));
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < fans.size(); ++i)
+        {
+            cast_rays(map, fans[i].x, fans[i].y, fans[i].rayX.data(), fans[i].rayY.data(),
+                      BENCH_FAN_WIDTH, raycaster, &hits[i * BENCH_FAN_WIDTH]);
+        }
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double total_distance = 0.0;
+        for (const RayHit &hit : hits)
+        {
+            total_distance += hit.distance;
+        }
+        printf("  %-7s  %8.2f Mrays/s  %7.1f ns/ray  average distance %.2f",
+               raycaster_name(raycaster), num_rays / sec / 1e6, sec * 1e9 / num_rays,
+               total_distance / num_rays);
+
+        if (raycaster == RAYCASTER_SCALAR)
+        {
+            reference = hits;
+            printf("\n");
+        }
+        else if (raycaster == RAYCASTER_SKIP)
+        {
+            // Rays that pass (within float rounding) right through the corner of a
+            // wall can go either way, depending on how the distances were added up
+            int mismatches = 0;
+            for (size_t i = 0; i < num_rays; ++i)
+            {
+                if (hits[i].hit != reference[i].hit || hits[i].mapX != reference[i].mapX || hits[i].mapY != reference[i].mapY)
+                {
+                    ++mismatches;
+                }
+            }
+            printf("  %d hit a different wall (grazing a corner)\n", mismatches);
+        }
+        else
+        {
+            int mismatches = 0;
+            for (size_t i = 0; i < num_rays; ++i)
+            {
+                if (!same_hit(hits[i], reference[i]))
+                {
+                    ++mismatches;
+                }
+            }
+            printf("  %d differ from scalar\n", mismatches);
+            if (mismatches != 0)
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Results of rendering frames at one screen size
+struct FrameStats
+{
+    double fps;
+    double p50; // Median frame time (ms)
+    double p99; // 99th percentile frame time (ms)
+    uint64_t checksum; // Of the last frame
+    double pack_p50;   // Median time packing sub-cells took (ms), over the last PROFILE_HISTORY frames
+    bool pack_matches; // Packing of the last frame matches 'pack_pixels_reference'
+    uint64_t frames_checksum; // Of every frame, if asked for
+    double sprites_p50;        // Median time finding and drawing sprites took (ms), like 'pack_p50'
+    double sprites_considered; // Average number of sprites in the grid cells looked at per frame
+    double sprites_visible;    // Average number of sprites in view per frame
+    double raycast_p50;        // Median time raycasting took (ms), like 'pack_p50'
+    double columns_reused;     // Average share of the columns reused from the frame before
+    int allocating_frames;     // Frames after the first that allocated heap memory
+};
+
+// Renders 'options.frames' frames along the camera path at 'size', or from
+// the spots in 'cameras' (one per frame) if it isn't empty.
+// 'checksum_every_frame' fills in 'FrameStats::frames_checksum'.
+static FrameStats bench_frames(const Map &map, const BenchOptions &options, const ViewSettings &settings,
+                               BenchSize size, ThreadPool &pool,
+                               const std::vector<Keyframe> &cameras = std::vector<Keyframe>(),
+                               bool checksum_every_frame = false)
+{
+    ViewBuffers buffers;
+    FrameBuffer fb;
+    Camera camera;
+    std::vector<double> frame_ms(options.frames);
+
+    // The rendering code draws at the size in these globals
+    screen_width = size.width;
+    screen_height = size.height;
+    fb_reset(fb, screen_width, screen_height, Cell{' ', 0});
+    camera_resize(camera, view_columns(settings), (options.fov > 0.0f) ? options.fov : (float)FOV);
+
+    uint64_t frames_checksum = 0;
+    long sprites_considered = 0;
+    long sprites_visible = 0;
+    long columns_reused = 0;
+    int allocating_frames = 0;
+    auto bench_start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < options.frames; ++frame)
+    {
+        Keyframe keyframe = cameras.empty() ? camera_at(frame, options.frames) : cameras[frame];
+        profiler_begin_frame();
+
+        uint64_t allocations = allocation_count();
+        auto frame_start = std::chrono::steady_clock::now();
+        camera_set_angle(camera, keyframe.a);
+        render_view(map, keyframe.x, keyframe.y, camera, settings, pool, buffers, fb);
+        auto frame_end = std::chrono::steady_clock::now();
+        if (frame > 0 && allocation_count() != allocations)
+        {
+            ++allocating_frames; // The first frame sizes everything, none after it should allocate
+        }
+
+        frame_ms[frame] = std::chrono::duration<double, std::milli>(frame_end - frame_start).count();
+        sprites_considered += buffers.sprites_considered;
+        sprites_visible += (long)buffers.visible_sprites.size();
+        columns_reused += buffers.columns_reused;
+        if (checksum_every_frame)
+        {
+            frames_checksum = frames_checksum * 31 + frame_checksum(fb);
+        }
+    }
+    double total_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - bench_start).count();
+
+    std::vector<double> sorted = frame_ms;
+    std::sort(sorted.begin(), sorted.end());
+
+    FrameStats stats;
+    stats.fps = options.frames / total_sec;
+    stats.p50 = sorted[(sorted.size() - 1) * 50 / 100];
+    stats.p99 = sorted[(sorted.size() - 1) * 99 / 100];
+    stats.checksum = frame_checksum(fb);
+    stats.pack_p50 = profiler_stats(STAGE_PACK).p50;
+    stats.pack_matches = true;
+    stats.frames_checksum = frames_checksum;
+    stats.sprites_p50 = profiler_stats(STAGE_SPRITES).p50;
+    stats.sprites_considered = (double)sprites_considered / options.frames;
+    stats.sprites_visible = (double)sprites_visible / options.frames;
+    stats.raycast_p50 = profiler_stats(STAGE_RAYCAST).p50;
+    stats.columns_reused = (double)columns_reused / options.frames / camera.width;
+    stats.allocating_frames = allocating_frames;
+    SubcellMode subcells = settings.colored_output ? settings.subcells : SUBCELL_NONE;
+    if (subcells != SUBCELL_NONE)
+    {
+        FrameBuffer reference = fb;
+        pack_pixels_reference(subcells, buffers.pixels, reference);
+        stats.pack_matches = (reference.cells == fb.cells);
+    }
+    return stats;
+}
+
+// How far frames raycast at every 'ViewSettings::column_step' columns are
+// from frames raycast at every column
+struct ColumnStepError
+{
+    int frames_off;       // Frames with any cell different
+    double cells_off;     // Average share of the cells that are different
+    double max_cells_off; // Largest share of them in one frame
+};
+
+// Renders the frames 'bench_frames' does both at 'settings.column_step' and
+// at every column, and compares every frame cell by cell. Not timed, so
+// the timings in 'bench_frames' don't include rendering everything twice.
+static ColumnStepError compare_column_step(const Map &map, const BenchOptions &options, const ViewSettings &settings,
+                                           BenchSize size, ThreadPool &pool)
+{
+    ViewSettings every_column = settings;
+    every_column.column_step = 1;
+    ViewBuffers buffers;
+    ViewBuffers every_column_buffers;
+    FrameBuffer fb;
+    FrameBuffer every_column_fb;
+    Camera camera;
+
+    screen_width = size.width;
+    screen_height = size.height;
+    fb_reset(fb, screen_width, screen_height, Cell{' ', 0});
+    fb_reset(every_column_fb, screen_width, screen_height, Cell{' ', 0});
+    camera_resize(camera, view_columns(settings), (options.fov > 0.0f) ? options.fov : (float)FOV);
+
+    ColumnStepError error = {0, 0.0, 0.0};
+    for (int frame = 0; frame < options.frames; ++frame)
+    {
+        Keyframe keyframe = camera_at(frame, options.frames);
+        camera_set_angle(camera, keyframe.a);
+        render_view(map, keyframe.x, keyframe.y, camera, settings, pool, buffers, fb);
+        render_view(map, keyframe.x, keyframe.y, camera, every_column, pool, every_column_buffers, every_column_fb);
+
+        int cells_off = 0;
+        for (size_t i = 0; i < fb.cells.size(); ++i)
+        {
+            const Cell &a = fb.cells[i];
+            const Cell &b = every_column_fb.cells[i];
+            cells_off += (a.glyph != b.glyph || a.color_pair != b.color_pair) ? 1 : 0;
+        }
+        double share = (double)cells_off / fb.cells.size();
+        error.frames_off += (cells_off > 0) ? 1 : 0;
+        error.cells_off += share / options.frames;
+        error.max_cells_off = std::max(error.max_cells_off, share);
+    }
+    return error;
+}
+
+static void print_frame_stats(BenchSize size, const FrameStats &stats, const char *label, SubcellMode subcells)
+{
+    printf("%4dx%-4d %s %9.1f fps  p50 %8.3f ms  p99 %8.3f ms  checksum %016llx\n",
+           size.width, size.height, label, stats.fps, stats.p50, stats.p99,
+           (unsigned long long)stats.checksum);
+    if (subcells != SUBCELL_NONE)
+    {
+        printf("           packing p50 %.3f ms (%.0f%% of frame)%s\n", stats.pack_p50,
+               100.0 * stats.pack_p50 / stats.p50, stats.pack_matches ? "" : ", DOESN'T MATCH REFERENCE");
+    }
+    if (stats.allocating_frames > 0)
+    {
+        printf("           %d frames after the first allocated heap memory\n", stats.allocating_frames);
+    }
+}
+
+// Replays a recording, rendering the frames it drew one after the other.
+// The player moves the way it did when the recording was made, so it is a
+// benchmark of what a real session looks like.
+static int run_replay_bench(const BenchOptions &options)
+{
+    Replay replay;
+    std::string error;
+    if (!replay_open(replay, options.replay_path, error))
+    {
+        printf("Could not load recording: %s\n", error.c_str());
+        return 1;
+    }
+    const RecordingHeader &header = replay.header;
+
+    Map map;
+    if (options.map_path.empty())
+    {
+        create_default_map(map);
+    }
+    else if (!load_map(options.map_path, map, error))
+    {
+        printf("Could not load map: %s\n", error.c_str());
+        return 1;
+    }
+    if (header.map_width != (uint32_t)map.width || header.map_height != (uint32_t)map.height ||
+        header.map_hash != map_hash(map))
+    {
+        printf("Recording was made on another map (%ux%u), give the same --map\n",
+               header.map_width, header.map_height);
+        return 1;
+    }
+
+    // Replayed the same way as in the game loop, without waiting for the frame times
+    screen_width = header.screen_width;
+    screen_height = header.screen_height;
+    Session session;
+    recording_header_apply(header, session);
+    auto start = std::chrono::steady_clock::time_point();
+    session_init(session, PlayerState{header.start_x, header.start_y, header.start_angle}, start);
+
+    // Frames are printed like in the game loop, to /dev/null instead of a
+    // terminal, so a frame takes about as long as in the game
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd < 0)
+    {
+        printf("Could not open /dev/null\n");
+        return 1;
+    }
+    AnsiBackend backend(null_fd);
+    Presenter presenter;
+    presenter_resize(presenter, screen_width, screen_height + STATUS_ROWS);
+    backend.resize(presenter.back.width, presenter.back.height);
+    backend.init();
+    FrameBuffer &fb = presenter.back;
+
+    ThreadPool pool(options.threads);
+    ViewBuffers buffers;
+    Camera camera;
+
+    // Same sprites and lights as the game scatters
+    Sprites sprites;
+    scatter_sprites(sprites, map, options.replay_sprites, 1);
+    std::vector<Light> lights;
+    map_lights(map, lights);
+    scatter_lights(lights, map, options.replay_lights, 1);
+    LightMap light_map;
+    if (!lights.empty())
+    {
+        light_map_bake(light_map, map, lights, pool);
+    }
+
+    printf("Replay benchmark: '%s' at %dx%d, %d thread(s), %s raycaster\n", options.replay_path.c_str(),
+           screen_width, screen_height, pool.thread_count(), raycaster_name(select_raycaster(map, options.raycaster)));
+
+    // Frames are encoded the way --record-frames records them, to see what that costs
+    std::vector<unsigned char> encoded;
+    size_t encoded_bytes = 0;
+
+    std::vector<double> frame_ms;
+    double frame_total_ms = 0.0;
+    double encode_total_ms = 0.0;
+    int frames = 0;     // Frames in the recording
+    int compared = 0;   // Frames compared to the recorded frame
+    int mismatches = 0; // Frames that didn't match the recorded frame
+    int steady = 0;     // Frames drawn at the same size and settings as the one before
+    int allocating = 0; // Of those, frames that allocated heap memory
+    ViewSettings last_settings;
+    bool resized = true;
+    ReplayFrame frame;
+    auto bench_start = std::chrono::steady_clock::now();
+    while (replay_next_frame(replay, start, frame, error))
+    {
+        ++frames;
+        if (replay.screen_width != screen_width || replay.screen_height != screen_height)
+        {
+            // Terminal was resized while recording
+            resize_screen(presenter, backend, replay.screen_width, replay.screen_height);
+            resized = true;
+        }
+        for (const KeyEvent &event : frame.events)
+        {
+            session_key_event(session, event);
+        }
+        session_update(session, map, start + frame.time);
+        if (!frame.drawn)
+        {
+            continue;
+        }
+        PlayerState player = sim_interpolate(session.sim);
+        profiler_begin_frame();
+
+        auto frame_start = std::chrono::steady_clock::now();
+        ViewSettings settings;
+        settings.raycaster = options.raycaster;
+        settings.colored_output = session.colored_output;
+        settings.textures = session.textured ? options.textures : nullptr;
+        settings.subcells = session.subcells;
+        settings.column_step = replay.column_step;
+        settings.sprites = sprites.x.empty() ? nullptr : &sprites;
+        settings.lights = lights.empty() ? nullptr : &light_map;
+
+        // Everything is already sized for a frame drawn like the one before
+        // it, so drawing and printing it shouldn't allocate
+        bool same_as_last = !resized && settings.colored_output == last_settings.colored_output &&
+                            settings.textures == last_settings.textures &&
+                            settings.subcells == last_settings.subcells &&
+                            settings.column_step == last_settings.column_step;
+        resized = false;
+        last_settings = settings;
+        uint64_t allocations = allocation_count();
+        camera_resize(camera, view_columns(settings), header.fov);
+        if (camera.angle != player.angle)
+        {
+            camera_set_angle(camera, player.angle);
+        }
+        render_view(map, player.x, player.y, camera, settings, pool, buffers, fb);
+        if (session.display_map)
+        {
+            draw_map_overlay(map, player.x, player.y, fb);
+        }
+        present(presenter, backend);
+        auto frame_end = std::chrono::steady_clock::now();
+        if (same_as_last)
+        {
+            ++steady;
+            allocating += (allocation_count() != allocations) ? 1 : 0;
+        }
+
+        encoded.clear();
+        encode_frame(fb, presenter.runs, encoded);
+        auto encode_end = std::chrono::steady_clock::now();
+        frame_ms.push_back(std::chrono::duration<double, std::milli>(frame_end - frame_start).count());
+        encoded_bytes += encoded.size();
+        if (frame_ms.size() > 1)
+        {
+            // (Not the first frame, printed and recorded whole, that only happens once)
+            frame_total_ms += frame_ms.back();
+            encode_total_ms += std::chrono::duration<double, std::milli>(encode_end - frame_end).count();
+        }
+
+        // The view should be what was recorded (not the frame timings, they
+        // are different every time)
+        if (frame.has_cells && !session.display_profiler && replay.frame.width == fb.width &&
+            replay.frame.height == fb.height)
+        {
+            ++compared;
+            size_t view_cells = (size_t)screen_width * screen_height;
+            if (!std::equal(fb.cells.begin(), fb.cells.begin() + view_cells, replay.frame.cells.begin()))
+            {
+                ++mismatches;
+            }
+        }
+    }
+    double total_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - bench_start).count();
+    backend.shutdown();
+    close(null_fd);
+    if (!error.empty())
+    {
+        printf("Could not replay recording: %s\n", error.c_str());
+        return 1;
+    }
+    if (frame_ms.empty())
+    {
+        printf("Recording has no frames drawn\n");
+        return 1;
+    }
+
+    int drawn = (int)frame_ms.size();
+    std::sort(frame_ms.begin(), frame_ms.end());
+    double p50 = frame_ms[(drawn - 1) * 50 / 100];
+    double encode_share = (frame_total_ms > 0.0) ? encode_total_ms / frame_total_ms : 0.0;
+    printf("%4dx%-4d %9.1f fps  p50 %8.3f ms  p99 %8.3f ms  checksum %016llx\n", screen_width, screen_height,
+           drawn / total_sec, p50, frame_ms[(drawn - 1) * 99 / 100], (unsigned long long)frame_checksum(fb));
+    printf("          %d frames drawn of %d, %.1f seconds of play\n", drawn, frames,
+           std::chrono::duration<double>(frame.time).count());
+    printf("          recording frames: encoding %.1f us per frame (%.1f%% of frame time, budget %.0f%%), %.0f bytes per frame\n",
+           encode_total_ms * 1000.0 / std::max(drawn - 1, 1), 100.0 * encode_share, 100.0 * RECORD_BUDGET, (double)encoded_bytes / drawn);
+#ifdef COUNT_ALLOCATIONS
+    printf("          %d of %d frames drawn like the one before allocated heap memory\n", allocating, steady);
+#else
+    printf("          heap allocations not counted (build with 'make bench')\n");
+#endif
+    if (header.flags & RECORDING_FRAMES)
+    {
+        printf("          %d of %d recorded frames compared don't match\n", mismatches, compared);
+    }
+
+    if (mismatches != 0)
+    {
+        printf("Replayed frames don't match the recording\n");
+        return 1;
+    }
+    if (encode_share > RECORD_BUDGET && drawn >= RECORD_BUDGET_MIN_FRAMES)
+    {
+        printf("Encoding frames for recording is over budget\n");
+        return 1;
+    }
+    if (allocating != 0)
+    {
+        printf("Frames allocated heap memory once everything was sized for them\n");
+        return 1;
+    }
+    return 0;
+}
+
+// A camera spot for every frame, each looking straight at a random one of
+// the points 'x', 'y' from 1 to 'max_distance' tiles away, standing in an
+// empty tile with nothing in between. If 'max_wall_behind' is more than 0
+// there has to be a wall at most that far behind the point as well. Same
+// every run.
+// Returns no spots if too few of them could be found (the points are all
+// inside walls or out in the open).
+static std::vector<Keyframe> cameras_looking_at(const Map &map, const std::vector<float> &x,
+                                                const std::vector<float> &y, float max_distance,
+                                                float max_wall_behind, int frames)
+{
+    std::vector<Keyframe> cameras;
+    uint32_t state = 12345;
+    auto next_random = [&state]() -> float
+    {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    };
+    long tries = x.empty() ? 0 : (long)frames * 1000;
+    for (; tries > 0 && (int)cameras.size() < frames; --tries)
+    {
+        int target = std::min((int)(next_random() * x.size()), (int)x.size() - 1);
+        float distance = 1.0f + next_random() * (max_distance - 1.0f);
+        float a = next_random() * 2 * PI;
+        float dirX = sinf(a);
+        float dirY = cosf(a);
+        float cameraX = x[target] - dirX * distance;
+        float cameraY = y[target] - dirY * distance;
+        if (cameraX < 0.0f || cameraY < 0.0f || cameraX >= map.width || cameraY >= map.height ||
+            map.is_wall((int)cameraX, (int)cameraY))
+        {
+            continue;
+        }
+        RayHit hit = cast_ray(map, cameraX, cameraY, dirX, dirY);
+        bool in_view = !hit.hit || hit.distance > distance;
+        bool wall_behind = max_wall_behind <= 0.0f || (hit.hit && hit.distance <= distance + max_wall_behind);
+        if (in_view && wall_behind)
+        {
+            cameras.push_back(Keyframe{cameraX, cameraY, a});
+        }
+    }
+    if ((int)cameras.size() < frames)
+    {
+        cameras.clear();
+    }
+    return cameras;
+}
+
+// Renders frames from random spots on a map full of sprites, with the
+// sprites in view found through their grid, and by checking every one of
+// them, and compares the two
+static int run_sprite_bench(const BenchOptions &options)
+{
+    Map map;
+    if (options.map_path.empty())
+    {
+        int map_size = (options.map_size > 0) ? options.map_size : 256;
+        generate_map(map, map_size, map_size, 1);
+    }
+    else
+    {
+        std::string error;
+        if (!load_map(options.map_path, map, error))
+        {
+            printf("Could not load map: %s\n", error.c_str());
+            return 1;
+        }
+    }
+    Sprites sprites;
+    scatter_sprites(sprites, map, options.sprites, 1);
+
+    // Looking at a sprite every frame, random spots on a big map would hardly
+    // ever see one
+    std::vector<Keyframe> cameras = cameras_looking_at(map, sprites.x, sprites.y, BENCH_SPRITE_DISTANCE, 0.0f,
+                                                       options.frames);
+    if (cameras.empty())
+    {
+        printf("No sprites in the open to render frames of\n");
+        return 1;
+    }
+
+    ThreadPool pool(options.threads);
+    ViewSettings settings;
+    settings.raycaster = options.raycaster;
+    settings.colored_output = options.colored_output;
+    settings.textures = options.textured ? options.textures : nullptr;
+    settings.subcells = options.subcells;
+    settings.column_step = options.column_step;
+    settings.sprites = &sprites;
+    ViewSettings every_sprite = settings;
+    every_sprite.sprite_grid = false;
+
+    printf("Sprite benchmark: %d sprites on %dx%d map, %d frames looking at a sprite per size, %d thread(s)\n",
+           (int)sprites.x.size(), map.width, map.height, options.frames, pool.thread_count());
+    bool matches = true;
+    for (const BenchSize &size : options.sizes)
+    {
+        FrameStats grid_stats = bench_frames(map, options, settings, size, pool, cameras, true);
+        FrameStats every_stats = bench_frames(map, options, every_sprite, size, pool, cameras, true);
+        print_frame_stats(size, grid_stats, "", options.colored_output ? options.subcells : SUBCELL_NONE);
+        printf("           sprites p50 %.3f ms (%.0f%% of frame), %.1f looked at and %.1f in view per frame\n",
+               grid_stats.sprites_p50, 100.0 * grid_stats.sprites_p50 / grid_stats.p50,
+               grid_stats.sprites_considered, grid_stats.sprites_visible);
+        printf("           checking every sprite: sprites p50 %.3f ms (%.1fx as long)%s\n", every_stats.sprites_p50,
+               every_stats.sprites_p50 / std::max(grid_stats.sprites_p50, 1e-6),
+               (every_stats.frames_checksum == grid_stats.frames_checksum) ? "" : ", FRAMES DON'T MATCH");
+        matches = matches && every_stats.frames_checksum == grid_stats.frames_checksum;
+    }
+    if (!matches)
+    {
+        printf("Sprites found through the grid don't match checking every sprite\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Bakes the light map of a map full of lights, changes lights and walls
+// re-baking only what changed, checks that against baking it whole, and
+// renders frames lit and unlit
+static int run_light_bench(const BenchOptions &options)
+{
+    Map map;
+    if (options.map_path.empty())
+    {
+        int map_size = (options.map_size > 0) ? options.map_size : 256;
+        generate_map(map, map_size, map_size, 1);
+    }
+    else
+    {
+        std::string error;
+        if (!load_map(options.map_path, map, error))
+        {
+            printf("Could not load map: %s\n", error.c_str());
+            return 1;
+        }
+    }
+    std::vector<Light> lights;
+    map_lights(map, lights);
+    scatter_lights(lights, map, options.lights, 1);
+
+    uint32_t state = 12345;
+    auto next_random = [&state]() -> float
+    {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    };
+
+    // Whole map, on one thread and on the pool
+    ThreadPool single(1);
+    ThreadPool pool(options.threads);
+    LightMap single_map;
+    auto bake_start = std::chrono::steady_clock::now();
+    light_map_bake(single_map, map, lights, single);
+    auto bake_end = std::chrono::steady_clock::now();
+    LightMap light_map;
+    light_map_bake(light_map, map, lights, pool);
+    auto pool_end = std::chrono::steady_clock::now();
+    double single_ms = std::chrono::duration<double, std::milli>(bake_end - bake_start).count();
+    double pool_ms = std::chrono::duration<double, std::milli>(pool_end - bake_end).count();
+    bool matches = (single_map.levels == light_map.levels);
+
+    printf("Lighting benchmark: %d lights on %dx%d map, %d thread(s)\n", (int)lights.size(), map.width, map.height,
+           pool.thread_count());
+    printf("          baking: %.1f ms on 1 thread, %.1f ms on %d (%.1fx as fast)%s\n", single_ms, pool_ms,
+           pool.thread_count(), single_ms / std::max(pool_ms, 1e-6), matches ? "" : ", DOESN'T MATCH");
+
+    // Changes cycle through moving a light, adding or taking away a wall,
+    // adding a light and removing one. Walls aren't changed on the edge of
+    // the map, so it stays closed.
+    const int num_kinds = 4;
+    const char *kind_names[num_kinds] = {"moving a light", "changing a wall", "adding a light", "removing a light"};
+    double change_ms[num_kinds] = {};
+    long change_tiles[num_kinds] = {};
+    int change_count[num_kinds] = {};
+    int checks = 0;
+    for (int change = 0; change < options.light_changes; ++change)
+    {
+        int kind = change % num_kinds;
+        if (kind != 1 && light_map.lights.empty())
+        {
+            kind = 2; // Nothing to move or remove
+        }
+        auto change_start = std::chrono::steady_clock::now();
+        if (kind == 0)
+        {
+            int index = (int)(next_random() * light_map.lights.size());
+            const Light &light = light_map.lights[index];
+            float x = std::min(std::max(light.x + (next_random() - 0.5f) * 4.0f, 0.0f), map.width - 0.01f);
+            float y = std::min(std::max(light.y + (next_random() - 0.5f) * 4.0f, 0.0f), map.height - 0.01f);
+            light_map_move(light_map, map, index, x, y, pool);
+        }
+        else if (kind == 1)
+        {
+            int x = 1 + (int)(next_random() * (map.width - 2));
+            int y = 1 + (int)(next_random() * (map.height - 2));
+            map.set(x, y, map.is_wall(x, y) ? CELL_EMPTY : CELL_WALL);
+            light_map_wall_changed(light_map, map, x, y, pool);
+        }
+        else if (kind == 2)
+        {
+            Light light;
+            light.x = next_random() * map.width;
+            light.y = next_random() * map.height;
+            light_map_add(light_map, map, light, pool);
+        }
+        else
+        {
+            light_map_remove(light_map, map, (int)(next_random() * light_map.lights.size()), pool);
+        }
+        // (Changing a wall includes rebuilding the map's distance field)
+        change_ms[kind] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                                     change_start).count();
+        change_tiles[kind] += light_map.tiles_baked;
+        ++change_count[kind];
+
+        if (change % 20 == 19 || change == options.light_changes - 1)
+        {
+            LightMap whole;
+            light_map_bake(whole, map, light_map.lights, pool);
+            ++checks;
+            matches = matches && (whole.levels == light_map.levels);
+        }
+    }
+    for (int kind = 0; kind < num_kinds; ++kind)
+    {
+        if (change_count[kind] > 0)
+        {
+            printf("          %-16s %8.3f ms per change (%.2f%% of baking), %7.0f tiles re-baked (%.2f%% of map)\n",
+                   kind_names[kind], change_ms[kind] / change_count[kind],
+                   100.0 * change_ms[kind] / change_count[kind] / std::max(pool_ms, 1e-6),
+                   (double)change_tiles[kind] / change_count[kind],
+                   100.0 * change_tiles[kind] / change_count[kind] / ((double)map.width * map.height));
+        }
+    }
+    printf("          %d changes, re-baked light map checked against baking it whole %d times%s\n",
+           options.light_changes, checks, matches ? "" : ", DOESN'T MATCH");
+
+    // Looking at a light every frame, with a wall behind it close enough to be
+    // lit by it (lights only show on walls)
+    std::vector<float> light_x;
+    std::vector<float> light_y;
+    for (const Light &light : light_map.lights)
+    {
+        light_x.push_back(light.x);
+        light_y.push_back(light.y);
+    }
+    std::vector<Keyframe> cameras = cameras_looking_at(map, light_x, light_y, LIGHT_DEFAULT_RADIUS,
+                                                       LIGHT_DEFAULT_RADIUS, options.frames);
+    if (cameras.empty())
+    {
+        printf("No lights in the open to render frames of\n");
+        return 1;
+    }
+
+    // Lit with the light map re-baked a piece at a time, and baked whole,
+    // every frame has to be the same
+    LightMap whole;
+    light_map_bake(whole, map, light_map.lights, pool);
+    ViewSettings settings;
+    settings.raycaster = options.raycaster;
+    settings.colored_output = options.colored_output;
+    settings.textures = options.textured ? options.textures : nullptr;
+    settings.subcells = options.subcells;
+    settings.column_step = options.column_step;
+    settings.lights = &light_map;
+    ViewSettings whole_lit = settings;
+    whole_lit.lights = &whole;
+    ViewSettings unlit = settings;
+    unlit.lights = nullptr;
+    bool frames_match = true;
+    bool frames_lit = true;
+    for (const BenchSize &size : options.sizes)
+    {
+        FrameStats lit_stats = bench_frames(map, options, settings, size, pool, cameras, true);
+        FrameStats whole_stats = bench_frames(map, options, whole_lit, size, pool, cameras, true);
+        FrameStats unlit_stats = bench_frames(map, options, unlit, size, pool, cameras, true);
+        print_frame_stats(size, lit_stats, "", options.colored_output ? options.subcells : SUBCELL_NONE);
+        printf("           unlit: p50 %.3f ms (lit takes %.2fx as long)%s%s\n", unlit_stats.p50,
+               lit_stats.p50 / std::max(unlit_stats.p50, 1e-6),
+               (whole_stats.frames_checksum == lit_stats.frames_checksum) ? "" : ", FRAMES DON'T MATCH BAKING WHOLE",
+               (unlit_stats.frames_checksum != lit_stats.frames_checksum) ? "" : ", FRAMES AREN'T LIT");
+        frames_match = frames_match && whole_stats.frames_checksum == lit_stats.frames_checksum;
+        frames_lit = frames_lit && unlit_stats.frames_checksum != lit_stats.frames_checksum;
+    }
+    if (!matches)
+    {
+        printf("Re-baked light map doesn't match baking it whole\n");
+        return 1;
+    }
+    if (!frames_match)
+    {
+        printf("Frames lit by the re-baked light map don't match baking it whole\n");
+        return 1;
+    }
+    if (!frames_lit)
+    {
+        printf("Lit frames are the same as unlit ones\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Moves bodies around a map, colliding with the walls and each other, and
+// times single moves from random spots
+static int run_collision_bench(const BenchOptions &options)
+{
+    Map map;
+    if (options.map_path.empty())
+    {
+        int map_size = (options.map_size > 0) ? options.map_size : 256;
+        generate_map(map, map_size, map_size, 1);
+    }
+    else
+    {
+        std::string error;
+        if (!load_map(options.map_path, map, error))
+        {
+            printf("Could not load map: %s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    // Bodies at random spots clear of the walls, walking in random
+    // directions at the player's speed, same every run
+    uint32_t state = 12345;
+    auto next_random = [&state]() -> float
+    {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    };
+    Bodies bodies;
+    while ((int)bodies.x.size() < options.collision_bodies)
+    {
+        float x = next_random() * map.width;
+        float y = next_random() * map.height;
+        float a = next_random() * 2 * PI;
+        if (!body_in_wall(map, x, y, PLAYER_RADIUS))
+        {
+            bodies_add(bodies, x, y, sinf(a) * MOVE_SPEED, cosf(a) * MOVE_SPEED, PLAYER_RADIUS);
+        }
+    }
+    int count = (int)bodies.x.size();
+    printf("Collision benchmark: %d bodies on %dx%d map, %d ticks\n", count, map.width, map.height, options.frames);
+
+    CollisionGrid grid;
+    CollisionStats stats;
+    auto start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < options.frames; ++tick)
+    {
+        bodies_step(bodies, map, grid, (float)SIM_TICK, stats);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("  Moving:   %.3f ms per tick, %.1f M moves/s, %.1f M pair checks/s, %.2f overlaps per tick\n",
+           1000.0 * seconds / options.frames, stats.moves / seconds / 1e6, stats.pair_checks / seconds / 1e6,
+           (double)stats.overlaps / options.frames);
+
+    // Single moves from the bodies' spots, a tick's worth in random directions
+    std::vector<float> moveX(options.moves), moveY(options.moves), moveDX(options.moves), moveDY(options.moves);
+    for (int i = 0; i < options.moves; ++i)
+    {
+        int body = std::min((int)(next_random() * count), count - 1);
+        float a = next_random() * 2 * PI;
+        moveX[i] = bodies.x[body];
+        moveY[i] = bodies.y[body];
+        moveDX[i] = sinf(a) * MOVE_SPEED * (float)SIM_TICK;
+        moveDY[i] = cosf(a) * MOVE_SPEED * (float)SIM_TICK;
+    }
+    int blocked_moves = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.moves; ++i)
+    {
+        blocked_moves += move_and_slide(map, moveX[i], moveY[i], moveDX[i], moveDY[i], PLAYER_RADIUS) != 0;
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("  Queries:  %.1f M single moves/s (%.1f%% against a wall)\n", options.moves / seconds / 1e6,
+           100.0 * blocked_moves / std::max(options.moves, 1));
+
+    // No body may have ended up in a wall, and the grid has to find every
+    // pair that overlaps (checked against every other body, for a sample)
+    int in_wall = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        in_wall += body_in_wall(map, bodies.x[i], bodies.y[i], bodies.radius[i]);
+    }
+    collision_grid_build(grid, bodies.x.data(), bodies.y.data(), bodies.radius.data(), count, map.width, map.height);
+    auto overlap = [&bodies](int i, int j)
+    {
+        float dx = bodies.x[j] - bodies.x[i];
+        float dy = bodies.y[j] - bodies.y[i];
+        float min_distance = bodies.radius[i] + bodies.radius[j];
+        return i != j && dx * dx + dy * dy < min_distance * min_distance;
+    };
+    long grid_overlaps = 0;
+    long every_overlaps = 0;
+    int sample_step = std::max(1, count / 1000);
+    for (int i = 0; i < count; i += sample_step)
+    {
+        float r = bodies.radius[i];
+        collision_grid_query(grid, bodies.x[i] - r, bodies.y[i] - r, bodies.x[i] + r, bodies.y[i] + r,
+                             [&](int j) { grid_overlaps += overlap(i, j); });
+        for (int j = 0; j < count; ++j)
+        {
+            every_overlaps += overlap(i, j);
+        }
+    }
+    printf("  Checks:   %d bodies in walls, %ld overlaps found through the grid, %ld checking every body\n",
+           in_wall, grid_overlaps, every_overlaps);
+    if (in_wall > 0 || grid_overlaps != every_overlaps)
+    {
+        printf("Collision checks failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Renders the frames from 'cameras' reusing columns, and compares the hit
+// of every column with raycasting it, bit for bit like 'same_hit'. Adds
+// the columns that don't match to 'mismatches' and the ones reused to 'reused'.
+static void compare_reused_hits(const Map &map, const BenchOptions &options, const ViewSettings &settings,
+                                BenchSize size, ThreadPool &pool, const std::vector<Keyframe> &cameras,
+                                long &mismatches, long &reused)
+{
+    ViewBuffers buffers;
+    FrameBuffer fb;
+    Camera camera;
+    screen_width = size.width;
+    screen_height = size.height;
+    fb_reset(fb, screen_width, screen_height, Cell{' ', 0});
+    camera_resize(camera, view_columns(settings), (options.fov > 0.0f) ? options.fov : (float)FOV);
+
+    std::vector<RayHit> reference(camera.width);
+    for (const Keyframe &keyframe : cameras)
+    {
+        camera_set_angle(camera, keyframe.a);
+        render_view(map, keyframe.x, keyframe.y, camera, settings, pool, buffers, fb);
+        reused += buffers.columns_reused;
+
+        // The hits of the frame just drawn are kept for the next one to reuse
+        cast_rays(map, keyframe.x, keyframe.y, camera.rayX.data(), camera.rayY.data(), camera.width,
+                  settings.raycaster, reference.data());
+        for (int x = 0; x < camera.width; ++x)
+        {
+            mismatches += same_hit(buffers.last_hits[x], reference[x]) ? 0 : 1;
+        }
+    }
+}
+
+// Renders frames turning in place at random spots on a map, reusing the
+// columns of the frame before and raycasting every column, and compares the two
+static int run_turn_bench(const BenchOptions &options)
+{
+    Map map;
+    if (options.map_path.empty())
+    {
+        int map_size = (options.map_size > 0) ? options.map_size : 256;
+        generate_map(map, map_size, map_size, 1);
+    }
+    else
+    {
+        std::string error;
+        if (!load_map(options.map_path, map, error))
+        {
+            printf("Could not load map: %s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    // BENCH_TURN_FRAMES frames turning one way at each random spot (in an
+    // empty tile), as fast as the player turns, same every run
+    std::vector<Keyframe> cameras;
+    uint32_t state = 12345;
+    auto next_random = [&state]() -> float
+    {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    };
+    float turn = TURN_SPEED * (float)SIM_TICK;
+    while ((int)cameras.size() < options.frames)
+    {
+        float x = next_random() * map.width;
+        float y = next_random() * map.height;
+        float a = next_random() * 2 * PI;
+        float direction = (next_random() < 0.5f) ? -1.0f : 1.0f;
+        if (map.is_wall((int)x, (int)y))
+        {
+            continue;
+        }
+        for (int frame = 0; frame < BENCH_TURN_FRAMES && (int)cameras.size() < options.frames; ++frame)
+        {
+            cameras.push_back(Keyframe{x, y, a + direction * turn * frame});
+        }
+    }
+
+    ThreadPool pool(options.threads);
+    ViewSettings settings;
+    settings.raycaster = options.raycaster;
+    settings.colored_output = options.colored_output;
+    settings.textures = options.textured ? options.textures : nullptr;
+    settings.subcells = options.subcells;
+    ViewSettings every_column = settings;
+    every_column.reuse_columns = false;
+
+    printf("Turning benchmark: %d frames on %dx%d map, turning %.3f radians per frame, %d frames per spot, "
+           "%d thread(s), %s raycaster\n", options.frames, map.width, map.height, turn, BENCH_TURN_FRAMES,
+           pool.thread_count(), raycaster_name(select_raycaster(map, options.raycaster)));
+    bool matches = true;
+    for (const BenchSize &size : options.sizes)
+    {
+        FrameStats reuse_stats = bench_frames(map, options, settings, size, pool, cameras, true);
+        FrameStats every_stats = bench_frames(map, options, every_column, size, pool, cameras, true);
+        long mismatches = 0;
+        long reused = 0;
+        compare_reused_hits(map, options, settings, size, pool, cameras, mismatches, reused);
+        print_frame_stats(size, reuse_stats, "", options.colored_output ? options.subcells : SUBCELL_NONE);
+        printf("           raycast p50 %.3f ms, %.1f%% of columns reused\n", reuse_stats.raycast_p50,
+               100.0 * reuse_stats.columns_reused);
+        printf("           raycasting every column: raycast p50 %.3f ms (%.1fx as long), p50 %.3f ms%s\n",
+               every_stats.raycast_p50, every_stats.raycast_p50 / std::max(reuse_stats.raycast_p50, 1e-6),
+               every_stats.p50,
+               (every_stats.frames_checksum == reuse_stats.frames_checksum) ? "" : ", FRAMES DON'T MATCH");
+        printf("           %ld of %ld reused columns hit something else than raycasting them\n", mismatches, reused);
+        matches = matches && every_stats.frames_checksum == reuse_stats.frames_checksum && mismatches == 0;
+    }
+    if (!matches)
+    {
+        printf("Frames reusing columns don't match raycasting every column\n");
+        return 1;
+    }
+    return 0;
+}
+
+int run_bench(const BenchOptions &options)
+{
+    if (options.raycast)
+    {
+        return run_raycast_bench(options);
+    }
+    if (!options.replay_path.empty())
+    {
+        return run_replay_bench(options);
+    }
+    if (options.sprites > 0)
+    {
+        return run_sprite_bench(options);
+    }
+    if (options.lights > 0)
+    {
+        return run_light_bench(options);
+    }
+    if (options.collision_bodies > 0)
+    {
+        return run_collision_bench(options);
+    }
+    if (options.turn)
+    {
+        return run_turn_bench(options);
+    }
+
+    Map map;
+    open_bench_map(map);
+    ThreadPool pool(options.threads);
+
+    ViewSettings settings;
+    settings.raycaster = options.raycaster;
+    settings.colored_output = options.colored_output;
+    settings.textures = options.textured ? options.textures : nullptr;
+    settings.subcells = options.subcells;
+    settings.column_step = options.column_step;
+    SubcellMode subcells = options.colored_output ? options.subcells : SUBCELL_NONE;
+
+    printf("Benchmark: %d frames per size, %s%s output%s%s, %d thread(s), %s raycaster",
+           options.frames, options.colored_output ? "colored" : "ascii",
+           options.texture_budget ? " untextured/textured" : (options.textured ? " textured" : ""),
+           (subcells != SUBCELL_NONE) ? " in sub-cells " : "",
+           (subcells != SUBCELL_NONE) ? subcell_mode_name(subcells) : "",
+           pool.thread_count(), raycaster_name(select_raycaster(map, options.raycaster)));
+    if (options.column_step > 1)
+    {
+        printf(" on every %d columns", options.column_step);
+    }
+    printf("\n");
+
+    // Packing has to give exactly what packing one cell at a time does, and
+    // after the first frame none should allocate (see arena.h)
+    bool pack_matches = true;
+    bool allocation_free = true;
+    if (!options.texture_budget)
+    {
+        for (const BenchSize &size : options.sizes)
+        {
+            FrameStats stats = bench_frames(map, options, settings, size, pool);
+            print_frame_stats(size, stats, "", subcells);
+            if (options.column_step > 1)
+            {
+                ColumnStepError error = compare_column_step(map, options, settings, size, pool);
+                printf("           %d of %d frames differ from raycasting every column, "
+                       "%.2f%% of the cells on average, at most %.2f%%\n",
+                       error.frames_off, options.frames, 100.0 * error.cells_off, 100.0 * error.max_cells_off);
+            }
+            pack_matches = pack_matches && stats.pack_matches;
+            allocation_free = allocation_free && stats.allocating_frames == 0;
+        }
+        if (!pack_matches)
+        {
+            printf("Packing sub-cells doesn't match the reference\n");
+            return 1;
+        }
+        if (!allocation_free)
+        {
+            printf("Frames allocated heap memory after the first\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    // Textured against untextured, at each size. Timing drifts with what
+    // else the machine is doing (and clock speed), so each textured run
+    // comes right after its untextured one, and the run with the median
+    // ratio of the two counts.
+    bool within_budget = true;
+    ViewSettings textured = settings;
+    textured.textures = options.textures;
+    settings.textures = nullptr;
+    for (const BenchSize &size : options.sizes)
+    {
+        std::vector<FrameStats> flat_runs;
+        std::vector<FrameStats> textured_runs;
+        std::vector<std::pair<double, int>> ratios; // Ratio and run
+        for (int run = 0; run < TEXTURE_BUDGET_RUNS; ++run)
+        {
+            flat_runs.push_back(bench_frames(map, options, settings, size, pool));
+            textured_runs.push_back(bench_frames(map, options, textured, size, pool));
+            ratios.push_back({textured_runs[run].p50 / flat_runs[run].p50, run});
+        }
+        std::sort(ratios.begin(), ratios.end());
+        double ratio = ratios[TEXTURE_BUDGET_RUNS / 2].first;
+        int median_run = ratios[TEXTURE_BUDGET_RUNS / 2].second;
+        print_frame_stats(size, flat_runs[median_run], "untextured", subcells);
+        print_frame_stats(size, textured_runs[median_run], "textured  ", subcells);
+        for (int run = 0; run < TEXTURE_BUDGET_RUNS; ++run)
+        {
+            pack_matches = pack_matches && flat_runs[run].pack_matches && textured_runs[run].pack_matches;
+            allocation_free = allocation_free && flat_runs[run].allocating_frames == 0 &&
+                              textured_runs[run].allocating_frames == 0;
+        }
+
+        printf("           textured takes %.2fx as long (median of %d runs, %.2fx to %.2fx, budget %.2fx)\n", ratio,
+               TEXTURE_BUDGET_RUNS, ratios.front().first, ratios.back().first, TEXTURE_BUDGET);
+        within_budget = within_budget && ratio <= TEXTURE_BUDGET;
+    }
+    if (!pack_matches)
+    {
+        printf("Packing sub-cells doesn't match the reference\n");
+        return 1;
+    }
+    if (!within_budget)
+    {
+        printf("Textured rendering is over budget\n");
+        return 1;
+    }
+    if (!allocation_free)
+    {
+        printf("Frames allocated heap memory after the first\n");
+        return 1;
+    }
+    return 0;
+}
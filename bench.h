@@ -0,0 +1,125 @@
+// bench.h - Headless benchmark mode (--bench). Renders frames along a scripted
+//           camera path into an off-screen frame buffer, without needing a
+//           terminal, and reports how fast it went.
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "raycast.h" // Raycaster
+#include "subcell.h" // SubcellMode
+#include <string> // std::string
+#include <vector> // vector
+
+// How many times longer (median frame time) textured frames may take than
+// untextured ones in the --bench-textures benchmark. Drawing a wall row
+// untextured is a store of the column's one cell, textured it is working
+// out the texel (a shift and a clamp), a load of it and the store, with
+// the texels shaded once per column rather than once per row. Even if
+// drawing were all of a frame, that is at most three times the work, so
+// more means the textured path does per row work it shouldn't.
+#define TEXTURE_BUDGET 3.0
+// Times each size is run untextured and textured for TEXTURE_BUDGET, the
+// median ratio counts
+#define TEXTURE_BUDGET_RUNS 5
+
+// Most time encoding frames for a recording (--record-frames) may take, as a
+// share of the time rendering and printing them takes, in the --bench-replay
+// benchmark
+#define RECORD_BUDGET 0.05
+// Frames rendered turning in place at each spot in the --bench-turn benchmark
+#define BENCH_TURN_FRAMES 30
+// Farthest the camera is from the sprite it looks at in the --bench-sprites
+// benchmark, in tiles
+#define BENCH_SPRITE_DISTANCE 8.0f
+
+// Recordings with fewer frames drawn than this aren't held to RECORD_BUDGET,
+// there are too few frames to measure (each one starts out with cold caches)
+#define RECORD_BUDGET_MIN_FRAMES 60
+
+struct TextureAtlas;
+
+struct BenchSize
+{
+    int width;
+    int height;
+};
+
+struct BenchOptions
+{
+    std::vector<BenchSize> sizes; // Screen sizes to run the benchmark at
+    int frames = 600;             // Frames to render at each size
+    int threads = 1;              // Threads to raycast the columns on
+    bool colored_output = true;   // Colored or pure ascii rendering
+    float fov = 0.0f;             // Field of view angle, FOV if 0
+    Raycaster raycaster = RAYCASTER_AUTO; // How the screen columns are raycast
+    const TextureAtlas *textures = nullptr; // Textures to use when textured
+    bool textured = false;        // Draw walls with 'textures'
+    SubcellMode subcells = SUBCELL_NONE; // Draw sub-cells (colored output only). Checks
+                                         // the packing against 'pack_pixels_reference'.
+    int column_step = 1;          // Raycast every this many columns (see ADAPTIVE
+                                  // RESOLUTION in view.h), a replay goes by the recording
+
+    // Render every size both untextured and textured (--bench-textures), and
+    // fail if textured frames take more than TEXTURE_BUDGET times as long
+    bool texture_budget = false;
+
+    // Raycasting benchmark (--bench-raycast) instead of rendering frames.
+    // Casts fans of random rays on a big map with each raycaster.
+    bool raycast = false;
+    int rays = 1000000;           // Rays to cast with each raycaster
+    std::string map_path;         // Map to cast rays on (generated if empty), or to
+                                  // replay on (built in map if empty)
+    int map_size = 0;             // Width and height of generated map, 0 for the
+                                  // benchmark's own (2048 raycasting, 256 sprites,
+                                  // collision and turning)
+
+    // Sprite benchmark (--bench-sprites) instead of the camera path. Scatters
+    // this many sprites over a generated map (or the one at 'map_path') and
+    // renders frames from random spots, once finding the sprites in view
+    // through their grid and once checking every sprite. Fails if the two
+    // don't render exactly the same frames.
+    int sprites = 0;
+
+    // Collision benchmark (--bench-collision) instead of the camera path.
+    // Moves this many bodies of PLAYER_RADIUS around a generated map (or the
+    // one at 'map_path') for 'frames' ticks, colliding with the walls and each
+    // other, and times single moves from random spots. Fails if a body ends
+    // up in a wall, or the grid misses a pair of bodies that overlap.
+    int collision_bodies = 0;
+    int moves = 1000000;          // Single moves to time
+
+    // Turning benchmark (--bench-turn) instead of the camera path. Renders
+    // frames turning in place at random spots on a generated map (or the one
+    // at 'map_path'), once reusing the columns of the frame before (see
+    // REUSING COLUMNS in view.h) and once raycasting every column. Fails if
+    // the two don't render exactly the same frames.
+    bool turn = false;
+
+    // Lighting benchmark (--bench-lights) instead of the camera path. Scatters
+    // this many lights over a generated map (or the one at 'map_path'), times
+    // baking its light map on one thread and on the pool, then times moving,
+    // adding and removing lights and adding and taking away walls, re-baking
+    // only what changed (see light.h). Renders frames from random spots lit
+    // and unlit. Fails if a re-baked light map doesn't match baking it whole.
+    int lights = 0;
+    int light_changes = 200;      // Lights and walls to change
+
+    // Replay benchmark (--bench-replay) instead of the camera path. Renders
+    // the frames drawn in a recording (see recording.h) as fast as possible,
+    // at its screen size, and prints them to /dev/null. Checks them against
+    // the recorded frames if there are any, and fails if encoding them takes
+    // over RECORD_BUDGET of the time.
+    std::string replay_path;
+    int replay_sprites = 0;       // Sprites (see sprite.h) and lights (see light.h)
+    int replay_lights = 0;        // scattered over the map when it was recorded
+};
+
+// Parse a list of screen sizes like "80x40,200x60" into 'sizes'.
+// Returns false if 'text' isn't a valid list.
+bool parse_bench_sizes(const std::string &text, std::vector<BenchSize> &sizes);
+
+// Runs the benchmark and prints the results to stdout.
+// Returns exit code for the program.
+int run_bench(const BenchOptions &options);
+
+#endif
@@ -0,0 +1,45 @@
+#include "camera.h"
+#include <cmath> // sinf, cosf, tanf
+
+void camera_resize(Camera &camera, int width, float fov)
+{
+    if (width == camera.width && fov == camera.fov)
+    {
+        return;
+    }
+    camera.width = width;
+    camera.fov = fov;
+
+    camera.column_offset.resize(width);
+    camera.rayX.resize(width);
+    camera.rayY.resize(width);
+    for (int x = 0; x < width; ++x)
+    {
+        camera.column_offset[x] = 2.0f * x / width - 1.0f;
+    }
+
+    // Plane length depends on fov, rebuild it and the rays
+    camera_set_angle(camera, camera.angle);
+}
+
+void camera_set_angle(Camera &camera, float angle)
+{
+    camera.angle = angle;
+
+    // Angle is measured from the y-axis towards the x-axis (angle 0 looks down
+    // along +y), and the right side of the screen is at increasing angles.
+    camera.dirX = sinf(angle);
+    camera.dirY = cosf(angle);
+    float planeLength = tanf(camera.fov / 2.0f);
+    camera.planeX = camera.dirY * planeLength;
+    camera.planeY = -camera.dirX * planeLength;
+
+    const float *offset = camera.column_offset.data();
+    float *rayX = camera.rayX.data();
+    float *rayY = camera.rayY.data();
+    for (int x = 0; x < camera.width; ++x)
+    {
+        rayX[x] = camera.dirX + camera.planeX * offset[x];
+        rayY[x] = camera.dirY + camera.planeY * offset[x];
+    }
+}
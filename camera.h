@@ -0,0 +1,42 @@
+// camera.h - Where the player looks. Uses a direction vector plus a camera
+//            plane vector (perpendicular to it) instead of an angle per
+//            column, so the ray through each screen column is just the
+//            direction plus a fixed fraction of the plane. The fractions are
+//            looked up from a table, built once for the screen width.
+
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <vector> // vector
+
+struct Camera
+{
+    float angle = 0.0f; // Angle the camera looks in (same as the player angle)
+    float fov = 0.0f;   // Field of view angle, across the whole screen width
+    int width = 0;      // Number of screen columns the tables are built for
+
+    float dirX = 0.0f;   // Unit vector of the direction the camera looks in
+    float dirY = 0.0f;
+    float planeX = 0.0f; // Vector from the middle of the screen to its right
+    float planeY = 0.0f; // edge, length tan(fov / 2)
+
+    // Where on the camera plane each column is, -1.0f (left edge) to
+    // 1.0f (right edge). Only depends on 'width', not on 'angle'.
+    std::vector<float> column_offset;
+
+    // Direction of the ray through each column (dir + plane * column_offset).
+    // Not unit vectors: their length is such that the ray distances come out
+    // as distance to the camera plane, not to the camera (no fisheye).
+    std::vector<float> rayX;
+    std::vector<float> rayY;
+};
+
+// Set screen width and field of view, rebuilds the per-column tables.
+// Does nothing if neither has changed.
+void camera_resize(Camera &camera, int width, float fov);
+
+// Set angle camera looks in and update the ray directions to match.
+// (The only sin/cos done per frame)
+void camera_set_angle(Camera &camera, float angle);
+
+#endif
@@ -0,0 +1,68 @@
+#include "framebuffer.h"
+#include <algorithm> // fill_n, min
+
+void fb_reset(FrameBuffer &fb, int width, int height, Cell fill)
+{
+    fb.width = width;
+    fb.height = height;
+    fb.cells.assign((size_t)width * height, fill);
+}
+
+void fb_fill_row(FrameBuffer &fb, int x, int y, int length, Cell fill)
+{
+    if (y < 0 || y >= fb.height)
+    {
+        return;
+    }
+    if (x < 0)
+    {
+        length += x;
+        x = 0;
+    }
+    length = std::min(length, fb.width - x);
+    if (length > 0)
+    {
+        std::fill_n(&fb.at(x, y), length, fill);
+    }
+}
+
+void fb_print(FrameBuffer &fb, int x, int y, const char *text, short color_pair)
+{
+    if (y < 0 || y >= fb.height)
+    {
+        return;
+    }
+    for (; *text != '\0' && x < fb.width; ++text, ++x)
+    {
+        if (x >= 0)
+        {
+            fb.at(x, y) = Cell{*text, color_pair};
+        }
+    }
+}
+
+const char *quadrant_glyph_utf8(char glyph)
+{
+    // All of them are in the block elements range U+2580 to U+259F,
+    // encoded as E2 96 80 to E2 96 9F
+    static const char utf8[16][3] =
+    {
+        {'\xe2', '\x96', '\x91'}, // Nothing, never used (mask 0 is drawn as a space)
+        {'\xe2', '\x96', '\x98'}, // Top left
+        {'\xe2', '\x96', '\x9d'}, // Top right
+        {'\xe2', '\x96', '\x80'}, // Upper half
+        {'\xe2', '\x96', '\x96'}, // Bottom left
+        {'\xe2', '\x96', '\x8c'}, // Left half
+        {'\xe2', '\x96', '\x9e'}, // Top right and bottom left
+        {'\xe2', '\x96', '\x9b'}, // All but bottom right
+        {'\xe2', '\x96', '\x97'}, // Bottom right
+        {'\xe2', '\x96', '\x9a'}, // Top left and bottom right
+        {'\xe2', '\x96', '\x90'}, // Right half
+        {'\xe2', '\x96', '\x9c'}, // All but bottom left
+        {'\xe2', '\x96', '\x84'}, // Lower half
+        {'\xe2', '\x96', '\x99'}, // All but top right
+        {'\xe2', '\x96', '\x9f'}, // All but top left
+        {'\xe2', '\x96', '\x88'}, // Full block
+    };
+    return utf8[(unsigned char)glyph & 0x0f];
+}
@@ -0,0 +1,63 @@
+// framebuffer.h - Off-screen buffer holding what every character cell on the
+//                 terminal should show. Everything is drawn into one of these
+//                 first and then handed over to be printed to the terminal.
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <vector>
+
+// Glyphs GLYPH_QUADRANTS to GLYPH_QUADRANTS + 15 stand for the Unicode block
+// characters made out of quarters of a cell (like the half blocks), which
+// don't fit in a char. GLYPH_QUADRANTS + mask is the one that has the quarters
+// in 'mask' drawn in the foreground color and the rest in the background color.
+// Mask bits: 1 = top left, 2 = top right, 4 = bottom left, 8 = bottom right.
+#define GLYPH_QUADRANTS 0x80
+#define QUADRANT_TOP_LEFT 1
+#define QUADRANT_TOP_RIGHT 2
+#define QUADRANT_BOTTOM_LEFT 4
+#define QUADRANT_BOTTOM_RIGHT 8
+#define QUADRANT_TOP_HALF (QUADRANT_TOP_LEFT | QUADRANT_TOP_RIGHT)
+
+// One character cell on the terminal
+struct Cell
+{
+    char glyph;       // Character to print
+    short color_pair; // Color pair to print it with (0 = terminal default colors)
+
+    bool operator==(const Cell &other) const
+    {
+        return glyph == other.glyph && color_pair == other.color_pair;
+    }
+    bool operator!=(const Cell &other) const { return !(*this == other); }
+};
+
+struct FrameBuffer
+{
+    int width = 0;
+    int height = 0;
+    std::vector<Cell> cells; // Row by row, width * height cells
+
+    Cell &at(int x, int y) { return cells[y * width + x]; }
+    const Cell &at(int x, int y) const { return cells[y * width + x]; }
+};
+
+// True if 'glyph' is one of the quadrant block characters
+inline bool is_quadrant_glyph(char glyph)
+{
+    return ((unsigned char)glyph & 0xf0) == GLYPH_QUADRANTS;
+}
+
+// UTF-8 encoding of quadrant block character 'glyph' (3 bytes, no terminating zero)
+const char *quadrant_glyph_utf8(char glyph);
+
+// Resize (if needed) and fill every cell with 'fill'
+void fb_reset(FrameBuffer &fb, int width, int height, Cell fill);
+
+// Fill 'length' cells of row 'y' starting at column 'x' (clipped to the buffer)
+void fb_fill_row(FrameBuffer &fb, int x, int y, int length, Cell fill);
+
+// Write 'text' into row 'y' starting at column 'x' (clipped to the buffer)
+void fb_print(FrameBuffer &fb, int x, int y, const char *text, short color_pair);
+
+#endif
@@ -1,12 +1,26 @@
 // Taken from: https://stackoverflow.com/questions/4025891/create-a-function-to-check-for-key-press-in-unix-using-ncurses
 
 #include <cstdlib>
+#include <cerrno> // errno
+#include <clocale> // setlocale
+#include <cstring> // strlen
+#include <thread> // thread
+#include <vector> // vector
+#include <poll.h> // poll
+#include <sys/ioctl.h> // ioctl, TIOCGWINSZ
+#include <termios.h> // tcgetattr, tcsetattr
+#include <unistd.h> // read, write, pipe
 #include "input.h"
+#include "spsc_queue.h"
 
 static bool initInputHasBeenCalled = false;
+static bool rawInput = false; // True if 'init_raw_input' was called instead of 'init_input'
+static struct termios oldTermios; // Terminal settings from before 'init_raw_input'
 
 void init_input(void)
 {
+    // Lets ncursesw print the UTF-8 block characters of sub-cell drawing
+    setlocale(LC_CTYPE, "");
     initscr();
 
     cbreak();
@@ -14,10 +28,60 @@ void init_input(void)
     nodelay(stdscr, TRUE);
     scrollok(stdscr, FALSE); // scrollok(.., FALSE) means, Dont't scroll screen if cursor moves past the last line. (According to what I've read online, on man pages I think..)
     curs_set(0); // Make cursor invisible
+    typeahead(-1); // Keys are read by the input thread, ncurses shouldn't look at stdin
 
     initInputHasBeenCalled = true;
 }
 
+void init_raw_input(void)
+{
+    tcgetattr(STDIN_FILENO, &oldTermios); // grab old terminal i/o settings
+
+    struct termios current = oldTermios;
+    current.c_lflag &= ~(ICANON | ECHO); // disable buffered i/o and echo
+    current.c_cc[VMIN] = 0;  // read() returns right away,
+    current.c_cc[VTIME] = 0; // even if there is nothing to read
+    tcsetattr(STDIN_FILENO, TCSANOW, &current);
+
+    rawInput = true;
+    initInputHasBeenCalled = true;
+}
+
+void restore_input(void)
+{
+    if (rawInput)
+    {
+        tcsetattr(STDIN_FILENO, TCSANOW, &oldTermios);
+    }
+}
+
+bool terminal_size(int &rows, int &columns)
+{
+    struct winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) != 0 || size.ws_row == 0 || size.ws_col == 0)
+    {
+        return false;
+    }
+    rows = size.ws_row;
+    columns = size.ws_col;
+    return true;
+}
+
+int read_key(void)
+{
+    if (!rawInput)
+    {
+        return getch();
+    }
+
+    unsigned char ch;
+    if (read(STDIN_FILENO, &ch, 1) == 1)
+    {
+        return ch;
+    }
+    return ERR;
+}
+
 int kbhit(void)
 {
     if (!initInputHasBeenCalled)
@@ -36,6 +100,223 @@ int kbhit(void)
     }
 }
 
+// Most key events waiting for the game loop, more than that are dropped
+#define KEY_EVENT_QUEUE_SIZE 256
+
+static std::thread inputThread;
+static int wakePipe[2] = {-1, -1}; // Written to to make the input thread stop
+static SpscQueue<KeyEvent, KEY_EVENT_QUEUE_SIZE> keyEvents;
+
+// Writes 'text' to the terminal. Only used for requests the terminal
+// is free to ignore, so if it fails there is nothing to be done.
+static void write_terminal(const char *text)
+{
+    ssize_t written = write(STDOUT_FILENO, text, strlen(text));
+    (void)written;
+}
+
+// Handles a finished "ESC [ ... u" sequence: "ESC [ key[:alternates] ; modifiers[:event] ... u"
+// Modifiers are 1 + bits (shift 1, alt 2, ctrl 4), event is 1 press, 2 repeat, 3 release.
+static void parse_kitty_key(const char *params, std::chrono::steady_clock::time_point time,
+                            std::vector<KeyEvent> &events)
+{
+    if (*params < '0' || *params > '9')
+    {
+        return; // Like the "ESC [ ? flags u" answer to a query
+    }
+    int key = strtol(params, (char **)&params, 10);
+    while (*params == ':' || (*params >= '0' && *params <= '9'))
+    {
+        ++params; // Skip alternate keys
+    }
+
+    int modifiers = 1;
+    int event = 1;
+    if (*params == ';')
+    {
+        modifiers = strtol(params + 1, (char **)&params, 10);
+        if (*params == ':')
+        {
+            event = strtol(params + 1, (char **)&params, 10);
+        }
+    }
+    if (key == 'c' && ((modifiers - 1) & 4))
+    {
+        key = KEY_CTRL_C;
+    }
+    KeyEventType type = (event == 3) ? KEY_EVENT_RELEASE : (event == 2) ? KEY_EVENT_REPEAT : KEY_EVENT_PRESS;
+    events.push_back(KeyEvent{key, type, time});
+}
+
+static void parse_byte(KeyParser &parser, unsigned char byte, std::chrono::steady_clock::time_point time,
+                       std::vector<KeyEvent> &events)
+{
+    if (parser.length == 0)
+    {
+        if (byte == 27)
+        {
+            parser.sequence[parser.length++] = byte;
+        }
+        else
+        {
+            events.push_back(KeyEvent{byte, KEY_EVENT_TEXT, time});
+        }
+        return;
+    }
+
+    if (parser.length == 1 && byte != '[')
+    {
+        // Not an escape sequence, just the escape key
+        parser.length = 0;
+        events.push_back(KeyEvent{27, KEY_EVENT_TEXT, time});
+        parse_byte(parser, byte, time, events);
+        return;
+    }
+
+    parser.sequence[parser.length++] = byte;
+    if (parser.length > 2 && byte >= 0x40 && byte <= 0x7e)
+    {
+        // Final byte. Only key events are of interest (arrow keys and such are ignored)
+        if (byte == 'u')
+        {
+            parser.sequence[parser.length - 1] = '\0';
+            parse_kitty_key(parser.sequence + 2, time, events);
+        }
+        parser.length = 0;
+    }
+    else if (parser.length == (int)sizeof(parser.sequence) - 1)
+    {
+        parser.length = 0; // Longer than anything we know, drop it
+    }
+}
+
+void parse_key_bytes(KeyParser &parser, const unsigned char *bytes, int count,
+                     std::chrono::steady_clock::time_point time, std::vector<KeyEvent> &events)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        parse_byte(parser, bytes[i], time, events);
+    }
+}
+
+static void input_thread_loop()
+{
+    KeyParser parser;
+    std::vector<KeyEvent> events;
+    struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {wakePipe[0], POLLIN, 0}};
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        if (fds[1].revents != 0)
+        {
+            return; // Asked to stop
+        }
+        if (fds[0].revents != 0)
+        {
+            unsigned char bytes[256];
+            ssize_t count = read(STDIN_FILENO, bytes, sizeof(bytes));
+            if (count < 0 && (errno == EINTR || errno == EAGAIN))
+            {
+                continue;
+            }
+            if (count <= 0)
+            {
+                return; // stdin closed
+            }
+            events.clear();
+            parse_key_bytes(parser, bytes, (int)count, std::chrono::steady_clock::now(), events);
+            for (const KeyEvent &event : events)
+            {
+                keyEvents.push(event);
+            }
+        }
+    }
+}
+
+bool start_input_thread(void)
+{
+    if (pipe(wakePipe) != 0)
+    {
+        return false;
+    }
+    write_terminal(KITTY_KEYBOARD_ON);
+    inputThread = std::thread(input_thread_loop);
+    return true;
+}
+
+void stop_input_thread(void)
+{
+    if (!inputThread.joinable())
+    {
+        return;
+    }
+    char stop = 1;
+    ssize_t written = write(wakePipe[1], &stop, 1);
+    (void)written;
+    inputThread.join();
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+    write_terminal(KITTY_KEYBOARD_OFF);
+}
+
+bool pop_key_event(KeyEvent &event)
+{
+    return keyEvents.pop(event);
+}
+
+void key_states_update(KeyStates &states, const KeyEvent &event)
+{
+    if (event.key < 0 || event.key >= 256)
+    {
+        return;
+    }
+    KeyState &state = states.keys[event.key];
+    switch (event.type)
+    {
+    case KEY_EVENT_PRESS:
+        state.pressed = true;
+        // fall through
+    case KEY_EVENT_REPEAT:
+        state.down = true;
+        state.timed = false;
+        break;
+    case KEY_EVENT_RELEASE:
+        state.down = false;
+        break;
+    case KEY_EVENT_TEXT:
+    {
+        bool repeating = event.time - state.last_press < std::chrono::duration<double>(KEY_REPEAT_DELAY);
+        double hold = repeating ? KEY_REPEAT_TIMEOUT : KEY_TAP_TIME;
+        state.down = true;
+        state.timed = true;
+        state.pressed = true;
+        state.until = event.time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                       std::chrono::duration<double>(hold));
+        state.last_press = event.time;
+        break;
+    }
+    }
+}
+
+bool key_held(KeyStates &states, int key, std::chrono::steady_clock::time_point now)
+{
+    KeyState &state = states.keys[key];
+    if (state.timed && now >= state.until)
+    {
+        state.down = false;
+    }
+    bool held = state.down || state.pressed;
+    state.pressed = false;
+    return held;
+}
+
 #ifdef false
 // -------------------------------------------------
 // ----------------- Example Code  -----------------
@@ -5,12 +5,127 @@
 //             for input before proceeding
 //           - Not Buffered meaning we don't have
 //             to hit enter for it to proceed.
+//
+// ---- INPUT THREAD: ----
+// Keys are read from stdin on a thread of its own, which waits in poll() and
+// turns the bytes into key events as soon as they arrive. The game loop
+// takes all events that came in since the last frame from a lock-free queue
+// ('pop_key_event') and keeps track of which keys are held down ('KeyStates').
+//
+// ---- HELD KEYS: ----
+// Terminals that speak the kitty keyboard protocol are asked to report key
+// presses, repeats and releases, so we know exactly when a key is held down
+// (and several keys can be held at once, like W and D to move diagonally).
+// Other terminals only send the character of the key, repeated while it is
+// held after the key repeat delay, and only for the last key pressed. There a
+// key counts as held for a short while after each character: KEY_TAP_TIME
+// after a single press, and KEY_REPEAT_TIMEOUT once it repeats.
+
+#ifndef INPUT_H
+#define INPUT_H
 
 #include <ncurses.h>
+#include <chrono> // steady_clock
+#include <vector> // vector
+
+// Seconds a key counts as held after a single press (terminals without release events)
+#define KEY_TAP_TIME 0.05
+// A press within this many seconds of the last press of the same key is the
+// key repeating (longer than the usual key repeat delay)
+#define KEY_REPEAT_DELAY 0.7
+// Seconds a repeating key counts as held after its last repeat, bridges the
+// gaps between repeats (key repeat is 20+ per second)
+#define KEY_REPEAT_TIMEOUT 0.1
+
+// Asks the terminal to report every key as an escape sequence with
+// press/repeat/release (kitty keyboard protocol, flags 2 and 8 pushed on its
+// stack of flags), and to pop them again. Terminals that don't know it ignore it.
+#define KITTY_KEYBOARD_ON "\033[>10u"
+#define KITTY_KEYBOARD_OFF "\033[<u"
 
+// Key code for Ctrl-C. Terminals reporting every key with the kitty keyboard
+// protocol send it as a key instead of interrupting the program.
+#define KEY_CTRL_C 3
+
+// Sets up ncurses to read input (use together with NcursesBackend)
 void init_input(void);
+// Sets up the terminal to read input straight from stdin, without
+// ncurses (use together with AnsiBackend)
+void init_raw_input(void);
+// Puts the terminal back the way it was before 'init_raw_input'
+void restore_input(void);
+
+// Size of the terminal on stdout, in rows and columns (asked with the
+// TIOCGWINSZ ioctl). Returns false if stdout isn't a terminal.
+bool terminal_size(int &rows, int &columns);
+
 int kbhit(void);
 
+// Get next pressed key, or ERR if no key has been pressed.
+// Works with both 'init_input' and 'init_raw_input'.
+// (Don't use together with the input thread)
+int read_key(void);
+
+enum KeyEventType
+{
+    KEY_EVENT_PRESS,   // Key went down
+    KEY_EVENT_REPEAT,  // Key is still down, repeating
+    KEY_EVENT_RELEASE, // Key went up
+    KEY_EVENT_TEXT     // Character from a terminal that doesn't tell presses from repeats, or report releases
+};
+
+struct KeyEvent
+{
+    int key;           // Character of the key (lower case letters for letter keys)
+    KeyEventType type;
+    std::chrono::steady_clock::time_point time; // When it was read
+};
+
+// Starts the input thread, reading stdin (call after 'init_input' or 'init_raw_input').
+// Returns false if it couldn't be started.
+bool start_input_thread(void);
+// Stops the input thread and switches off the kitty keyboard protocol again
+void stop_input_thread(void);
+
+// Takes the oldest key event read by the input thread.
+// Returns false if there are none. Only to be called from one thread.
+bool pop_key_event(KeyEvent &event);
+
+// Turns the bytes read from a terminal into key events. Escape sequences can be
+// split over several reads, so a sequence being read is kept here until it ends.
+struct KeyParser
+{
+    char sequence[32];
+    int length = 0; // Bytes in 'sequence', 0 if not in one
+};
+
+// Appends the key events in 'bytes' (read at 'time') to 'events'. Used by the
+// input thread for stdin, and by the server for the bytes its clients send.
+void parse_key_bytes(KeyParser &parser, const unsigned char *bytes, int count,
+                     std::chrono::steady_clock::time_point time, std::vector<KeyEvent> &events);
+
+// Which keys are held down, see HELD KEYS above
+struct KeyState
+{
+    bool down = false;    // Pressed and not released (or timed out) since
+    bool timed = false;   // Release isn't reported, 'down' ends at 'until'
+    bool pressed = false; // Pressed since last 'key_held' call
+    std::chrono::steady_clock::time_point until;      // When 'timed' key counts as released
+    std::chrono::steady_clock::time_point last_press; // Last KEY_EVENT_TEXT for the key
+};
+
+struct KeyStates
+{
+    KeyState keys[256];
+};
+
+// Updates 'states' with 'event'
+void key_states_update(KeyStates &states, const KeyEvent &event);
+
+// True if 'key' is held down at 'now', or was pressed since the last call
+// (so a press and release in between two calls isn't lost).
+bool key_held(KeyStates &states, int key, std::chrono::steady_clock::time_point now);
+
 // Functions to call, but that exist directly in 'ncurses.h'
 
 // Get last pressed character/key
@@ -18,3 +133,5 @@ int kbhit(void);
 
 // Print (To be used instead of printf, because output looks messed up with printf)
 // printw()
+
+#endif
@@ -0,0 +1,313 @@
+#include "light.h"
+#include "thread_pool.h"
+#include <algorithm> // min, max
+#include <cmath> // sqrtf, floorf
+
+// Light is added up in fixed point, LIGHT_FIXED_ONE for a point lit all the
+// way. Sums of integers come out the same whatever order the lights are
+// added up in, so re-baking a tile always gives what baking it the first time did.
+#define LIGHT_FIXED_ONE 65536
+
+static_assert(LIGHT_SAMPLES == 4, "Floors are sampled in a 2x2 grid");
+
+// Outward direction of each face, FACE_NORTH to FACE_WEST
+static const int face_dx[4] = {0, 0, 1, -1};
+static const int face_dy[4] = {-1, 1, 0, 0};
+
+void scatter_lights(std::vector<Light> &lights, const Map &map, int count, unsigned seed)
+{
+    // Same small random number generator as 'scatter_sprites'
+    uint32_t state = seed * 2654435761u + 7;
+    auto next_random = [&state]() -> float
+    {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    };
+
+    int placed = 0;
+    // (Gives up on a map with next to no empty tiles rather than searching forever)
+    for (long tries = 0; placed < count && tries < 100L * count + 1000; ++tries)
+    {
+        int x = (int)(next_random() * map.width);
+        int y = (int)(next_random() * map.height);
+        if (map.is_wall(x, y))
+        {
+            continue;
+        }
+        Light light;
+        light.x = x + 0.5f;
+        light.y = y + 0.5f;
+        lights.push_back(light);
+        ++placed;
+    }
+}
+
+void map_lights(const Map &map, std::vector<Light> &lights)
+{
+    for (const MapLight &map_light : map.lights)
+    {
+        Light light;
+        light.x = map_light.x;
+        light.y = map_light.y;
+        lights.push_back(light);
+    }
+}
+
+static float light_radius(const Light &light)
+{
+    return std::min(std::max(light.radius, 0.0f), LIGHT_MAX_RADIUS);
+}
+
+TileRect light_reach(const LightMap &light_map, const Light &light)
+{
+    float radius = light_radius(light);
+    return TileRect{std::max((int)floorf(light.x - radius) - 1, 0),
+                    std::max((int)floorf(light.y - radius) - 1, 0),
+                    std::min((int)floorf(light.x + radius) + 1, light_map.width - 1),
+                    std::min((int)floorf(light.y + radius) + 1, light_map.height - 1)};
+}
+
+// Grid cell (one coordinate) of tile 'tile', clamped to the grid
+static int grid_cell(int tile, int cells)
+{
+    return std::min(std::max(tile >> LIGHT_GRID_SHIFT, 0), cells - 1);
+}
+
+// Sorts the lights into the grid cells by where they are (counting sort,
+// like 'sprites_build_grid'). Lights outside the map go in the closest cell.
+static void build_light_grid(LightMap &light_map)
+{
+    light_map.grid_width = std::max(1, (light_map.width + LIGHT_GRID_SIZE - 1) >> LIGHT_GRID_SHIFT);
+    light_map.grid_height = std::max(1, (light_map.height + LIGHT_GRID_SIZE - 1) >> LIGHT_GRID_SHIFT);
+    int num_cells = light_map.grid_width * light_map.grid_height;
+    int count = (int)light_map.lights.size();
+    auto cell_of = [&](int i)
+    {
+        const Light &light = light_map.lights[i];
+        return grid_cell((int)floorf(light.y), light_map.grid_height) * light_map.grid_width +
+               grid_cell((int)floorf(light.x), light_map.grid_width);
+    };
+
+    light_map.cell_start.assign(num_cells + 1, 0);
+    for (int i = 0; i < count; ++i)
+    {
+        ++light_map.cell_start[cell_of(i) + 1];
+    }
+    for (int cell = 0; cell < num_cells; ++cell)
+    {
+        light_map.cell_start[cell + 1] += light_map.cell_start[cell];
+    }
+    light_map.grid_lights.resize(count);
+    std::vector<int> next(light_map.cell_start.begin(), light_map.cell_start.end() - 1);
+    for (int i = 0; i < count; ++i)
+    {
+        light_map.grid_lights[next[cell_of(i)]++] = i;
+    }
+}
+
+// Calls 'visit(light)' for every light in the grid cells that a light
+// reaching any tile in 'rect' can be in
+template<typename Visit>
+static void lights_near(const LightMap &light_map, const TileRect &rect, Visit visit)
+{
+    int margin = (int)LIGHT_MAX_RADIUS + 2;
+    int cx0 = grid_cell(rect.x0 - margin, light_map.grid_width);
+    int cy0 = grid_cell(rect.y0 - margin, light_map.grid_height);
+    int cx1 = grid_cell(rect.x1 + margin, light_map.grid_width);
+    int cy1 = grid_cell(rect.y1 + margin, light_map.grid_height);
+    for (int cy = cy0; cy <= cy1; ++cy)
+    {
+        for (int cx = cx0; cx <= cx1; ++cx)
+        {
+            int cell = cy * light_map.grid_width + cx;
+            for (int i = light_map.cell_start[cell]; i < light_map.cell_start[cell + 1]; ++i)
+            {
+                visit(light_map.lights[light_map.grid_lights[i]]);
+            }
+        }
+    }
+}
+
+// Light (in LIGHT_FIXED_ONE units) that 'light' gives point 'pointX', 'pointY'.
+// On a wall face facing 'normalX', 'normalY' if 'facing', on the floor otherwise.
+static int64_t light_at(const Map &map, const Light &light, float pointX, float pointY,
+                        bool facing, float normalX, float normalY)
+{
+    float dx = pointX - light.x;
+    float dy = pointY - light.y;
+    float distance = sqrtf(dx * dx + dy * dy);
+    float radius = light_radius(light);
+    if (distance >= radius)
+    {
+        return 0;
+    }
+    float amount = light.intensity * (1.0f - distance / radius);
+    if (facing)
+    {
+        // Weaker the more sideways it comes in, nothing from behind
+        float cosine = -(dx * normalX + dy * normalY) / std::max(distance, 1e-6f);
+        if (cosine <= 0.0f)
+        {
+            return 0;
+        }
+        amount *= cosine;
+    }
+    if (distance > 1e-4f)
+    {
+        // The point is at 1.0f along the ray, a wall hit before it is in between
+        RayHit hit = cast_ray(map, light.x, light.y, dx, dy);
+        if (hit.hit && hit.distance < 1.0f)
+        {
+            return 0;
+        }
+    }
+    return (int64_t)(amount * LIGHT_FIXED_ONE);
+}
+
+// Level of the light adding up to 'sum' over LIGHT_SAMPLES points
+static uint8_t light_level(int64_t sum)
+{
+    int64_t level = (sum * LIGHT_MAX_LEVEL / LIGHT_SAMPLES + LIGHT_FIXED_ONE / 2) / LIGHT_FIXED_ONE;
+    return (uint8_t)std::min<int64_t>(std::max<int64_t>(level, 0), LIGHT_MAX_LEVEL);
+}
+
+// Works out the light levels of tile 'x', 'y', see BAKING in light.h
+static void bake_tile(LightMap &light_map, const Map &map, int x, int y)
+{
+    uint8_t *levels = &light_map.levels[((size_t)y * light_map.width + x) * 4];
+    bool wall = map.at(x, y) != CELL_EMPTY;
+    bool open[4];
+    for (int face = 0; face < 4; ++face)
+    {
+        open[face] = wall && !map.is_wall(x + face_dx[face], y + face_dy[face]);
+    }
+    int64_t sums[4] = {0, 0, 0, 0};
+
+    lights_near(light_map, TileRect{x, y, x, y}, [&](const Light &light)
+    {
+        float radius = light_radius(light);
+        if (light.x < x - radius - 1.0f || light.x > x + radius + 2.0f ||
+            light.y < y - radius - 1.0f || light.y > y + radius + 2.0f ||
+            map.is_wall((int)floorf(light.x), (int)floorf(light.y)))
+        {
+            return; // Out of reach, or shut in a wall
+        }
+        for (int sample = 0; sample < LIGHT_SAMPLES; ++sample)
+        {
+            float along = (sample + 0.5f) / LIGHT_SAMPLES;
+            if (!wall)
+            {
+                float pointX = x + 0.25f + 0.5f * (sample & 1);
+                float pointY = y + 0.25f + 0.5f * (sample >> 1);
+                sums[0] += light_at(map, light, pointX, pointY, false, 0.0f, 0.0f);
+                continue;
+            }
+            for (int face = 0; face < 4; ++face)
+            {
+                if (!open[face])
+                {
+                    continue;
+                }
+                // Middle of the face, moved along it and out in front of it
+                float pointX = x + 0.5f + face_dx[face] * (0.5f + LIGHT_SURFACE_GAP) + (face_dx[face] == 0 ? along - 0.5f : 0.0f);
+                float pointY = y + 0.5f + face_dy[face] * (0.5f + LIGHT_SURFACE_GAP) + (face_dy[face] == 0 ? along - 0.5f : 0.0f);
+                sums[face] += light_at(map, light, pointX, pointY, true, (float)face_dx[face], (float)face_dy[face]);
+            }
+        }
+    });
+
+    for (int i = 0; i < 4; ++i)
+    {
+        levels[i] = light_level(sums[i]);
+    }
+}
+
+// Bakes the tiles in 'rect' again, rows of them in parallel
+static void bake_rect(LightMap &light_map, const Map &map, const TileRect &rect, ThreadPool &pool)
+{
+    if (rect.x0 > rect.x1 || rect.y0 > rect.y1)
+    {
+        return;
+    }
+    pool.parallel_for(rect.y1 - rect.y0 + 1, LIGHT_BAKE_ROWS, [&](int begin, int end)
+    {
+        for (int y = rect.y0 + begin; y < rect.y0 + end; ++y)
+        {
+            for (int x = rect.x0; x <= rect.x1; ++x)
+            {
+                bake_tile(light_map, map, x, y);
+            }
+        }
+    });
+    light_map.tiles_baked += (rect.x1 - rect.x0 + 1) * (rect.y1 - rect.y0 + 1);
+}
+
+void light_map_bake(LightMap &light_map, const Map &map, const std::vector<Light> &lights, ThreadPool &pool)
+{
+    light_map.width = map.width;
+    light_map.height = map.height;
+    light_map.lights = lights;
+    light_map.levels.assign((size_t)map.width * map.height * 4, 0);
+    light_map.tiles_baked = 0;
+    build_light_grid(light_map);
+    bake_rect(light_map, map, TileRect{0, 0, map.width - 1, map.height - 1}, pool);
+}
+
+void light_map_add(LightMap &light_map, const Map &map, const Light &light, ThreadPool &pool)
+{
+    light_map.lights.push_back(light);
+    build_light_grid(light_map);
+    light_map.tiles_baked = 0;
+    bake_rect(light_map, map, light_reach(light_map, light), pool);
+}
+
+void light_map_move(LightMap &light_map, const Map &map, int index, float x, float y, ThreadPool &pool)
+{
+    Light &light = light_map.lights[index];
+    TileRect was = light_reach(light_map, light);
+    light.x = x;
+    light.y = y;
+    TileRect now = light_reach(light_map, light);
+    build_light_grid(light_map);
+    light_map.tiles_baked = 0;
+    if (was.x1 + 1 < now.x0 || now.x1 + 1 < was.x0 || was.y1 + 1 < now.y0 || now.y1 + 1 < was.y0)
+    {
+        // Moved out of its own reach, the two are baked on their own
+        bake_rect(light_map, map, was, pool);
+        bake_rect(light_map, map, now, pool);
+    }
+    else
+    {
+        bake_rect(light_map, map, TileRect{std::min(was.x0, now.x0), std::min(was.y0, now.y0),
+                                           std::max(was.x1, now.x1), std::max(was.y1, now.y1)}, pool);
+    }
+}
+
+void light_map_remove(LightMap &light_map, const Map &map, int index, ThreadPool &pool)
+{
+    TileRect was = light_reach(light_map, light_map.lights[index]);
+    light_map.lights[index] = light_map.lights.back();
+    light_map.lights.pop_back();
+    build_light_grid(light_map);
+    light_map.tiles_baked = 0;
+    bake_rect(light_map, map, was, pool);
+}
+
+void light_map_wall_changed(LightMap &light_map, const Map &map, int x, int y, ThreadPool &pool)
+{
+    // The tile and the faces of the ones next to it, and everything the
+    // lights reaching it shine on (their rays may go through it)
+    TileRect rect{std::max(x - 1, 0), std::max(y - 1, 0),
+                  std::min(x + 1, light_map.width - 1), std::min(y + 1, light_map.height - 1)};
+    lights_near(light_map, TileRect{x, y, x, y}, [&](const Light &light)
+    {
+        TileRect reach = light_reach(light_map, light);
+        if (x >= reach.x0 && x <= reach.x1 && y >= reach.y0 && y <= reach.y1)
+        {
+            rect = TileRect{std::min(rect.x0, reach.x0), std::min(rect.y0, reach.y0),
+                            std::max(rect.x1, reach.x1), std::max(rect.y1, reach.y1)};
+        }
+    });
+    light_map.tiles_baked = 0;
+    bake_rect(light_map, map, rect, pool);
+}
@@ -0,0 +1,157 @@
+// light.h - Point lights placed on the map, and the light maps baked from
+//           them. Walls are shaded by how far away they are (see shading.h),
+//           light falling on a wall moves it along the wall gradient towards
+//           the near (bright) end, the opposite way a texel's shade does.
+//
+// ---- LIGHT MAPS: ----
+// How much light falls on each face of every wall tile, and on the floor of
+// every empty tile, is worked out once when the map and its lights are loaded
+// (baked) and kept in a LightMap. Drawing a wall column then costs a single
+// lookup of the face its ray hit, and drawing a sprite a single lookup of
+// the floor it stands on. (The floor and ceiling themselves are drawn a row
+// at a time from 'ShadeTables::background', not a tile at a time, so they
+// aren't lit.)
+//
+// ---- BAKING: ----
+// Light from a point light fades out evenly to nothing at its radius, and
+// falls on a wall face weaker the more sideways it comes in. A point is only
+// lit by a light if a ray cast from the light (see raycast.h) gets there
+// without hitting a wall first. Each face and floor is lit at LIGHT_SAMPLES
+// points and the light averaged, so shadow edges across one are part lit.
+// Rows of tiles are baked in parallel on a ThreadPool. Every tile adds up
+// the light of the lights near it, found through a grid of the lights
+// (LIGHT_GRID_SIZE x LIGHT_GRID_SIZE tiles per cell).
+//
+// ---- RE-BAKING: ----
+// A light only reaches the tiles within its radius (its reach, see
+// 'light_reach'), and the rays cast from it only go through those. So when a
+// light is added, moved or removed only the tiles in its reach (where it was
+// and where it is now) are baked again, and when a wall is added or taken
+// away only the reach of the lights that reach it, and the tiles next to it.
+// Each tile is always baked the same way, so this gives exactly the light
+// map baking the whole map would.
+
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include "map.h" // MAP_BLOCK_SHIFT
+#include "raycast.h" // RayHit, FACE_NORTH
+#include "shading.h" // SHADE_TABLE_SIZE
+#include <cstdint> // uint8_t
+#include <vector> // vector
+
+class ThreadPool;
+
+// Light levels go from 0 (dark) to LIGHT_MAX_LEVEL (lit all the way)
+#define LIGHT_MAX_LEVEL 255
+
+// Number of distance table entries a wall or sprite at LIGHT_MAX_LEVEL is
+// moved towards the near end of its gradient (3/5 of MAX_DEPTH)
+#define LIGHT_SHADE_RANGE (SHADE_TABLE_SIZE * 3 / 5)
+
+// Radius of lights placed on the map, in tiles, and how bright they are
+// (1.0f lights a wall right next to them all the way)
+#define LIGHT_DEFAULT_RADIUS 6.0f
+#define LIGHT_DEFAULT_INTENSITY 1.0f
+// Lights don't reach further than this, in tiles
+#define LIGHT_MAX_RADIUS 16.0f
+
+// Points on each wall face and floor the light is worked out at
+#define LIGHT_SAMPLES 4
+
+// How far in front of a wall face its points are, so a ray cast to one
+// doesn't stop at the wall itself
+#define LIGHT_SURFACE_GAP 0.01f
+
+// Width and height of a cell of the grid the lights are sorted into, in tiles
+#define LIGHT_GRID_SHIFT MAP_BLOCK_SHIFT
+#define LIGHT_GRID_SIZE (1 << LIGHT_GRID_SHIFT)
+
+// Tiles of rows baked together, on one thread
+#define LIGHT_BAKE_ROWS 4
+
+// A point light
+struct Light
+{
+    float x; // Position on the map
+    float y;
+    float radius = LIGHT_DEFAULT_RADIUS;       // In tiles, at most LIGHT_MAX_RADIUS
+    float intensity = LIGHT_DEFAULT_INTENSITY; // Light right next to it
+};
+
+// Rectangle of tiles from 'x0', 'y0' to 'x1', 'y1' (inclusive)
+struct TileRect
+{
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+// Lights and the light maps baked from them, see LIGHT MAPS above
+struct LightMap
+{
+    int width = 0;  // Of the map, in tiles
+    int height = 0;
+    std::vector<Light> lights;
+
+    // LIGHT_MAX_LEVEL based light levels, 4 per tile. A wall tile has the
+    // light on its faces (FACE_NORTH to FACE_WEST), an empty tile the light
+    // on its floor in the first one. Faces that another wall covers are 0.
+    std::vector<uint8_t> levels;
+
+    // Lights sorted into grid cells, see BAKING above. Lights in cell 'cx',
+    // 'cy' are 'grid_lights[cell_start[i]]' to 'grid_lights[cell_start[i + 1] - 1]',
+    // with i = cy * grid_width + cx.
+    int grid_width = 0;
+    int grid_height = 0;
+    std::vector<int> cell_start;
+    std::vector<int> grid_lights;
+
+    int tiles_baked = 0; // Tiles baked by the last bake or re-bake
+};
+
+// Places 'count' lights at random spots in empty tiles of 'map' (in the
+// middle of the tile). Same seed gives the same lights.
+void scatter_lights(std::vector<Light> &lights, const Map &map, int count, unsigned seed);
+
+// The lights placed on 'map' (see 'Map::lights'), with the default radius and intensity
+void map_lights(const Map &map, std::vector<Light> &lights);
+
+// Tiles that 'light' can reach (widened by a tile, for the faces on their
+// borders), clipped to the map
+TileRect light_reach(const LightMap &light_map, const Light &light);
+
+// Bakes the light map of 'map' lit by 'lights', see BAKING above
+void light_map_bake(LightMap &light_map, const Map &map, const std::vector<Light> &lights, ThreadPool &pool);
+
+// Adds 'light', moves light 'index' to 'x', 'y', or removes light 'index'
+// (the last light takes its index), and re-bakes the tiles it reaches.
+void light_map_add(LightMap &light_map, const Map &map, const Light &light, ThreadPool &pool);
+void light_map_move(LightMap &light_map, const Map &map, int index, float x, float y, ThreadPool &pool);
+void light_map_remove(LightMap &light_map, const Map &map, int index, ThreadPool &pool);
+
+// Re-bakes what changes when tile 'x', 'y' of 'map' was made a wall or
+// emptied (call after changing it, see 'Map::set')
+void light_map_wall_changed(LightMap &light_map, const Map &map, int x, int y, ThreadPool &pool);
+
+// Number of distance table entries light level 'level' moves a wall or sprite
+// towards the near end of its gradient
+inline int light_shade_offset(uint8_t level)
+{
+    return level * LIGHT_SHADE_RANGE / LIGHT_MAX_LEVEL;
+}
+
+// Light level on the wall face 'hit' hit (a hit wall inside the map)
+inline uint8_t light_face_level(const LightMap &light_map, const RayHit &hit)
+{
+    return light_map.levels[((size_t)hit.mapY * light_map.width + hit.mapX) * 4 + (hit.face - FACE_NORTH)];
+}
+
+// Light level on the floor at 'x', 'y' (inside the map)
+inline uint8_t light_floor_level(const LightMap &light_map, float x, float y)
+{
+    return light_map.levels[((size_t)(int)y * light_map.width + (int)x) * 4];
+}
+
+#endif
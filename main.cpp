@@ -1,39 +1,479 @@
 #include <string> // stoi, string
 #include <cmath>
-#include <ctime>
 
 #include <chrono>
 #include <thread>
 
+#include "bench.h"
+#include "camera.h"
 #include "globals.h"
 #include "input.h"
+#include "light.h"
+#include "map.h"
+#include "presenter.h"
+#include "profiler.h"
+#include "raycast.h"
+#include "recording.h"
 #include "rendering.h"
+#include "server.h"
+#include "session.h"
+#include "shading.h"
+#include "simulation.h"
+#include "sprite.h"
+#include "subcell.h"
+#include "texture.h"
+#include "thread_pool.h"
+#include "view.h"
 
 #include <cassert>
 #include <algorithm> // max
 #include <iostream> // cin
 #include <vector>
+#include <memory> // unique_ptr
+#include <csignal> // signal
 #include <unistd.h> // isatty
 
-float playerX = 1.5f; // Player x position/coordinate
-float playerY = 1.5f; // Player y position/coordinate
-float playerA = 1.5f; // Player angle of direction its looking at
-
 // Definition of extern variables from "globals.h"
 int screen_width;
 int screen_height;
 
+// Set when program has been asked to exit (Ctrl-C)
+static volatile sig_atomic_t quit_requested = 0;
+
+static void handle_quit_signal(int)
+{
+    quit_requested = 1;
+}
+
+// Set when the terminal has been resized (SIGWINCH)
+static volatile sig_atomic_t resize_requested = 0;
+
+static void handle_resize_signal(int)
+{
+    resize_requested = 1;
+}
+
+// Size of the view for a terminal 'rows' x 'columns' big, at least one cell
+static void view_size_for_terminal(int rows, int columns, int &width, int &height)
+{
+    width = std::max(columns, 1);
+    height = std::max(rows - STATUS_ROWS, 1); // Minus STATUS_ROWS to make space for the prinout of fps, player position etc.
+}
+
 int main(int argc,char* argv[])
 {
-    printf("\033c"); // Clear screen
+    // Number of threads to split the raycasting of the screen columns on.
+    // Defaults to one thread per core.
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // How frames are printed to the terminal, "ncurses" or "ansi"
+    // (ansi = escape sequences with 24-bit colors written straight to the terminal)
+    std::string backend_name = "ncurses";
+
+    // Palette file to load instead of the built in palette, none if empty
+    std::string palette_path;
+
+    // Texture file to load on top of the built in textures, none if empty.
+    // Walls start out textured if one is given.
+    std::string textures_path;
+
+    // Map file to load instead of the built in map, none if empty
+    std::string map_path;
+    // Generate a map of this size instead of using the built in map, unless 0
+    int generate_width = 0;
+    int generate_height = 0;
+    // Save map in binary format to this file and exit, unless empty
+    std::string save_map_path;
+
+    // File to write frame timings to (Chrome trace event format), none if empty
+    std::string trace_path;
+
+    // Number of sprites to scatter over the map (see sprite.h)
+    int num_sprites = 0;
+
+    // Number of lights to scatter over the map, on top of the ones placed on it (see light.h)
+    int num_lights = 0;
+
+    // Field of view angle, in radians
+    float fov = FOV;
+
+    // How the screen columns are raycast
+    Raycaster raycaster = RAYCASTER_AUTO;
+
+    // Draw at a higher resolution than the terminal, with block characters
+    SubcellMode subcells = SUBCELL_NONE;
+
+    // Most frames drawn per second, sleeping in between. 0 = as many as possible.
+    int frame_cap = 60;
+    // Don't draw frames when nothing changed since the last one
+    bool skip_unchanged = false;
+    // Raycast fewer columns when frames take longer than this many milliseconds
+    // (see ADAPTIVE RESOLUTION in view.h). 0 = the time between frames at
+    // 'frame_cap', less than 0 = off.
+    double adaptive_target_ms = -1.0;
+
+    // File to record the session to, none if empty. With 'record_frames'
+    // the frames drawn are recorded too, otherwise only the key presses.
+    std::string record_path;
+    bool record_frames = false;
+    // Recording to replay instead of playing, none if empty
+    std::string replay_path;
+
+    // Serve the game to clients on this address instead of playing it here
+    // (see server.h), not a server if empty
+    std::string serve_address;
+
+    // Benchmark mode (--bench), runs without a terminal
+    bool bench = false;
+    BenchOptions bench_options;
+    parse_bench_sizes("80x40,200x60,400x120", bench_options.sizes);
+
+    // Pick out the options ("--name value"), what remains is the
+    // positional arguments screen height and width
+    std::vector<std::string> positional_args;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+        {
+            try
+            {
+                num_threads = std::max(1, std::stoi(argv[++i]));
+            }
+            catch(const std::exception& e)
+            {
+                printf("Could not parse number of threads '%s', going with %d.\n", argv[i], num_threads);
+            }
+        }
+        else if (arg == "--backend" && i + 1 < argc)
+        {
+            backend_name = argv[++i];
+        }
+        else if (arg == "--palette" && i + 1 < argc)
+        {
+            palette_path = argv[++i];
+        }
+        else if (arg == "--textures" && i + 1 < argc)
+        {
+            textures_path = argv[++i];
+        }
+        else if (arg == "--map" && i + 1 < argc)
+        {
+            map_path = argv[++i];
+        }
+        else if (arg == "--generate-map" && i + 1 < argc)
+        {
+            std::vector<BenchSize> sizes;
+            if (!parse_bench_sizes(argv[++i], sizes) || sizes.size() != 1)
+            {
+                printf("Could not parse map size '%s', expected WIDTHxHEIGHT\n", argv[i]);
+                return 1;
+            }
+            generate_width = sizes[0].width;
+            generate_height = sizes[0].height;
+        }
+        else if (arg == "--save-map" && i + 1 < argc)
+        {
+            save_map_path = argv[++i];
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+        {
+            trace_path = argv[++i];
+        }
+        else if (arg == "--raycaster" && i + 1 < argc)
+        {
+            if (!parse_raycaster(argv[++i], raycaster))
+            {
+                printf("Unknown raycaster '%s', expected auto, skip, scalar, sse or avx2\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (arg == "--subcells" && i + 1 < argc)
+        {
+            if (!parse_subcell_mode(argv[++i], subcells))
+            {
+                printf("Unknown sub-cell mode '%s', expected none, half or quad\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (arg == "--fps" && i + 1 < argc)
+        {
+            frame_cap = std::max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--skip-unchanged")
+        {
+            skip_unchanged = true;
+        }
+        else if (arg == "--adaptive")
+        {
+            adaptive_target_ms = 0.0;
+        }
+        else if (arg == "--adaptive-target" && i + 1 < argc)
+        {
+            adaptive_target_ms = std::max(0.1, atof(argv[++i]));
+        }
+        else if (arg == "--bench-column-step" && i + 1 < argc)
+        {
+            bench_options.column_step = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--record" && i + 1 < argc)
+        {
+            record_path = argv[++i];
+        }
+        else if (arg == "--record-frames")
+        {
+            record_frames = true;
+        }
+        else if (arg == "--replay" && i + 1 < argc)
+        {
+            replay_path = argv[++i];
+        }
+        else if (arg == "--sprites" && i + 1 < argc)
+        {
+            num_sprites = std::max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--lights" && i + 1 < argc)
+        {
+            num_lights = std::max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--serve" && i + 1 < argc)
+        {
+            serve_address = argv[++i];
+        }
+        else if (arg == "--fov" && i + 1 < argc)
+        {
+            float degrees = atof(argv[++i]);
+            if (degrees <= 0.0f || degrees >= 180.0f)
+            {
+                printf("Field of view '%s' must be between 0 and 180 degrees\n", argv[i]);
+                return 1;
+            }
+            fov = degrees * PI / 180.0f;
+        }
+        else if (arg == "--bench")
+        {
+            bench = true;
+        }
+        else if (arg == "--bench-size" && i + 1 < argc)
+        {
+            if (!parse_bench_sizes(argv[++i], bench_options.sizes))
+            {
+                printf("Could not parse benchmark sizes '%s', expected WIDTHxHEIGHT[,WIDTHxHEIGHT...]\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (arg == "--bench-frames" && i + 1 < argc)
+        {
+            bench_options.frames = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--bench-raycast")
+        {
+            bench = true;
+            bench_options.raycast = true;
+        }
+        else if (arg == "--bench-map-size" && i + 1 < argc)
+        {
+            bench_options.map_size = std::max(3, atoi(argv[++i]));
+        }
+        else if (arg == "--bench-textures")
+        {
+            bench = true;
+            bench_options.texture_budget = true;
+        }
+        else if (arg == "--bench-sprites" && i + 1 < argc)
+        {
+            bench = true;
+            bench_options.sprites = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--bench-turn")
+        {
+            bench = true;
+            bench_options.turn = true;
+        }
+        else if (arg == "--bench-lights" && i + 1 < argc)
+        {
+            bench = true;
+            bench_options.lights = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--bench-collision" && i + 1 < argc)
+        {
+            bench = true;
+            bench_options.collision_bodies = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--bench-ascii")
+        {
+            bench_options.colored_output = false;
+        }
+        else if (arg == "--bench-replay" && i + 1 < argc)
+        {
+            bench = true;
+            bench_options.replay_path = argv[++i];
+        }
+        else
+        {
+            positional_args.push_back(arg);
+        }
+    }
+
+    if (!record_path.empty() && !replay_path.empty())
+    {
+        printf("Can't record while replaying\n");
+        return 1;
+    }
+
+    bool serving = !serve_address.empty();
+    if (serving && (!record_path.empty() || !replay_path.empty()))
+    {
+        printf("Can't record or replay in server mode\n");
+        return 1;
+    }
 
-    // Try parsing command line arguments screen height and width
+    if (!trace_path.empty() && !profiler_open_trace(trace_path.c_str()))
+    {
+        printf("Could not open trace file '%s'\n", trace_path.c_str());
+        return 1;
+    }
+
+    if (!palette_path.empty())
+    {
+        std::string error;
+        if (!load_palette(palette_path, palette, error))
+        {
+            printf("Could not load palette: %s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    if (subcells != SUBCELL_NONE && !pixel_colors_build())
+    {
+        printf("Palette has too many colors for sub-cell drawing (at most %d)\n", MAX_PIXEL_COLORS);
+        return 1;
+    }
+
+    TextureAtlas textures;
+    if (textures_path.empty())
+    {
+        default_textures(textures);
+    }
+    else
+    {
+        std::string error;
+        if (!load_textures(textures_path, textures, error))
+        {
+            printf("Could not load textures: %s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    if (bench)
+    {
+        bench_options.threads = num_threads;
+        bench_options.map_path = map_path;
+        bench_options.fov = fov;
+        bench_options.raycaster = raycaster;
+        bench_options.textures = &textures;
+        bench_options.textured = !textures_path.empty();
+        bench_options.subcells = subcells;
+        bench_options.replay_sprites = num_sprites;
+        bench_options.replay_lights = num_lights;
+        int result = run_bench(bench_options);
+        profiler_close_trace();
+        return result;
+    }
+
+    Map map;
+    if (generate_width > 0)
+    {
+        generate_map(map, generate_width, generate_height, 1);
+    }
+    else if (map_path.empty())
+    {
+        create_default_map(map);
+    }
+    else
+    {
+        std::string error;
+        if (!load_map(map_path, map, error))
+        {
+            printf("Could not load map: %s\n", error.c_str());
+            return 1;
+        }
+    }
+    if (!save_map_path.empty())
+    {
+        if (!save_map_binary(map, save_map_path))
+        {
+            printf("Could not save map to '%s'\n", save_map_path.c_str());
+            return 1;
+        }
+        printf("Saved %dx%d map to '%s'\n", map.width, map.height, save_map_path.c_str());
+        return 0;
+    }
+
+    Sprites sprites;
+    scatter_sprites(sprites, map, num_sprites, 1);
+
+    // Light on the walls and floors, baked once up front (see light.h)
+    std::vector<Light> lights;
+    map_lights(map, lights);
+    scatter_lights(lights, map, num_lights, 1);
+    LightMap light_map;
+    double bake_ms = 0.0;
+    if (!lights.empty())
+    {
+        ThreadPool bake_pool(num_threads);
+        auto bake_start = std::chrono::steady_clock::now();
+        light_map_bake(light_map, map, lights, bake_pool);
+        bake_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bake_start).count();
+    }
+    const LightMap *view_lights = lights.empty() ? nullptr : &light_map;
+
+    // A recording is replayed at the screen size it was made at, on the same map
+    Replay replay;
+    bool replaying = !replay_path.empty();
+    if (replaying)
+    {
+        std::string error;
+        if (!replay_open(replay, replay_path, error))
+        {
+            printf("Could not load recording: %s\n", error.c_str());
+            return 1;
+        }
+        const RecordingHeader &header = replay.header;
+        if (header.map_width != (uint32_t)map.width || header.map_height != (uint32_t)map.height ||
+            header.map_hash != map_hash(map))
+        {
+            printf("Recording was made on another map (%ux%u), give the same --map\n",
+                   header.map_width, header.map_height);
+            return 1;
+        }
+        fov = header.fov;
+    }
+
+    if (!serving)
+    {
+        printf("\033c"); // Clear screen
+    }
+
+    // Try parsing command line arguments screen height and width,
+    // otherwise go with the size of the terminal
+    int terminal_rows = 0;
+    int terminal_columns = 0;
     try
     {
-        if (argc >= 3)
+        if (replaying)
+        {
+            screen_width = replay.header.screen_width;
+            screen_height = replay.header.screen_height;
+        }
+        else if (positional_args.size() >= 2)
+        {
+            view_size_for_terminal(std::stoi(positional_args[0]), std::stoi(positional_args[1]),
+                                   screen_width, screen_height);
+        }
+        else if (!serving && terminal_size(terminal_rows, terminal_columns))
         {
-            screen_height = (std::stoi(argv[1]) - 3); // Minus 3 to make space for the prinout of fps, player position etc.
-            screen_width = std::stoi(argv[2]);
+            view_size_for_terminal(terminal_rows, terminal_columns, screen_width, screen_height);
         }
         else
         {
@@ -46,244 +486,358 @@ int main(int argc,char* argv[])
         screen_height = DEFAULT_SCREEN_HEIGHT;
         screen_width = DEFAULT_SCREEN_WIDTH;
     }
-    printf("Screen Width = %d Height = %d\n", screen_width, screen_height);
-    printf("Used WASD to move forward/backward and strafe left/right. Use K and L to rotate.\n");
+    printf("Screen Width = %d Height = %d Threads = %d Raycaster = %s\n", screen_width, screen_height, num_threads,
+           raycaster_name(select_raycaster(map, raycaster)));
+    if (!lights.empty())
+    {
+        printf("Baked the light of %d lights in %.1f ms\n", (int)lights.size(), bake_ms);
+    }
+    if (serving)
+    {
+        ServerOptions server_options;
+        server_options.address = serve_address;
+        server_options.map = &map;
+        server_options.textures = &textures;
+        server_options.sprites = sprites.x.empty() ? nullptr : &sprites;
+        server_options.lights = view_lights;
+        server_options.textured = !textures_path.empty();
+        server_options.subcells = subcells;
+        server_options.fov = fov;
+        server_options.raycaster = raycaster;
+        server_options.threads = num_threads;
+        server_options.frame_cap = frame_cap;
+        int result = run_server(server_options);
+        profiler_close_trace();
+        return result;
+    }
+    if (replaying)
+    {
+        printf("Replaying '%s'%s. Ctrl-C stops it.\n", replay_path.c_str(),
+               (replay.header.flags & RECORDING_FRAMES) ? " (recorded frames)" : "");
+    }
+    else
+    {
+        printf("Used WASD to move forward/backward and strafe left/right. Use K and L to rotate.\n");
+        printf("V toggles colors, T textures, H sub-cells (half, quad), M the map and P the frame timings.\n");
+    }
     printf("Press Enter to continue...\n");
     sleep(1);
     std::cin.ignore();
 
-    std::string map;
-    // # = wall/obastacle
-    // . = space
-    map += "####################";
-    map += "#..................#";
-    map += "#..................#";
-    map += "######...#######...#";
-    map += "######...#######...#";
-    map += "######...#######...#";
-    map += "######...###########";
-    map += "#..................#";
-    map += "#..................#";
-    map += "#..................#";
-    map += "#..................#";
-    map += "#####...#########..#";
-    map += "#..##...####..###..#";
-    map += "#..#########..###..#";
-    map += "#..................#";
-    map += "#..................#";
-    map += "#################..#";
-    map += "#..................#";
-    map += "#..................#";
-    map += "####################";
-
     printf("\033c"); // Clear screen
 
-    // Matrix where we store the characters in how they will be rendered onto the screen
-    std::string screen(screen_width * screen_height, ' ');
+    // Frame buffers where we store the characters (and colors) in how they will be rendered
+    // onto the screen. The rows below the rendered view are for the fps printout etc.
+    Presenter presenter;
+    presenter_resize(presenter, screen_width, screen_height + STATUS_ROWS);
+    FrameBuffer &screen = presenter.back;
+
+    // Player, held keys and display toggles (see session.h)
+    Session session;
+    session.textured = !textures_path.empty();
+    session.subcells = subcells;
+
+    // Raycasting results for every screen column, filled up in parallel
+    // and then drawn to screen from the main thread.
+    ViewBuffers view_buffers;
+    ThreadPool pool(num_threads);
+
+    // Ray direction of every screen column, updated when the player turns.
+    // (Built for the number of columns the view needs every frame, see 'view_columns')
+    Camera camera;
+    camera_set_angle(camera, START_ANGLE);
+
+    std::unique_ptr<OutputBackend> backend;
+    if (backend_name == "ansi")
+    {
+        init_raw_input();
+        backend.reset(new AnsiBackend());
+    }
+    else
+    {
+        init_input();
+        backend.reset(new NcursesBackend());
+    }
+    backend->resize(screen.width, screen.height);
+    if (!backend->init())
+    {
+        // Terminal has no colors, so stick to pure ascii
+        session.colored_output = false;
+    }
+    // Not enough color pairs for sub-cells, so stick to whole cells
+    session.subcells_supported = backend->supports_subcells();
+    if (!session.subcells_supported)
+    {
+        session.subcells = SUBCELL_NONE;
+    }
+
+    // Leave game loop on Ctrl-C, so the terminal can be restored
+    signal(SIGINT, handle_quit_signal);
+    signal(SIGTERM, handle_quit_signal);
+    // Follow the terminal when it is resized (a replay stays at the size it
+    // was recorded at). Replaces the handler of ncurses, see 'NcursesBackend::resize'.
+    if (!replaying)
+    {
+        signal(SIGWINCH, handle_resize_signal);
+    }
+
+    // Keys are read on a thread of their own (see input.h)
+    if (!start_input_thread())
+    {
+        backend->shutdown();
+        restore_input();
+        printf("Could not start input thread\n");
+        return 1;
+    }
+
+    // The player moves in fixed ticks, frames are drawn in between (see simulation.h).
+    // A replay starts out the way the recording did, and gets its key events and
+    // frame times from the recording instead of the terminal and the clock.
+    auto start_time = std::chrono::steady_clock::now();
+    auto next_frame = start_time;
+    if (replaying)
+    {
+        // (Without the colors or sub-cells the terminal can't draw)
+        bool colors_supported = session.colored_output;
+        bool subcells_supported = session.subcells_supported;
+        recording_header_apply(replay.header, session);
+        session.colored_output = session.colored_output && colors_supported;
+        session.subcells_supported = session.subcells_supported && subcells_supported;
+        if (!session.subcells_supported)
+        {
+            session.subcells = SUBCELL_NONE;
+        }
+        session_init(session, PlayerState{replay.header.start_x, replay.header.start_y, replay.header.start_angle},
+                     start_time);
+    }
+    else
+    {
+        session_init(session, PlayerState{map.start_x, map.start_y, START_ANGLE}, start_time);
+    }
+    ReplayFrame replay_frame;
 
-    // True = Colorized rendering/output
-    // False = Pure ascii (white text on black background) rendering/output
-    bool colored_output = true;
-    // True = Display map
-    // False = Don't display map
-    bool display_map = false;
+    Recorder recorder;
+    bool recording = !record_path.empty();
+    if (recording)
+    {
+        RecordingHeader header;
+        header.flags = record_frames ? RECORDING_FRAMES : 0;
+        header.fov = fov;
+        recording_header_set(header, map, session);
+        if (!recorder_open(recorder, record_path, header, start_time))
+        {
+            stop_input_thread();
+            backend->shutdown();
+            restore_input();
+            printf("Could not create recording '%s'\n", record_path.c_str());
+            return 1;
+        }
+    }
 
-    init_input();
-    init_colors();
+    // Player in the last frame drawn
+    PlayerState drawn_player = session.sim.current;
 
-    clock_t prevClock = clock();
+    // Columns raycast per frame, see ADAPTIVE RESOLUTION in view.h. (A replay
+    // raycasts as many as the recording did.)
+    AdaptiveResolution adaptive;
+    bool adapting = adaptive_target_ms >= 0.0 && !replaying;
+    adaptive.target_ms = (adaptive_target_ms > 0.0) ? adaptive_target_ms : 1000.0 / ((frame_cap > 0) ? frame_cap : 60);
+    int recorded_column_step = 1;
 
     // Game loop
-    while (1)
+    while (!quit_requested && !session.quit)
     {
-        // Handle input
-        if (kbhit())
+        profiler_begin_frame();
+        ScopedTimer frame_timer(STAGE_FRAME);
+
+        // Handle input, every key event since last frame
+        auto input_start = std::chrono::steady_clock::now();
+        auto now = input_start;
+        KeyEvent event;
+        if (replaying)
         {
-            char key = getch();
-            if (key == 'k') // rotate ccw
+            // Keys pressed while replaying only stop it (Ctrl-C)
+            while (pop_key_event(event))
             {
-                playerA -= 0.08f;
+                session.quit = session.quit || event.key == KEY_CTRL_C;
             }
-            else if (key == 'l') // rotate cw
+
+            std::string error;
+            if (!replay_next_frame(replay, start_time, replay_frame, error))
             {
-                playerA += 0.08f;
+                break; // End of the recording
             }
-            else if (key == 'w') // move forwards
+            now = start_time + replay_frame.time;
             {
-                playerX += sinf(playerA) * 0.5;
-                playerY += cosf(playerA) * 0.5;
-
-                // Collision detection
-                if (map[(int)playerY * MAP_WIDTH + (int)playerX] == '#')
-                {
-                    // New position puts us inside a wall. Rollback the move we just did
-                    playerX -= sinf(playerA) * 0.5;
-                    playerY -= cosf(playerA) * 0.5;
-                }
+                // Frames are replayed as far apart as they were recorded
+                ScopedTimer idle_timer(STAGE_IDLE);
+                std::this_thread::sleep_until(now);
             }
-            else if (key == 's') // move backwards
+            for (const KeyEvent &replay_event : replay_frame.events)
             {
-                playerX -= sinf(playerA) * 0.5;
-                playerY -= cosf(playerA) * 0.5;
-
-                // Collision detection
-                if (map[(int)playerY * MAP_WIDTH + (int)playerX] == '#')
-                {
-                    // New position puts us inside a wall. Rollback the move we just did
-                    playerX += sinf(playerA) * 0.5;
-                    playerY += cosf(playerA) * 0.5;
-                }
+                session_key_event(session, replay_event);
             }
-            else if (key == 'a') // strafe left
+        }
+        else
+        {
+            while (pop_key_event(event))
             {
-                playerX += sinf(playerA - 1.57) * 0.5; // pi/2 (90 degrees) = 1.57
-                playerY += cosf(playerA - 1.57) * 0.5;
-
-                // Collision detection
-                if (map[(int)playerY * MAP_WIDTH + (int)playerX] == '#')
+                session_key_event(session, event);
+                if (recording)
                 {
-                    // New position puts us inside a wall. Rollback the move we just did
-                    playerX -= sinf(playerA - 1.57) * 0.5;
-                    playerY -= cosf(playerA - 1.57) * 0.5;
+                    record_key_event(recorder, event);
                 }
             }
-            else if (key == 'd') // strafe right
-            {
-                playerX += sinf(playerA + 1.57) * 0.5;
-                playerY += cosf(playerA + 1.57) * 0.5;
+            now = std::chrono::steady_clock::now();
+        }
 
-                // Collision detection
-                if (map[(int)playerY * MAP_WIDTH + (int)playerX] == '#')
-                {
-                    // New position puts us inside a wall. Rollback the move we just did
-                    playerX -= sinf(playerA + 1.57) * 0.5;
-                    playerY -= cosf(playerA + 1.57) * 0.5;
-                }
-            }
-            else if (key == 'v') // Switch visual mode (toggle between ascii and colorized drawing)
+        // The view follows the size of the terminal, or the recording's when replaying
+        int resize_width = screen_width;
+        int resize_height = screen_height;
+        if (replaying)
+        {
+            resize_width = replay.screen_width;
+            resize_height = replay.screen_height;
+        }
+        else if (resize_requested)
+        {
+            resize_requested = 0;
+            if (terminal_size(terminal_rows, terminal_columns))
             {
-                colored_output = !colored_output;
-                attrset(A_NORMAL); // Override previous attributes set, and set to normal
-                                   // if switching is to ascii rendering
-                                   // (attron doesn,'t override previous, attrset does though)
+                view_size_for_terminal(terminal_rows, terminal_columns, resize_width, resize_height);
             }
-            else if (key == 'm') // Toggle display map
+        }
+        if (resize_width != screen_width || resize_height != screen_height)
+        {
+            resize_screen(presenter, *backend, resize_width, resize_height);
+            session.redraw = true;
+            if (recording)
             {
-                display_map = !display_map;
+                record_resize(recorder, screen_width, screen_height);
             }
         }
 
-        // Should only be called once per frame (as suppose to once per column or row)
-        // Needs also to be called before rendering wall, as wall should paint over
-        // the ceiling and floor.
-        if (colored_output)
+        // Run the simulation up to now
+        session_update(session, map, now);
+        profiler_record(STAGE_INPUT, input_start, std::chrono::steady_clock::now());
+
+        // Nothing changed since the last frame drawn, so it is still what
+        // should be on the terminal. (The frame timings change every frame.)
+        // A replay draws the frames the recording drew.
+        PlayerState player = sim_interpolate(session.sim);
+        bool changed = session.redraw || session.display_profiler || player != drawn_player;
+        bool draw = replaying ? replay_frame.drawn : (changed || !skip_unchanged);
+        if (draw && replaying && replay_frame.has_cells &&
+            replay.frame.width == screen.width && replay.frame.height == screen.height)
         {
-            colored_draw_ceiling_and_floor();
+            // Recorded frame, as it was on the terminal
+            screen.cells = replay.frame.cells;
+            ScopedTimer present_timer(STAGE_PRESENT);
+            present(presenter, *backend);
         }
-
-        // Iterate through all screen columns
-        for (int x = 0; x < screen_width; ++x)
+        else if (draw)
         {
-            // For each column, making up the screen, calculate the projected ray angle into world space
-            // ---- CALCULATION EXPLAINED: ----
-            // (playerA - FOV / 2.0f) = The left edge of our field-of-view (what we see)
-            // (float)x / (float)screen_width) * FOV = If x = 1 this is how much degree of angle for each column we see infront of us,
-            //                                   So this adds the amount of degrees of angle to find our column
-            float rayAngle = (playerA - FOV / 2.0f) + ((float)x / (float)screen_width) * FOV;
-
-            // Progressively step forward in direction of current 
-            // 'rayAngle' until we hit a wall to figure out the distance.
-            float distanceToWall = 0;
-            bool hitWall = false;
-
-            // Unit vector for ray
-            float rayX = sinf(rayAngle);
-            float rayY = cosf(rayAngle);
-
-            while (!hitWall && distanceToWall < MAX_DEPTH)
+            auto draw_start = std::chrono::steady_clock::now();
+            ViewSettings view_settings;
+            view_settings.raycaster = raycaster;
+            view_settings.colored_output = session.colored_output;
+            view_settings.textures = session.textured ? &textures : nullptr;
+            view_settings.subcells = session.subcells;
+            view_settings.sprites = sprites.x.empty() ? nullptr : &sprites;
+            view_settings.lights = view_lights;
+            view_settings.column_step = replaying ? replay.column_step : adaptive.column_step;
+            if (recording && view_settings.column_step != recorded_column_step)
             {
-                distanceToWall += RAYCAST_DIST_RES;
-
-                int testX = (int)(playerX + rayX * distanceToWall);
-                int testY = (int)(playerY + rayY * distanceToWall);
-
-                // Test if ray is out of bounds
-                if ( testX < 0 ||
-                     testX >= MAP_WIDTH ||
-                     testY < 0 ||
-                     testY >= MAP_HEIGHT)
-                {
-                    hitWall = true;
-                    distanceToWall = MAX_DEPTH;
-                }
-                else
-                {
-                    // Ray is inbounds so test to see if the ray cell is a wall block
-                    if (map[testY * MAP_WIDTH + testX] == '#')
-                    {
-                        hitWall = true;
-                    }
-                }
+                record_column_step(recorder, view_settings.column_step);
+                recorded_column_step = view_settings.column_step;
             }
+            camera_resize(camera, view_columns(view_settings), fov);
+            if (camera.angle != player.angle)
+            {
+                camera_set_angle(camera, player.angle);
+            }
+            render_view(map, player.x, player.y, camera, view_settings, pool, view_buffers, screen);
 
-            // Calculate how much of ceiling and floor should show based on the distance 
-            // (more ceiling and floor the further away wall is)
-
-            // We assume our eyes are at Horizon level, so the further away we are
-            // we can think the height of the wall as it appears shrinks closer and closer
-            // to the middle as we move further away, so it shrinks in how it appears equally
-            // from the floor as it does from the ceiling.
-            int ceiling = std::max( (float)(screen_height / 2.0) - (float)(MAX_DEPTH * 4) / ((float) distanceToWall), 0.0f );
+            // Printouts below the rendered view, without any of the background or foreground color applied
+            for (int y = screen_height; y < screen.height; ++y)
+            {
+                fb_fill_row(screen, 0, y, screen.width, Cell{' ', 0});
+            }
+            char line[256];
+            static unsigned long frameCounter = 0;
+            // Time of last whole frame (this one isn't done yet), and how much of it was spent sleeping
+            double frame_ms = profiler_stats(STAGE_FRAME).last;
+            double idle_ms = profiler_stats(STAGE_IDLE).last;
+            long fps = (frame_ms > 0.0) ? 1000.0 / frame_ms : 0;
+            snprintf(line, sizeof(line), "FPS = %ld FrameTime: %.3f ms (%.3f ms not sleeping)", fps, frame_ms,
+                     frame_ms - idle_ms);
+            fb_print(screen, 0, screen_height, line, 0);
+            snprintf(line, sizeof(line), "frameCounter = %lu, cells printed = %d, raycasting every %d column(s)",
+                     frameCounter, presenter.cells_printed, view_settings.column_step);
+            fb_print(screen, 0, screen_height + 1, line, 0);
+            frameCounter++;
+            snprintf(line, sizeof(line), "player pos (x,y) = %.3f,%.3f playerA = %.3f", player.x, player.y, player.angle);
+            fb_print(screen, 0, screen_height + 2, line, 0);
+
+            if (session.display_map)
+            {
+                // Draw map in top left corner
+                draw_map_overlay(map, player.x, player.y, screen);
+            }
 
-            int floor = screen_height - ceiling;
+            if (session.display_profiler)
+            {
+                // Draw in top right corner
+                profiler_draw_overlay(screen, screen_width - PROFILER_OVERLAY_WIDTH, 0);
+            }
 
-            if (colored_output)
+            // Print what changed since last frame to the terminal
             {
-                colored_draw_wall_column(x, ceiling, floor, distanceToWall);
+                ScopedTimer present_timer(STAGE_PRESENT);
+                present(presenter, *backend);
             }
-            else
+
+            if (adapting)
             {
-                ascii_shade_column(x, ceiling, floor, distanceToWall, screen);
+                adaptive_resolution_update(adaptive, std::chrono::duration<double, std::milli>(
+                                                         std::chrono::steady_clock::now() - draw_start).count());
             }
         }
-
-        if (colored_output)
+        if (draw)
         {
-            // So the next printout, fps printout etc., happens on the correct line
-            move(screen_height, 0);
-            // Make sure next printout doesn't have any of the background or foreground color applied
-            attrset(A_NORMAL);
+            drawn_player = player;
+            session.redraw = false;
         }
-        else
+
+        // Record the frame, only what the presenter found changed
+        if (recording)
         {
-            ascii_draw(screen);
+            ScopedTimer record_timer(STAGE_RECORD);
+            record_frame(recorder, now, draw ? &screen : nullptr, presenter.runs);
         }
 
-        static unsigned long frameCounter = 0;
-        clock_t clock_diff = clock() - prevClock;
-        printw("\nclock_diff = %ld, clocksPerSec = %ld\n", clock_diff, CLOCKS_PER_SEC);
-        double time_diff_sec = (double)clock_diff / CLOCKS_PER_SEC;
-        long fps = 1.0f / time_diff_sec;
-        printw("FPS = %ld TimeDiff: %f seconds, frameCounter = %lu\n", fps, time_diff_sec, frameCounter);
-        prevClock = clock();
-        frameCounter++;
-        printw("player pos (x,y) = %.3f,%.3f playerA = %.3f", playerX, playerY, playerA);
-
-        if (display_map)
+        // Sleep until it's time for the next frame. If we are behind, the
+        // next frame is due right away (no catching up with faster frames).
+        // Without a frame cap, only sleep when there is nothing to draw.
+        if (!replaying && (frame_cap > 0 || (skip_unchanged && !changed)))
         {
-            // Draw map
-            move(0,0); // Draw map in top left corner
-            std::string mapCopy = map;
-            mapCopy[((int)playerY) * MAP_WIDTH + ((int)playerX)] = 'P';
-            for (int y = 0; y < MAP_HEIGHT; ++y)
-            {
-                move(y,0);
-                std::string mapRow = mapCopy.substr(y*MAP_WIDTH, MAP_WIDTH);
-                printw(mapRow.c_str());
-            }
+            ScopedTimer idle_timer(STAGE_IDLE);
+            auto frame_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>((frame_cap > 0) ? 1.0 / frame_cap : SIM_TICK));
+            next_frame = std::max(next_frame + frame_interval, std::chrono::steady_clock::now());
+            std::this_thread::sleep_until(next_frame);
         }
 
-        refresh(); // Without this printw will not be outputted before
+    } // End of Game loop ( while(!quit_requested) )
 
-    } // End of Game loop ( while(1) )
+    stop_input_thread();
+    backend->shutdown();
+    restore_input();
+    profiler_close_trace();
+    if (recording && !recorder_close(recorder))
+    {
+        printf("Could not write recording '%s'\n", record_path.c_str());
+        return 1;
+    }
+    return 0;
 }
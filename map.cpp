@@ -0,0 +1,429 @@
+#include "map.h"
+#include <algorithm> // max
+#include <cstdio> // FILE, fopen, fread, fwrite
+#include <cstring> // memcmp, memcpy
+#include <fcntl.h> // open
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h> // fstat
+#include <unistd.h> // close
+
+Map::~Map()
+{
+    release();
+}
+
+void Map::release()
+{
+    if (mapping != nullptr)
+    {
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+        mapping_size = 0;
+    }
+    storage.clear();
+    block_distance_field.clear();
+    cells = nullptr;
+}
+
+void Map::assign(int width, int height, const std::vector<uint8_t> &cells)
+{
+    release();
+    this->width = width;
+    this->height = height;
+    storage.assign(MAP_CELL_PADDING, 0);
+    storage.insert(storage.end(), cells.begin(), cells.end());
+    this->cells = storage.data() + MAP_CELL_PADDING;
+    build_distance_field();
+}
+
+void Map::assign_mapping(int width, int height, const uint8_t *cells, void *mapping, size_t mapping_size)
+{
+    release();
+    this->width = width;
+    this->height = height;
+    this->cells = cells;
+    this->mapping = mapping;
+    this->mapping_size = mapping_size;
+    build_distance_field();
+}
+
+void Map::set(int x, int y, uint8_t cell)
+{
+    if (mapping != nullptr)
+    {
+        std::vector<uint8_t> copy(cells, cells + (size_t)width * height);
+        assign(width, height, copy);
+    }
+    storage[MAP_CELL_PADDING + (size_t)y * width + x] = cell;
+    build_distance_field();
+}
+
+// First works out which blocks have a wall in them (tiles outside the map
+// count as wall, for blocks sticking out past the edge of the map).
+// Then a two pass chamfer distance transform over the blocks. With all 8
+// neighbours weighted 1 this gives the exact Chebyshev (chessboard) distance
+// to the closest block with a wall. First pass spreads distances right and
+// down from the top left corner, second pass left and up from the bottom right.
+void Map::build_distance_field()
+{
+    blocks_wide = (width + MAP_BLOCK_SIZE - 1) >> MAP_BLOCK_SHIFT;
+    blocks_high = (height + MAP_BLOCK_SIZE - 1) >> MAP_BLOCK_SHIFT;
+    block_distance_field.assign((size_t)blocks_wide * blocks_high, 255);
+
+    for (int y = 0; y < blocks_high * MAP_BLOCK_SIZE; ++y)
+    {
+        for (int x = 0; x < blocks_wide * MAP_BLOCK_SIZE; ++x)
+        {
+            if (is_wall(x, y))
+            {
+                block_distance_field[(size_t)(y >> MAP_BLOCK_SHIFT) * blocks_wide + (x >> MAP_BLOCK_SHIFT)] = 0;
+            }
+        }
+    }
+
+    // Distance at a neighbour, outside the map counts as wall
+    auto neighbour = [this](int bx, int by) -> int
+    {
+        if (bx < 0 || by < 0 || bx >= blocks_wide || by >= blocks_high)
+        {
+            return 0;
+        }
+        return block_distance_field[(size_t)by * blocks_wide + bx];
+    };
+
+    for (int by = 0; by < blocks_high; ++by)
+    {
+        for (int bx = 0; bx < blocks_wide; ++bx)
+        {
+            uint8_t &block_distance = block_distance_field[(size_t)by * blocks_wide + bx];
+            if (block_distance == 0)
+            {
+                continue;
+            }
+            int distance = std::min(std::min(neighbour(bx - 1, by), neighbour(bx - 1, by - 1)),
+                                    std::min(neighbour(bx, by - 1), neighbour(bx + 1, by - 1))) + 1;
+            block_distance = std::min<int>(block_distance, distance);
+        }
+    }
+    for (int by = blocks_high - 1; by >= 0; --by)
+    {
+        for (int bx = blocks_wide - 1; bx >= 0; --bx)
+        {
+            uint8_t &block_distance = block_distance_field[(size_t)by * blocks_wide + bx];
+            if (block_distance == 0)
+            {
+                continue;
+            }
+            int distance = std::min(std::min(neighbour(bx + 1, by), neighbour(bx + 1, by + 1)),
+                                    std::min(neighbour(bx, by + 1), neighbour(bx - 1, by + 1))) + 1;
+            block_distance = std::min<int>(block_distance, distance);
+        }
+    }
+}
+
+// Builds 'map' from text, one row of cells per line. See map.h for the format.
+static bool parse_text_map(const char *text, size_t length, Map &map, std::string &error)
+{
+    // First pass, find size
+    int width = 0;
+    int height = 0;
+    int row_length = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (text[i] == '\n')
+        {
+            width = std::max(width, row_length);
+            ++height;
+            row_length = 0;
+        }
+        else if (text[i] != '\r')
+        {
+            ++row_length;
+        }
+    }
+    if (row_length > 0)
+    {
+        width = std::max(width, row_length);
+        ++height;
+    }
+    if (width == 0 || height == 0)
+    {
+        error = "map is empty";
+        return false;
+    }
+
+    // Second pass, fill in cells. Anything not given is wall.
+    map.lights.clear();
+    std::vector<uint8_t> cells((size_t)width * height, CELL_WALL);
+    bool has_start = false;
+    int x = 0;
+    int y = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        char c = text[i];
+        if (c == '\n')
+        {
+            x = 0;
+            ++y;
+            continue;
+        }
+        if (c == '\r')
+        {
+            continue;
+        }
+
+        uint8_t cell;
+        if (c == '.' || c == ' ')
+        {
+            cell = CELL_EMPTY;
+        }
+        else if (c == 'P')
+        {
+            cell = CELL_EMPTY;
+            map.start_x = x + 0.5f;
+            map.start_y = y + 0.5f;
+            has_start = true;
+        }
+        else if (c == '*')
+        {
+            cell = CELL_EMPTY;
+            map.lights.push_back(MapLight{x + 0.5f, y + 0.5f});
+        }
+        else if (c == '#')
+        {
+            cell = CELL_WALL;
+        }
+        else if (c >= '1' && c <= '9')
+        {
+            cell = c - '0';
+        }
+        else
+        {
+            error = "unknown map character '" + std::string(1, c) + "' at line " + std::to_string(y + 1);
+            return false;
+        }
+        cells[(size_t)y * width + x] = cell;
+        ++x;
+    }
+
+    // Without a 'P' the player starts in the first empty cell, like a binary
+    // map the player has to start in the open
+    for (size_t i = 0; !has_start && i < cells.size(); ++i)
+    {
+        if (cells[i] == CELL_EMPTY)
+        {
+            map.start_x = (int)(i % width) + 0.5f;
+            map.start_y = (int)(i / width) + 0.5f;
+            has_start = true;
+        }
+    }
+    if (!has_start)
+    {
+        error = "map has no empty cell for the player to start in";
+        return false;
+    }
+
+    map.assign(width, height, cells);
+    return true;
+}
+
+static uint32_t read_uint32(const unsigned char *bytes)
+{
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static void write_uint32(unsigned char *bytes, uint32_t value)
+{
+    bytes[0] = value & 0xff;
+    bytes[1] = (value >> 8) & 0xff;
+    bytes[2] = (value >> 16) & 0xff;
+    bytes[3] = (value >> 24) & 0xff;
+}
+
+void create_default_map(Map &map)
+{
+    std::string text;
+    // # = wall/obastacle
+    // . = space
+    text += "####################\n";
+    text += "#P.................#\n";
+    text += "#..................#\n";
+    text += "######...#######...#\n";
+    text += "######...#######...#\n";
+    text += "######...#######...#\n";
+    text += "######...###########\n";
+    text += "#..................#\n";
+    text += "#..................#\n";
+    text += "#..................#\n";
+    text += "#..................#\n";
+    text += "#####...#########..#\n";
+    text += "#..##...####..###..#\n";
+    text += "#..#########..###..#\n";
+    text += "#..................#\n";
+    text += "#..................#\n";
+    text += "#################..#\n";
+    text += "#..................#\n";
+    text += "#..................#\n";
+    text += "####################\n";
+
+    std::string error;
+    parse_text_map(text.c_str(), text.size(), map, error);
+}
+
+void generate_map(Map &map, int width, int height, unsigned seed)
+{
+    // Small deterministic random number generator (same on every platform)
+    uint32_t state = seed * 2654435761u + 1;
+    auto next_random = [&state](uint32_t range) -> uint32_t
+    {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) % range;
+    };
+
+    std::vector<uint8_t> cells((size_t)width * height, CELL_EMPTY);
+    auto set_wall = [&](int x, int y, uint8_t cell)
+    {
+        if (x >= 0 && y >= 0 && x < width && y < height)
+        {
+            cells[(size_t)y * width + x] = cell;
+        }
+    };
+
+    // Border all around
+    for (int x = 0; x < width; ++x)
+    {
+        set_wall(x, 0, CELL_WALL);
+        set_wall(x, height - 1, CELL_WALL);
+    }
+    for (int y = 0; y < height; ++y)
+    {
+        set_wall(0, y, CELL_WALL);
+        set_wall(width - 1, y, CELL_WALL);
+    }
+
+    // Scattered pillars, about one per 2500 cells
+    size_t num_pillars = (size_t)width * height / 2500;
+    for (size_t i = 0; i < num_pillars; ++i)
+    {
+        set_wall(next_random(width), next_random(height), 1 + next_random(MAX_CELL_TYPES - 1));
+    }
+
+    // Long walls, horizontal or vertical, with gaps to walk through
+    size_t num_walls = (size_t)width * height / 20000;
+    for (size_t i = 0; i < num_walls; ++i)
+    {
+        int x = next_random(width);
+        int y = next_random(height);
+        int length = 8 + next_random(64);
+        bool horizontal = next_random(2) == 0;
+        uint8_t cell = 1 + next_random(MAX_CELL_TYPES - 1);
+        for (int j = 0; j < length; ++j)
+        {
+            if (j % 16 == 7)
+            {
+                continue; // Gap
+            }
+            set_wall(horizontal ? x + j : x, horizontal ? y : y + j, cell);
+        }
+    }
+
+    // Make sure the player starts out in the open
+    int start_x = width / 2;
+    int start_y = height / 2;
+    set_wall(start_x, start_y, CELL_EMPTY);
+    map.start_x = start_x + 0.5f;
+    map.start_y = start_y + 0.5f;
+    map.lights.clear();
+
+    map.assign(width, height, cells);
+}
+
+bool load_map(const std::string &path, Map &map, std::string &error)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = "could not open '" + path + "'";
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+        close(fd);
+        error = "could not read '" + path + "'";
+        return false;
+    }
+    size_t size = file_stat.st_size;
+
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // Mapping stays valid after file is closed
+    if (mapping == MAP_FAILED)
+    {
+        error = "could not mmap '" + path + "'";
+        return false;
+    }
+    const unsigned char *bytes = (const unsigned char *)mapping;
+
+    if (size >= MAP_BINARY_HEADER_SIZE && memcmp(bytes, MAP_BINARY_MAGIC, 8) == 0)
+    {
+        uint32_t width = read_uint32(bytes + 8);
+        uint32_t height = read_uint32(bytes + 12);
+        uint32_t start_x = read_uint32(bytes + 16);
+        uint32_t start_y = read_uint32(bytes + 20);
+        if (width == 0 || height == 0 || width > 1000000 || height > 1000000 ||
+            size - MAP_BINARY_HEADER_SIZE < (size_t)width * height)
+        {
+            munmap(mapping, size);
+            error = "'" + path + "' is not a valid binary map";
+            return false;
+        }
+        // Everything indexed by cell type id has MAX_CELL_TYPES entries, and
+        // the player has to start inside the map, in the open
+        const unsigned char *cells = bytes + MAP_BINARY_HEADER_SIZE;
+        size_t cell_count = (size_t)width * height;
+        bool valid_cells = true;
+        for (size_t i = 0; i < cell_count; ++i)
+        {
+            valid_cells = valid_cells && cells[i] < MAX_CELL_TYPES;
+        }
+        if (!valid_cells || start_x >= width || start_y >= height ||
+            cells[(size_t)start_y * width + start_x] != CELL_EMPTY)
+        {
+            munmap(mapping, size);
+            error = "'" + path + "' is not a valid binary map";
+            return false;
+        }
+
+        // Cells are used straight from the mapped file
+        map.assign_mapping(width, height, cells, mapping, size);
+        map.start_x = start_x + 0.5f;
+        map.start_y = start_y + 0.5f;
+        map.lights.clear();
+        return true;
+    }
+
+    bool result = parse_text_map((const char *)bytes, size, map, error);
+    munmap(mapping, size);
+    return result;
+}
+
+bool save_map_binary(const Map &map, const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    unsigned char header[MAP_BINARY_HEADER_SIZE];
+    memcpy(header, MAP_BINARY_MAGIC, 8);
+    write_uint32(header + 8, map.width);
+    write_uint32(header + 12, map.height);
+    write_uint32(header + 16, (uint32_t)map.start_x);
+    write_uint32(header + 20, (uint32_t)map.start_y);
+
+    size_t cell_count = (size_t)map.width * map.height;
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+              fwrite(map.data(), 1, cell_count, file) == cell_count;
+    return fclose(file) == 0 && ok;
+}
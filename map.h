@@ -0,0 +1,129 @@
+// map.h - The map the player moves around in. A dense grid of cells, one byte
+//         per cell holding the cell type id. Maps can be any size and are
+//         either the built in one or loaded from a file.
+//
+// ---- FILE FORMATS: ----
+// Text:   One row of cells per line, one character per cell.
+//         '.' or ' ' = empty, '#' = wall (CELL_WALL), '1'-'9' = wall of that
+//         cell type, 'P' = empty and where the player starts, '*' = empty
+//         with a light in the middle (see light.h).
+//         Rows shorter than the longest row are filled up with walls.
+//         Without a 'P' the player starts in the first empty cell (row by
+//         row), rejected if there is none.
+// Binary: MAP_BINARY_MAGIC (8 bytes), then width, height, player start x and
+//         player start y (little endian uint32 each), then width * height
+//         cell type ids row by row. Loaded with mmap, so no parsing or copying.
+//         Rejected if a cell type id isn't below MAX_CELL_TYPES, or the
+//         player doesn't start on an empty cell inside the map.
+//         (Binary maps have no lights)
+
+#ifndef MAP_H
+#define MAP_H
+
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t
+#include <string> // std::string
+#include <vector> // vector
+
+#define MAP_BINARY_MAGIC "ASCIIMAP"
+#define MAP_BINARY_HEADER_SIZE 24
+
+// Cell type ids
+#define CELL_EMPTY 0
+#define CELL_WALL 1
+#define MAX_CELL_TYPES 10 // Cell type ids go from 0 to MAX_CELL_TYPES - 1
+
+// Width and height in tiles of the blocks the map's distance field is built
+// over (1 << MAP_BLOCK_SHIFT). See 'Map::empty_block_radius'.
+#define MAP_BLOCK_SHIFT 3
+#define MAP_BLOCK_SIZE (1 << MAP_BLOCK_SHIFT)
+
+// Number of bytes before the first cell that are always safe to read.
+// Lets the SIMD raycaster fetch a cell as the top byte of a 4-byte load.
+// (Binary map files have their header there)
+#define MAP_CELL_PADDING 3
+
+// A light placed on the map, see light.h
+struct MapLight
+{
+    float x;
+    float y;
+};
+
+class Map
+{
+public:
+    Map() {}
+    ~Map();
+    Map(const Map &) = delete;
+    Map &operator=(const Map &) = delete;
+
+    int width = 0;
+    int height = 0;
+    float start_x = 1.5f; // Where the player starts
+    float start_y = 1.5f;
+    std::vector<MapLight> lights; // Placed on the map
+
+    // Cell type id at column 'x', row 'y' (must be inside the map)
+    uint8_t at(int x, int y) const { return cells[(size_t)y * width + x]; }
+
+    // True if 'x', 'y' is inside a wall, or outside the map
+    bool is_wall(int x, int y) const
+    {
+        return x < 0 || y < 0 || x >= width || y >= height || at(x, y) != CELL_EMPTY;
+    }
+
+    // The map is also split up into blocks of MAP_BLOCK_SIZE * MAP_BLOCK_SIZE
+    // tiles. For block 'bx', 'by' this is the Chebyshev distance (in blocks)
+    // to the closest block that has a wall in it, capped at 255.
+    // So every block within 'empty_block_radius - 1' blocks in every direction,
+    // and every tile in them, is empty. 0 if the block itself has a wall in it.
+    // (must be inside the map)
+    int empty_block_radius(int bx, int by) const { return block_distance_field[(size_t)by * blocks_wide + bx]; }
+
+    // All cells row by row, width * height cell type ids.
+    // Preceded by MAP_CELL_PADDING readable bytes.
+    const uint8_t *data() const { return cells; }
+
+    // Replace contents with a copy of 'cells'
+    void assign(int width, int height, const std::vector<uint8_t> &cells);
+    // Replace contents with memory mapped file, cells start at 'cells'
+    void assign_mapping(int width, int height, const uint8_t *cells, void *mapping, size_t mapping_size);
+
+    // Change the cell at column 'x', row 'y' (must be inside the map) to
+    // cell type id 'cell'. A memory mapped map is copied first. Rebuilds
+    // the distance field, so not something to do every frame.
+    void set(int x, int y, uint8_t cell);
+
+private:
+    void release();
+    void build_distance_field();
+
+    const uint8_t *cells = nullptr;
+    std::vector<uint8_t> storage; // Owns 'cells' (after MAP_CELL_PADDING bytes) when they weren't memory mapped
+    void *mapping = nullptr;      // Memory mapped file that owns 'cells', if any
+    size_t mapping_size = 0;
+
+    // For every block, distance to closest block with a wall, see
+    // 'empty_block_radius'. Built whenever the cells change. Small enough
+    // (one byte per block) to stay in cache while rays are cast.
+    int blocks_wide = 0;
+    int blocks_high = 0;
+    std::vector<uint8_t> block_distance_field;
+};
+
+// Fills 'map' with the built in map
+void create_default_map(Map &map);
+
+// Fills 'map' with a generated map of 'width' * 'height' cells. Big open areas
+// broken up by pillars and long walls. Same seed gives the same map.
+void generate_map(Map &map, int width, int height, unsigned seed);
+
+// Loads a map in text or binary format (detected from the start of the file).
+// Returns false, and a description of what went wrong in 'error', if it failed.
+bool load_map(const std::string &path, Map &map, std::string &error);
+
+// Saves 'map' in binary format. Returns false if file couldn't be written.
+bool save_map_binary(const Map &map, const std::string &path);
+
+#endif
@@ -0,0 +1,59 @@
+#include "rendering.h"
+#include <ncurses.h> // attrset, attr_set, mvaddstr, refresh, endwin, resizeterm
+
+bool NcursesBackend::init()
+{
+    return init_colors(subcell_pairs);
+}
+
+void NcursesBackend::shutdown()
+{
+    attrset(A_NORMAL);
+    endwin();
+}
+
+void NcursesBackend::resize(int width, int height)
+{
+    // The game loop handles SIGWINCH itself instead of ncurses (keys aren't
+    // read through ncurses, so it would never see KEY_RESIZE), so tell it
+    if (is_term_resized(height, width))
+    {
+        resizeterm(height, width);
+        clearok(curscr, TRUE); // The terminal may have moved things around, repaint all of it
+    }
+}
+
+// One ncurses call per stretch of cells sharing the same color pair.
+// Block characters go in as UTF-8, ncursesw puts them together.
+void NcursesBackend::print_run(const FrameBuffer &fb, int y, int x_begin, int x_end)
+{
+    int x = x_begin;
+    while (x < x_end)
+    {
+        short color_pair = fb.at(x, y).color_pair;
+        run_glyphs.clear();
+        int start = x;
+        while (x < x_end && fb.at(x, y).color_pair == color_pair)
+        {
+            char glyph = fb.at(x, y).glyph;
+            if (is_quadrant_glyph(glyph))
+            {
+                run_glyphs.append(quadrant_glyph_utf8(glyph), 3);
+            }
+            else
+            {
+                run_glyphs += glyph;
+            }
+            ++x;
+        }
+        // (COLOR_PAIR only has room for pairs up to 255)
+        attr_set(A_NORMAL, color_pair, nullptr);
+        mvaddstr(y, start, run_glyphs.c_str());
+    }
+}
+
+void NcursesBackend::flush()
+{
+    attrset(A_NORMAL);
+    refresh();
+}
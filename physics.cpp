@@ -0,0 +1,233 @@
+#include "physics.h"
+#include <algorithm> // max, min
+#include <cmath> // floorf, ceilf, fabsf, sqrtf
+
+// True if the map block of tile 'tx', 'ty' and every block next to it
+// have no walls (or it is outside of the map, then we don't know)
+static inline bool open_around(const Map &map, int tx, int ty)
+{
+    if (tx < 0 || ty < 0 || tx >= map.width || ty >= map.height)
+    {
+        return false;
+    }
+    return map.empty_block_radius(tx >> MAP_BLOCK_SHIFT, ty >> MAP_BLOCK_SHIFT) >= 2;
+}
+
+// True if any tile in columns 'tx0' to 'tx1' and rows 'ty0' to 'ty1' is a wall
+static inline bool tiles_have_wall(const Map &map, int tx0, int ty0, int tx1, int ty1)
+{
+    for (int ty = ty0; ty <= ty1; ++ty)
+    {
+        for (int tx = tx0; tx <= tx1; ++tx)
+        {
+            if (map.is_wall(tx, ty))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool body_in_wall(const Map &map, float x, float y, float radius)
+{
+    return tiles_have_wall(map, (int)floorf(x - radius), (int)floorf(y - radius),
+                           (int)floorf(x + radius), (int)floorf(y + radius));
+}
+
+// Moves 'position' along one axis by 'delta', stopping against the first
+// column (or row) of tiles in the way with a wall in rows (columns)
+// 'across0' to 'across1'. 'is_wall(along, across)' looks up a tile.
+template<typename IsWall>
+static inline bool move_axis(float &position, float delta, float radius, int across0, int across1, IsWall is_wall)
+{
+    float moved = position + delta;
+    if (delta > 0.0f)
+    {
+        // Front edge moves into the tiles from the one it was in up to 'moved + radius'
+        int first = (int)floorf(position + radius) + 1;
+        int last = (int)floorf(moved + radius);
+        for (int along = first; along <= last; ++along)
+        {
+            for (int across = across0; across <= across1; ++across)
+            {
+                if (is_wall(along, across))
+                {
+                    position = std::max(position, along - radius - COLLISION_GAP);
+                    return true;
+                }
+            }
+        }
+    }
+    else if (delta < 0.0f)
+    {
+        int first = (int)floorf(position - radius) - 1;
+        int last = (int)floorf(moved - radius);
+        for (int along = first; along >= last; --along)
+        {
+            for (int across = across0; across <= across1; ++across)
+            {
+                if (is_wall(along, across))
+                {
+                    position = std::min(position, along + 1 + radius + COLLISION_GAP);
+                    return true;
+                }
+            }
+        }
+    }
+    position = moved;
+    return false;
+}
+
+int move_and_slide(const Map &map, float &x, float &y, float dx, float dy, float radius)
+{
+    // Steps no longer than the radius, so no step goes further than the
+    // tiles next to the ones the body is in
+    int steps = std::max(1, (int)ceilf(std::max(fabsf(dx), fabsf(dy)) / radius));
+    float step_x = dx / steps;
+    float step_y = dy / steps;
+    int blocked = 0;
+    for (int step = 0; step < steps; ++step)
+    {
+        if (open_around(map, (int)floorf(x), (int)floorf(y)))
+        {
+            // Nothing to hit within a block in every direction
+            x += step_x;
+            y += step_y;
+            continue;
+        }
+
+        // Along x, against the rows the body covers, then along y from where that got to
+        if (move_axis(x, step_x, radius, (int)floorf(y - radius), (int)floorf(y + radius),
+                      [&map](int along, int across) { return map.is_wall(along, across); }))
+        {
+            blocked |= BLOCKED_X;
+            step_x = 0.0f;
+        }
+        if (move_axis(y, step_y, radius, (int)floorf(x - radius), (int)floorf(x + radius),
+                      [&map](int along, int across) { return map.is_wall(across, along); }))
+        {
+            blocked |= BLOCKED_Y;
+            step_y = 0.0f;
+        }
+    }
+    return blocked;
+}
+
+void collision_grid_build(CollisionGrid &grid, const float *x, const float *y, const float *radius, int count,
+                          int map_width, int map_height)
+{
+    grid.width = std::max(1, (map_width + COLLISION_GRID_SIZE - 1) >> COLLISION_GRID_SHIFT);
+    grid.height = std::max(1, (map_height + COLLISION_GRID_SIZE - 1) >> COLLISION_GRID_SHIFT);
+    int num_cells = grid.width * grid.height;
+
+    auto cell_of = [&](int i)
+    {
+        int cx = std::min(std::max((int)floorf(x[i]) >> COLLISION_GRID_SHIFT, 0), grid.width - 1);
+        int cy = std::min(std::max((int)floorf(y[i]) >> COLLISION_GRID_SHIFT, 0), grid.height - 1);
+        return cy * grid.width + cx;
+    };
+
+    // Counting sort by cell. 'cell_start[c + 1]' counts cell c's bodies
+    // first, then is summed up into where cell c + 1 starts.
+    grid.cell_start.assign(num_cells + 1, 0);
+    grid.max_radius = 0.0f;
+    for (int i = 0; i < count; ++i)
+    {
+        ++grid.cell_start[cell_of(i) + 1];
+        grid.max_radius = std::max(grid.max_radius, radius[i]);
+    }
+    for (int cell = 0; cell < num_cells; ++cell)
+    {
+        grid.cell_start[cell + 1] += grid.cell_start[cell];
+    }
+    // Counting 'cell_start[c]' up while filling cell c leaves it where cell
+    // c + 1 starts, so they're all moved up one afterwards
+    grid.bodies.resize(count);
+    for (int i = 0; i < count; ++i)
+    {
+        grid.bodies[grid.cell_start[cell_of(i)]++] = i;
+    }
+    for (int cell = num_cells; cell > 0; --cell)
+    {
+        grid.cell_start[cell] = grid.cell_start[cell - 1];
+    }
+    grid.cell_start[0] = 0;
+    grid.cell_start[num_cells] = count;
+}
+
+void bodies_add(Bodies &bodies, float x, float y, float vx, float vy, float radius)
+{
+    bodies.x.push_back(x);
+    bodies.y.push_back(y);
+    bodies.vx.push_back(vx);
+    bodies.vy.push_back(vy);
+    bodies.radius.push_back(radius);
+}
+
+void bodies_step(Bodies &bodies, const Map &map, CollisionGrid &grid, float dt, CollisionStats &stats)
+{
+    int count = (int)bodies.x.size();
+    float *x = bodies.x.data();
+    float *y = bodies.y.data();
+    float *vx = bodies.vx.data();
+    float *vy = bodies.vy.data();
+    const float *radius = bodies.radius.data();
+
+    // Against the walls, bouncing off them
+    for (int i = 0; i < count; ++i)
+    {
+        int blocked = move_and_slide(map, x[i], y[i], vx[i] * dt, vy[i] * dt, radius[i]);
+        if (blocked & BLOCKED_X)
+        {
+            vx[i] = -vx[i];
+        }
+        if (blocked & BLOCKED_Y)
+        {
+            vy[i] = -vy[i];
+        }
+    }
+    stats.moves += count;
+
+    // Against each other. Each pair that overlaps is pushed apart along the
+    // line between them, half the overlap each (and not into a wall).
+    collision_grid_build(grid, x, y, radius, count, map.width, map.height);
+    for (int i = 0; i < count; ++i)
+    {
+        float r = radius[i];
+        collision_grid_query(grid, x[i] - r, y[i] - r, x[i] + r, y[i] + r, [&](int j)
+        {
+            if (j <= i)
+            {
+                return; // Each pair once
+            }
+            ++stats.pair_checks;
+            float dx = x[j] - x[i];
+            float dy = y[j] - y[i];
+            float min_distance = r + radius[j];
+            float distance_squared = dx * dx + dy * dy;
+            if (distance_squared >= min_distance * min_distance)
+            {
+                return;
+            }
+            ++stats.overlaps;
+            float distance = sqrtf(distance_squared);
+            float nx; // Unit vector from body i to body j
+            float ny;
+            if (distance < 1e-6f)
+            {
+                nx = 1.0f; // Right on top of each other, push apart along x
+                ny = 0.0f;
+                distance = 0.0f;
+            }
+            else
+            {
+                nx = dx / distance;
+                ny = dy / distance;
+            }
+            float push = (min_distance - distance) / 2.0f;
+            move_and_slide(map, x[i], y[i], -nx * push, -ny * push, r);
+            move_and_slide(map, x[j], y[j], nx * push, ny * push, radius[j]);
+        });
+    }
+}
@@ -0,0 +1,118 @@
+// physics.h - Moving things around the map without going through walls or
+//             each other. The player and every other moving body is a
+//             circle, handled as the square around it against walls.
+//
+// ---- AGAINST WALLS: ----
+// A move is split up into steps no longer than the body's radius, so it can't
+// jump over a wall, and each step is done one axis at a time: first along x,
+// stopping against a wall in the way, then along y from there. A move into a
+// wall at an angle keeps the part of it along the wall, so bodies slide along
+// walls instead of sticking to them.
+//
+// ---- BROADPHASE: ----
+// The map is split up into blocks (MAP_BLOCK_SIZE x MAP_BLOCK_SIZE tiles) that
+// know how far away the closest wall is (see 'Map::empty_block_radius'). A
+// step starting in a block with no walls in or next to it can't hit one, so
+// out in the open no tiles are looked at at all. Bodies are sorted into a
+// CollisionGrid with cells of the same size, so the bodies one of them can
+// touch are found in the few cells around it instead of among all of them.
+
+#ifndef PHYSICS_H
+#define PHYSICS_H
+
+#include "map.h" // MAP_BLOCK_SHIFT
+#include <vector> // vector
+
+// Radius of the player, in tiles
+#define PLAYER_RADIUS 0.2f
+
+// Gap left between a body and a wall it stopped against
+#define COLLISION_GAP 0.001f
+
+// Width and height of a cell of a CollisionGrid, in tiles (same as the map's blocks)
+#define COLLISION_GRID_SHIFT MAP_BLOCK_SHIFT
+#define COLLISION_GRID_SIZE (1 << COLLISION_GRID_SHIFT)
+
+// What 'move_and_slide' stopped against
+#define BLOCKED_X 1 // A wall along x
+#define BLOCKED_Y 2 // A wall along y
+
+// Moves a body of 'radius' (less than 0.5) at 'x', 'y' by 'dx', 'dy', as far
+// as it can go without going into a wall, sliding along the walls it meets.
+// Returns BLOCKED_ bits for the axes a wall stopped it on.
+int move_and_slide(const Map &map, float &x, float &y, float dx, float dy, float radius);
+
+// True if the square around a body of 'radius' at 'x', 'y' is in a wall
+bool body_in_wall(const Map &map, float x, float y, float radius);
+
+// Bodies sorted into cells by position, see BROADPHASE above
+struct CollisionGrid
+{
+    int width = 0;  // In cells
+    int height = 0;
+    float max_radius = 0.0f; // Of the bodies in the grid
+    // Bodies in cell 'cx', 'cy' are 'bodies[cell_start[i]]' to
+    // 'bodies[cell_start[i + 1] - 1]', with i = cy * width + cx
+    std::vector<int> cell_start;
+    std::vector<int> bodies;
+};
+
+// Sorts 'count' bodies at 'x', 'y' into 'grid', over a map 'map_width' x
+// 'map_height' tiles big (bodies outside of it go in the closest cell).
+// Reuses the memory of the grid from the last call.
+void collision_grid_build(CollisionGrid &grid, const float *x, const float *y, const float *radius, int count,
+                          int map_width, int map_height);
+
+// Calls 'visit(body)' for every body in the grid cells that the square
+// 'x0', 'y0' to 'x1', 'y1' (widened by the largest radius) touches
+template<typename Visit>
+void collision_grid_query(const CollisionGrid &grid, float x0, float y0, float x1, float y1, Visit visit)
+{
+    auto cell = [](float position, float margin, int cells)
+    {
+        int c = (int)(position + margin) >> COLLISION_GRID_SHIFT;
+        return (position + margin < 0.0f) ? 0 : (c < cells ? c : cells - 1);
+    };
+    int cx_begin = cell(x0, -grid.max_radius, grid.width);
+    int cx_end = cell(x1, grid.max_radius, grid.width);
+    int cy_begin = cell(y0, -grid.max_radius, grid.height);
+    int cy_end = cell(y1, grid.max_radius, grid.height);
+    for (int cy = cy_begin; cy <= cy_end; ++cy)
+    {
+        for (int cx = cx_begin; cx <= cx_end; ++cx)
+        {
+            int i = cy * grid.width + cx;
+            for (int b = grid.cell_start[i]; b < grid.cell_start[i + 1]; ++b)
+            {
+                visit(grid.bodies[b]);
+            }
+        }
+    }
+}
+
+// Moving bodies, one entry per body in each array
+struct Bodies
+{
+    std::vector<float> x;  // Position
+    std::vector<float> y;
+    std::vector<float> vx; // Velocity, tiles per second
+    std::vector<float> vy;
+    std::vector<float> radius;
+};
+
+void bodies_add(Bodies &bodies, float x, float y, float vx, float vy, float radius);
+
+// Number of checks done by 'bodies_step'
+struct CollisionStats
+{
+    long moves = 0;        // 'move_and_slide' calls
+    long pair_checks = 0;  // Pairs of bodies checked for overlap
+    long overlaps = 0;     // Pairs of bodies found overlapping
+};
+
+// Moves every body by its velocity for 'dt' seconds, sliding along walls and
+// bouncing off them (a blocked axis turns its velocity around), then pushes
+// bodies that overlap apart. 'grid' is rebuilt for the bodies' new positions.
+void bodies_step(Bodies &bodies, const Map &map, CollisionGrid &grid, float dt, CollisionStats &stats);
+
+#endif
@@ -0,0 +1,81 @@
+#include "presenter.h"
+#include "globals.h" // screen_width, screen_height, STATUS_ROWS
+#include "rendering.h" // OutputBackend
+
+void presenter_resize(Presenter &presenter, int width, int height)
+{
+    fb_reset(presenter.back, width, height, Cell{' ', 0});
+    fb_reset(presenter.front, width, height, Cell{' ', 0});
+    presenter.full_redraw = true;
+    // Runs are at least PRESENT_MERGE_GAP cells apart, so this many fit on a
+    // row. Reserved now so a frame with more changes than any before doesn't
+    // have to allocate.
+    presenter.runs.reserve((size_t)height * ((width + PRESENT_MERGE_GAP) / (PRESENT_MERGE_GAP + 1)));
+}
+
+void resize_screen(Presenter &presenter, OutputBackend &backend, int width, int height)
+{
+    screen_width = width;
+    screen_height = height;
+    presenter_resize(presenter, width, height + STATUS_ROWS);
+    backend.resize(width, height + STATUS_ROWS);
+}
+
+void presenter_invalidate(Presenter &presenter)
+{
+    presenter.full_redraw = true;
+}
+
+void find_changed_runs(const FrameBuffer &back, const FrameBuffer &front, bool full_redraw,
+                       std::vector<PresentRun> &runs)
+{
+    runs.clear();
+    for (int y = 0; y < back.height; ++y)
+    {
+        int x = 0;
+        while (x < back.width)
+        {
+            // Skip over cells that are already on the terminal
+            if (!full_redraw && back.at(x, y) == front.at(x, y))
+            {
+                ++x;
+                continue;
+            }
+
+            // Extend the run until we find PRESENT_MERGE_GAP unchanged cells in a row
+            int run_begin = x;
+            int run_end = x + 1;
+            for (int gap = 0; x < back.width && gap < PRESENT_MERGE_GAP; ++x)
+            {
+                if (full_redraw || back.at(x, y) != front.at(x, y))
+                {
+                    run_end = x + 1;
+                    gap = 0;
+                }
+                else
+                {
+                    ++gap;
+                }
+            }
+            runs.push_back(PresentRun{y, run_begin, run_end});
+            x = run_end;
+        }
+    }
+}
+
+void present(Presenter &presenter, OutputBackend &backend)
+{
+    find_changed_runs(presenter.back, presenter.front, presenter.full_redraw, presenter.runs);
+
+    presenter.cells_printed = 0;
+    for (const PresentRun &run : presenter.runs)
+    {
+        backend.print_run(presenter.back, run.y, run.begin, run.end);
+        presenter.cells_printed += run.end - run.begin;
+    }
+
+    backend.flush();
+
+    presenter.front.cells = presenter.back.cells;
+    presenter.full_redraw = false;
+}
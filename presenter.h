@@ -0,0 +1,59 @@
+// presenter.h - Prints a frame drawn into a FrameBuffer to the terminal.
+//               Keeps a copy of the previously printed frame and only
+//               prints the cells that changed since then.
+
+#ifndef PRESENTER_H
+#define PRESENTER_H
+
+#include "framebuffer.h"
+#include <vector> // vector
+
+class OutputBackend;
+
+// Two runs of changed cells on the same row that are closer than this many
+// unchanged cells are printed as one run (reprinting the unchanged cells
+// in between is cheaper than moving the cursor).
+#define PRESENT_MERGE_GAP 4
+
+// Cells [begin, end) on row 'y' that are printed
+struct PresentRun
+{
+    int y;
+    int begin;
+    int end;
+};
+
+struct Presenter
+{
+    FrameBuffer back;  // Frame being drawn, what should be on the terminal next
+    FrameBuffer front; // Frame that is currently on the terminal
+    bool full_redraw = true; // True if everything must be printed next time,
+                             // 'front' doesn't match what is on the terminal
+    int cells_printed = 0;   // Number of cells printed by last 'present' call
+    std::vector<PresentRun> runs; // Runs printed by last 'present' call, row by row
+};
+
+// Set size of the frame, forces a full redraw on next 'present' call
+void presenter_resize(Presenter &presenter, int width, int height);
+
+// Sets the size of the view ('screen_width', 'screen_height') after the
+// terminal was resized, and resizes the frames of 'presenter' (STATUS_ROWS
+// more rows for the printouts below the view) and 'backend' to match.
+// The rest of what is sized after the view (camera, 'ViewBuffers', the row
+// tables of the shading) follows on the next 'render_view'. Everything
+// keeps its memory, only growing past the biggest size so far allocates.
+void resize_screen(Presenter &presenter, OutputBackend &backend, int width, int height);
+
+// Forces a full redraw on next 'present' call
+void presenter_invalidate(Presenter &presenter);
+
+// Finds the runs of cells in 'back' that differ from 'front' (all cells if
+// 'full_redraw'), row by row, into 'runs'
+void find_changed_runs(const FrameBuffer &back, const FrameBuffer &front, bool full_redraw,
+                       std::vector<PresentRun> &runs);
+
+// Print the cells in 'presenter.back' that differ from 'presenter.front'
+// to the terminal through 'backend', then 'front' is updated to match.
+void present(Presenter &presenter, OutputBackend &backend);
+
+#endif
@@ -0,0 +1,136 @@
+#include "profiler.h"
+#include <algorithm> // sort, max
+#include <cstdio> // FILE, fopen, fprintf, snprintf
+
+static const char *stage_names[NUM_PROFILE_STAGES] =
+{
+    "frame",
+    "input",
+    "raycast",
+    "shade",
+    "sprites",
+    "pack",
+    "map",
+    "present",
+    "record",
+    "idle",
+};
+
+// Milliseconds spent in each stage, for the last PROFILE_HISTORY frames.
+// 'history_pos' is the slot of the current frame.
+static double history[NUM_PROFILE_STAGES][PROFILE_HISTORY];
+static int history_pos = 0;
+static int history_count = 0; // Frames in history so far (up to PROFILE_HISTORY)
+
+static FILE *trace_file = nullptr;
+static bool trace_first_event = true;
+static std::chrono::steady_clock::time_point trace_start;
+
+ScopedTimer::ScopedTimer(ProfileStage stage)
+    : stage(stage), start(std::chrono::steady_clock::now())
+{
+}
+
+ScopedTimer::~ScopedTimer()
+{
+    profiler_record(stage, start, std::chrono::steady_clock::now());
+}
+
+void profiler_begin_frame()
+{
+    history_pos = (history_pos + 1) % PROFILE_HISTORY;
+    history_count = std::min(history_count + 1, PROFILE_HISTORY);
+    for (int stage = 0; stage < NUM_PROFILE_STAGES; ++stage)
+    {
+        history[stage][history_pos] = 0.0;
+    }
+}
+
+void profiler_record(ProfileStage stage, std::chrono::steady_clock::time_point start,
+                     std::chrono::steady_clock::time_point end)
+{
+    // A stage can be recorded more than once per frame, it's the total that counts
+    history[stage][history_pos] += std::chrono::duration<double, std::milli>(end - start).count();
+
+    if (trace_file != nullptr)
+    {
+        // Complete event ("ph":"X"), times in microseconds
+        double ts = std::chrono::duration<double, std::micro>(start - trace_start).count();
+        double dur = std::chrono::duration<double, std::micro>(end - start).count();
+        fprintf(trace_file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+                trace_first_event ? "" : ",", stage_names[stage], ts, dur);
+        trace_first_event = false;
+    }
+}
+
+StageStats profiler_stats(ProfileStage stage)
+{
+    StageStats stats = {};
+    if (history_count == 0)
+    {
+        return stats;
+    }
+
+    // Current frame isn't finished yet, so leave it out
+    double samples[PROFILE_HISTORY];
+    int count = 0;
+    for (int i = 1; i < history_count; ++i)
+    {
+        samples[count++] = history[stage][(history_pos - i + PROFILE_HISTORY) % PROFILE_HISTORY];
+    }
+    if (count == 0)
+    {
+        return stats;
+    }
+
+    stats.last = samples[0];
+    double sum = 0.0;
+    for (int i = 0; i < count; ++i)
+    {
+        sum += samples[i];
+    }
+    stats.average = sum / count;
+
+    std::sort(samples, samples + count);
+    stats.p50 = samples[(count - 1) * 50 / 100];
+    stats.p99 = samples[(count - 1) * 99 / 100];
+    stats.max = samples[count - 1];
+    return stats;
+}
+
+bool profiler_open_trace(const char *path)
+{
+    trace_file = fopen(path, "w");
+    if (trace_file == nullptr)
+    {
+        return false;
+    }
+    fprintf(trace_file, "{\"traceEvents\":[");
+    trace_first_event = true;
+    trace_start = std::chrono::steady_clock::now();
+    return true;
+}
+
+void profiler_close_trace()
+{
+    if (trace_file != nullptr)
+    {
+        fprintf(trace_file, "\n]}\n");
+        fclose(trace_file);
+        trace_file = nullptr;
+    }
+}
+
+void profiler_draw_overlay(FrameBuffer &fb, int x, int y)
+{
+    char line[128];
+    snprintf(line, sizeof(line), " %-8s %7s %7s %7s %7s ", "ms", "last", "avg", "p50", "p99");
+    fb_print(fb, x, y, line, 0);
+    for (int stage = 0; stage < NUM_PROFILE_STAGES; ++stage)
+    {
+        StageStats stats = profiler_stats((ProfileStage)stage);
+        snprintf(line, sizeof(line), " %-8s %7.3f %7.3f %7.3f %7.3f ",
+                 stage_names[stage], stats.last, stats.average, stats.p50, stats.p99);
+        fb_print(fb, x, y + 1 + stage, line, 0);
+    }
+}
@@ -0,0 +1,75 @@
+// profiler.h - Measures how long each stage of a frame takes. Keeps the
+//              timings of the last PROFILE_HISTORY frames to show in an
+//              overlay, and can write every timing to a trace file that can
+//              be opened in chrome://tracing (or https://ui.perfetto.dev).
+//
+//              Only to be used from the main thread.
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "framebuffer.h"
+#include <chrono>
+
+// Number of frames the overlay statistics are calculated over
+#define PROFILE_HISTORY 128
+
+// Width in characters of the table drawn by 'profiler_draw_overlay'
+#define PROFILER_OVERLAY_WIDTH 42
+
+enum ProfileStage
+{
+    STAGE_FRAME,   // Whole frame, from one frame start to the next
+    STAGE_INPUT,   // Reading and handling key presses, and simulation ticks
+    STAGE_RAYCAST, // Raycasting all the screen columns
+    STAGE_SHADE,   // Drawing walls, ceiling and floor into the frame buffer
+    STAGE_SPRITES, // Finding the sprites in view and drawing them
+    STAGE_PACK,    // Packing sub-cell pixels into block characters
+    STAGE_MAP,     // Drawing the map overlay
+    STAGE_PRESENT, // Printing the frame to the terminal
+    STAGE_RECORD,  // Writing the frame to the recording (--record)
+    STAGE_IDLE,    // Sleeping until the next frame is due (frame cap)
+    NUM_PROFILE_STAGES
+};
+
+// Statistics for one stage over the last PROFILE_HISTORY frames, in milliseconds
+struct StageStats
+{
+    double last;
+    double average;
+    double p50;
+    double p99;
+    double max;
+};
+
+// Measures time from construction to destruction and adds it to 'stage'
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(ProfileStage stage);
+    ~ScopedTimer();
+
+private:
+    ProfileStage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Starts a new frame in the history, call first thing every frame
+void profiler_begin_frame();
+
+// Adds the time between 'start' and 'end' to 'stage' for the current frame
+void profiler_record(ProfileStage stage, std::chrono::steady_clock::time_point start,
+                     std::chrono::steady_clock::time_point end);
+
+StageStats profiler_stats(ProfileStage stage);
+
+// Start writing every recorded timing to a Chrome trace event file.
+// Returns false if file couldn't be opened.
+bool profiler_open_trace(const char *path);
+// Finish and close trace file (if any)
+void profiler_close_trace();
+
+// Draw a table of the stage statistics into 'fb' with its top left corner at 'x', 'y'
+void profiler_draw_overlay(FrameBuffer &fb, int x, int y);
+
+#endif
@@ -0,0 +1,293 @@
+#include "raycast.h"
+#include "globals.h"
+#include "map.h"
+#include "raycast_packet.h"
+#include <cmath> // fabsf, floorf
+#include <cstdint> // INT32_MAX
+#include <cstring> // strcmp
+
+// Number of borders, spaced '1 / rayComponent' apart with the first one at
+// 'sideDist', that the ray crosses before 'limit' (at most 'max_count').
+// Errs on the low side, crossing one border too few only costs an extra
+// step, but one too many could step past a wall.
+static int crossings_before(float limit, float sideDist, float rayComponent, int max_count)
+{
+    if (sideDist >= limit)
+    {
+        return 0;
+    }
+    int count = (int)((limit - sideDist) * rayComponent);
+    return count < max_count ? count : max_count;
+}
+
+// Walks the map grid along the ray, visiting each tile the ray passes
+// through exactly once, until a wall tile is hit.
+//
+// ---- HOW IT WORKS: ----
+// The ray crosses vertical tile borders (x = whole number) at regular
+// intervals of 'deltaDistX' along the ray, and horizontal tile borders
+// (y = whole number) at regular intervals of 'deltaDistY'.
+// 'sideDistX' and 'sideDistY' holds the distance along the ray to the next
+// vertical and horizontal border respectively. Each step we cross whichever
+// border is closest, which moves us into the next tile along the ray.
+//
+// ---- SKIPPING EMPTY SPACE: ----
+// The map knows, for every block of tiles, the distance to the closest block
+// with a wall in it ('Map::empty_block_radius'). When the block we are in is
+// surrounded by empty blocks, the ray can't hit anything until it leaves
+// that square of empty blocks, so all the border crossings inside the square
+// are done in one go.
+RayHit cast_ray(const Map &map, float originX, float originY, float rayX, float rayY,
+                bool skip_empty_space)
+{
+    RayHit result;
+
+    // Tile we are currently in
+    int mapX = (int)originX;
+    int mapY = (int)originY;
+
+    // Distance along ray between two vertical/horizontal tile borders.
+    // (A ray parallel to an axis never crosses the borders of that axis)
+    float deltaDistX = (rayX == 0.0f) ? 1e30f : fabsf(1.0f / rayX);
+    float deltaDistY = (rayY == 0.0f) ? 1e30f : fabsf(1.0f / rayY);
+
+    // Which direction (+1 or -1) we step in the map along each axis,
+    // and distance along ray from origin to first vertical/horizontal border
+    int stepX, stepY;
+    float sideDistX, sideDistY;
+    if (rayX < 0)
+    {
+        stepX = -1;
+        sideDistX = (originX - mapX) * deltaDistX;
+    }
+    else
+    {
+        stepX = 1;
+        sideDistX = (mapX + 1.0f - originX) * deltaDistX;
+    }
+    if (rayY < 0)
+    {
+        stepY = -1;
+        sideDistY = (originY - mapY) * deltaDistY;
+    }
+    else
+    {
+        stepY = 1;
+        sideDistY = (mapY + 1.0f - originY) * deltaDistY;
+    }
+
+    while (true)
+    {
+        if (skip_empty_space)
+        {
+            int blockX = mapX >> MAP_BLOCK_SHIFT;
+            int blockY = mapY >> MAP_BLOCK_SHIFT;
+            int blockRadius = map.empty_block_radius(blockX, blockY) - 1;
+            if (blockRadius >= 0)
+            {
+                // Number of empty tiles ahead of us, in the direction the
+                // ray is going, before the edge of the square of empty blocks
+                int radiusX = (stepX > 0) ? ((blockX + blockRadius + 1) << MAP_BLOCK_SHIFT) - 1 - mapX
+                                          : mapX - ((blockX - blockRadius) << MAP_BLOCK_SHIFT);
+                int radiusY = (stepY > 0) ? ((blockY + blockRadius + 1) << MAP_BLOCK_SHIFT) - 1 - mapY
+                                          : mapY - ((blockY - blockRadius) << MAP_BLOCK_SHIFT);
+
+                // Distance to where ray leaves the square of empty tiles,
+                // through its left/right and top/bottom side respectively
+                float exitX = sideDistX + radiusX * deltaDistX;
+                float exitY = sideDistY + radiusY * deltaDistY;
+
+                // Cross all borders of the axis ray leaves through, and the
+                // borders of the other axis that come before that.
+                int stepsX, stepsY;
+                if (exitX < exitY)
+                {
+                    stepsX = radiusX;
+                    stepsY = crossings_before(exitX, sideDistY, fabsf(rayY), radiusY);
+                }
+                else
+                {
+                    stepsY = radiusY;
+                    stepsX = crossings_before(exitY, sideDistX, fabsf(rayX), radiusX);
+                }
+                mapX += stepsX * stepX;
+                mapY += stepsY * stepY;
+                sideDistX += stepsX * deltaDistX;
+                sideDistY += stepsY * deltaDistY;
+            }
+        }
+
+        // Distance to the border we are about to cross (= where we enter next tile)
+        float distance;
+        bool crossedVertical; // True if we crossed a vertical border (stepped in x)
+        if (sideDistX < sideDistY)
+        {
+            distance = sideDistX;
+            sideDistX += deltaDistX;
+            mapX += stepX;
+            crossedVertical = true;
+        }
+        else
+        {
+            distance = sideDistY;
+            sideDistY += deltaDistY;
+            mapY += stepY;
+            crossedVertical = false;
+        }
+
+        // Test if ray went past what we can see or out of bounds
+        if (distance >= MAX_RAY_DEPTH ||
+            mapX < 0 || mapX >= map.width ||
+            mapY < 0 || mapY >= map.height)
+        {
+            fill_ray_hit(result, map, originX, originY, rayX, rayY, false, distance, mapX, mapY, crossedVertical);
+            return result;
+        }
+
+        if (map.at(mapX, mapY) != CELL_EMPTY)
+        {
+            fill_ray_hit(result, map, originX, originY, rayX, rayY, true, distance, mapX, mapY, crossedVertical);
+            return result;
+        }
+    }
+}
+
+void fill_ray_hit(RayHit &hit, const Map &map, float originX, float originY, float rayX, float rayY,
+                  bool wall, float distance, int mapX, int mapY, bool crossedVertical)
+{
+    if (!wall)
+    {
+        hit.hit = false;
+        hit.distance = MAX_RAY_DEPTH;
+        hit.mapX = (int)originX;
+        hit.mapY = (int)originY;
+        hit.cell = CELL_EMPTY;
+        hit.face = FACE_NONE;
+        hit.texX = 0.0f;
+        return;
+    }
+
+    // Distance to the border crossed into the wall tile, the side of it facing the origin
+    if (crossedVertical)
+    {
+        distance = (mapX + (rayX >= 0 ? 0.0f : 1.0f) - originX) / rayX;
+    }
+    else
+    {
+        distance = (mapY + (rayY >= 0 ? 0.0f : 1.0f) - originY) / rayY;
+    }
+
+    hit.hit = true;
+    hit.distance = distance;
+    hit.mapX = mapX;
+    hit.mapY = mapY;
+    hit.cell = map.at(mapX, mapY);
+
+    // Texture coordinate is the fraction of the hit point along the
+    // border we crossed, flipped where needed so it always goes
+    // left to right as seen by someone facing that wall face.
+    if (crossedVertical)
+    {
+        float hitY = originY + distance * rayY;
+        float fraction = hitY - floorf(hitY);
+        hit.face = (rayX >= 0) ? FACE_WEST : FACE_EAST;
+        hit.texX = (rayX >= 0) ? 1.0f - fraction : fraction;
+    }
+    else
+    {
+        float hitX = originX + distance * rayX;
+        float fraction = hitX - floorf(hitX);
+        hit.face = (rayY >= 0) ? FACE_NORTH : FACE_SOUTH;
+        hit.texX = (rayY >= 0) ? fraction : 1.0f - fraction;
+    }
+}
+
+static const char *raycaster_names[NUM_RAYCASTERS] = {"auto", "skip", "scalar", "sse", "avx2"};
+
+const char *raycaster_name(Raycaster raycaster)
+{
+    return raycaster_names[raycaster];
+}
+
+bool parse_raycaster(const char *name, Raycaster &raycaster)
+{
+    for (int i = 0; i < NUM_RAYCASTERS; ++i)
+    {
+        if (strcmp(name, raycaster_names[i]) == 0)
+        {
+            raycaster = (Raycaster)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool raycaster_supported(Raycaster raycaster)
+{
+#if RAYCAST_PACKETS
+    if (raycaster == RAYCASTER_SSE)
+    {
+        return __builtin_cpu_supports("sse4.1");
+    }
+    if (raycaster == RAYCASTER_AVX2)
+    {
+        return __builtin_cpu_supports("avx2");
+    }
+#else
+    if (raycaster == RAYCASTER_SSE || raycaster == RAYCASTER_AVX2)
+    {
+        return false;
+    }
+#endif
+    return true;
+}
+
+Raycaster select_raycaster(const Map &map, Raycaster raycaster)
+{
+    // Packets index cells with 32-bit ints
+    bool packets_fit = (size_t)map.width * map.height <= INT32_MAX;
+
+    if (raycaster == RAYCASTER_AUTO)
+    {
+        // 8 wide packets beat skipping empty space until rays get very long,
+        // 4 wide ones only on tiny maps, so those are left to skipping.
+        bool small_map = map.width <= PACKET_MAX_MAP_SIZE && map.height <= PACKET_MAX_MAP_SIZE;
+        return (small_map && packets_fit && raycaster_supported(RAYCASTER_AVX2)) ? RAYCASTER_AVX2 : RAYCASTER_SKIP;
+    }
+    if ((raycaster == RAYCASTER_SSE || raycaster == RAYCASTER_AVX2) &&
+        (!raycaster_supported(raycaster) || !packets_fit))
+    {
+        return RAYCASTER_SCALAR;
+    }
+    return raycaster;
+}
+
+void cast_rays(const Map &map, float originX, float originY, const float *rayX, const float *rayY,
+               int count, Raycaster raycaster, RayHit *hits)
+{
+    raycaster = select_raycaster(map, raycaster);
+
+    // Whole packets, the rest is done one ray at a time
+    int i = 0;
+#if RAYCAST_PACKETS
+    if (raycaster == RAYCASTER_AVX2)
+    {
+        for (; i + AVX2_PACKET_SIZE <= count; i += AVX2_PACKET_SIZE)
+        {
+            cast_ray_packet_avx2(map, originX, originY, rayX + i, rayY + i, hits + i);
+        }
+    }
+    else if (raycaster == RAYCASTER_SSE)
+    {
+        for (; i + SSE_PACKET_SIZE <= count; i += SSE_PACKET_SIZE)
+        {
+            cast_ray_packet_sse(map, originX, originY, rayX + i, rayY + i, hits + i);
+        }
+    }
+#endif
+    bool skip_empty_space = (raycaster == RAYCASTER_SKIP);
+    for (; i < count; ++i)
+    {
+        hits[i] = cast_ray(map, originX, originY, rayX[i], rayY[i], skip_empty_space);
+    }
+}
@@ -0,0 +1,221 @@
+#include "raycast_packet.h"
+#include "globals.h"
+#include "map.h"
+#include "raycast.h"
+
+#if RAYCAST_PACKETS
+
+#include <immintrin.h> // SSE4.1 and AVX2 intrinsics
+#include <cstdint> // uint8_t
+
+// Walks the map grid along 4 rays at once, see 'cast_ray' in raycast.cpp for
+// how the walk works. Every lane steps each loop, lanes that are done keep
+// stepping (their results are already saved) until all of them are done.
+__attribute__((target("sse4.1")))
+void cast_ray_packet_sse(const Map &map, float originX, float originY,
+                         const float *rayX, const float *rayY, RayHit *hits)
+{
+    const uint8_t *cells = map.data();
+    int startX = (int)originX;
+    int startY = (int)originY;
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 allOnes = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    const __m128 rayXs = _mm_loadu_ps(rayX);
+    const __m128 rayYs = _mm_loadu_ps(rayY);
+
+    // Distance along ray between two vertical/horizontal tile borders
+    // (fabsf clears the sign bit, axis parallel rays never cross)
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    const __m128 never = _mm_set1_ps(1e30f);
+    const __m128 deltaX = _mm_blendv_ps(_mm_andnot_ps(signBit, _mm_div_ps(one, rayXs)), never, _mm_cmpeq_ps(rayXs, zero));
+    const __m128 deltaY = _mm_blendv_ps(_mm_andnot_ps(signBit, _mm_div_ps(one, rayYs)), never, _mm_cmpeq_ps(rayYs, zero));
+
+    // Step direction (-1 where ray goes negative, +1 otherwise)
+    // and distance to first border
+    const __m128 negativeX = _mm_cmplt_ps(rayXs, zero);
+    const __m128 negativeY = _mm_cmplt_ps(rayYs, zero);
+    const __m128i stepX = _mm_or_si128(_mm_castps_si128(negativeX), _mm_set1_epi32(1));
+    const __m128i stepY = _mm_or_si128(_mm_castps_si128(negativeY), _mm_set1_epi32(1));
+    const __m128 originXs = _mm_set1_ps(originX);
+    const __m128 originYs = _mm_set1_ps(originY);
+    const __m128 startXs = _mm_set1_ps((float)startX);
+    const __m128 startYs = _mm_set1_ps((float)startY);
+    __m128 sideX = _mm_blendv_ps(_mm_mul_ps(_mm_sub_ps(_mm_add_ps(startXs, one), originXs), deltaX),
+                                 _mm_mul_ps(_mm_sub_ps(originXs, startXs), deltaX), negativeX);
+    __m128 sideY = _mm_blendv_ps(_mm_mul_ps(_mm_sub_ps(_mm_add_ps(startYs, one), originYs), deltaY),
+                                 _mm_mul_ps(_mm_sub_ps(originYs, startYs), deltaY), negativeY);
+
+    const __m128 maxDepth = _mm_set1_ps((float)MAX_RAY_DEPTH);
+    const __m128i zeroInt = _mm_setzero_si128();
+    const __m128i widths = _mm_set1_epi32(map.width);
+    const __m128i lastX = _mm_set1_epi32(map.width - 1);
+    const __m128i lastY = _mm_set1_epi32(map.height - 1);
+
+    __m128i mapX = _mm_set1_epi32(startX);
+    __m128i mapY = _mm_set1_epi32(startY);
+    __m128 active = allOnes;
+
+    // Saved when each lane is done
+    __m128 endDistance = zero;
+    __m128i endMapX = mapX;
+    __m128i endMapY = mapY;
+    __m128 endVertical = zero;
+    __m128 endWall = zero;
+
+    while (true)
+    {
+        // Cross whichever border is closest
+        __m128 crossedVertical = _mm_cmplt_ps(sideX, sideY);
+        __m128 distance = _mm_blendv_ps(sideY, sideX, crossedVertical);
+        sideX = _mm_blendv_ps(sideX, _mm_add_ps(sideX, deltaX), crossedVertical);
+        sideY = _mm_blendv_ps(_mm_add_ps(sideY, deltaY), sideY, crossedVertical);
+        mapX = _mm_add_epi32(mapX, _mm_and_si128(stepX, _mm_castps_si128(crossedVertical)));
+        mapY = _mm_add_epi32(mapY, _mm_andnot_si128(_mm_castps_si128(crossedVertical), stepY));
+
+        // Went past what we can see or out of bounds
+        __m128i outside = _mm_or_si128(_mm_or_si128(_mm_cmplt_epi32(mapX, zeroInt), _mm_cmpgt_epi32(mapX, lastX)),
+                                       _mm_or_si128(_mm_cmplt_epi32(mapY, zeroInt), _mm_cmpgt_epi32(mapY, lastY)));
+        __m128 leave = _mm_or_ps(_mm_cmpge_ps(distance, maxDepth), _mm_castsi128_ps(outside));
+
+        // Look up the tiles (lanes that left look at tile 0 instead)
+        __m128i index = _mm_andnot_si128(_mm_castps_si128(leave),
+                                         _mm_add_epi32(_mm_mullo_epi32(mapY, widths), mapX));
+        __m128i cell = _mm_setr_epi32(cells[_mm_cvtsi128_si32(index)], cells[_mm_extract_epi32(index, 1)],
+                                      cells[_mm_extract_epi32(index, 2)], cells[_mm_extract_epi32(index, 3)]);
+        __m128 empty = _mm_castsi128_ps(_mm_cmpeq_epi32(cell, zeroInt));
+        __m128 wall = _mm_andnot_ps(_mm_or_ps(leave, empty), allOnes);
+
+        __m128 done = _mm_and_ps(active, _mm_or_ps(leave, wall));
+        endDistance = _mm_blendv_ps(endDistance, distance, done);
+        endMapX = _mm_blendv_epi8(endMapX, mapX, _mm_castps_si128(done));
+        endMapY = _mm_blendv_epi8(endMapY, mapY, _mm_castps_si128(done));
+        endVertical = _mm_blendv_ps(endVertical, crossedVertical, done);
+        endWall = _mm_blendv_ps(endWall, wall, done);
+        active = _mm_andnot_ps(done, active);
+        if (_mm_movemask_ps(active) == 0)
+        {
+            break;
+        }
+    }
+
+    alignas(16) float distances[SSE_PACKET_SIZE];
+    alignas(16) int mapXs[SSE_PACKET_SIZE];
+    alignas(16) int mapYs[SSE_PACKET_SIZE];
+    _mm_store_ps(distances, endDistance);
+    _mm_store_si128((__m128i *)mapXs, endMapX);
+    _mm_store_si128((__m128i *)mapYs, endMapY);
+    int vertical = _mm_movemask_ps(endVertical);
+    int wall = _mm_movemask_ps(endWall);
+    for (int i = 0; i < SSE_PACKET_SIZE; ++i)
+    {
+        fill_ray_hit(hits[i], map, originX, originY, rayX[i], rayY[i], (wall >> i) & 1,
+                     distances[i], mapXs[i], mapYs[i], (vertical >> i) & 1);
+    }
+}
+
+// Same as 'cast_ray_packet_sse' but 8 rays wide, and with the tiles fetched
+// by one gather instruction. The gather loads 4 bytes, so each tile is fetched
+// as the top byte of the 4 bytes ending at it (the map has MAP_CELL_PADDING
+// readable bytes before its first cell for this).
+static_assert(MAP_CELL_PADDING >= 3, "Gather needs 3 readable bytes before the first cell");
+
+__attribute__((target("avx2")))
+void cast_ray_packet_avx2(const Map &map, float originX, float originY,
+                          const float *rayX, const float *rayY, RayHit *hits)
+{
+    const int *cellWords = (const int *)(map.data() - 3);
+    int startX = (int)originX;
+    int startY = (int)originY;
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 allOnes = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    const __m256 rayXs = _mm256_loadu_ps(rayX);
+    const __m256 rayYs = _mm256_loadu_ps(rayY);
+
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+    const __m256 never = _mm256_set1_ps(1e30f);
+    const __m256 deltaX = _mm256_blendv_ps(_mm256_andnot_ps(signBit, _mm256_div_ps(one, rayXs)), never,
+                                           _mm256_cmp_ps(rayXs, zero, _CMP_EQ_OQ));
+    const __m256 deltaY = _mm256_blendv_ps(_mm256_andnot_ps(signBit, _mm256_div_ps(one, rayYs)), never,
+                                           _mm256_cmp_ps(rayYs, zero, _CMP_EQ_OQ));
+
+    const __m256 negativeX = _mm256_cmp_ps(rayXs, zero, _CMP_LT_OQ);
+    const __m256 negativeY = _mm256_cmp_ps(rayYs, zero, _CMP_LT_OQ);
+    const __m256i stepX = _mm256_or_si256(_mm256_castps_si256(negativeX), _mm256_set1_epi32(1));
+    const __m256i stepY = _mm256_or_si256(_mm256_castps_si256(negativeY), _mm256_set1_epi32(1));
+    const __m256 originXs = _mm256_set1_ps(originX);
+    const __m256 originYs = _mm256_set1_ps(originY);
+    const __m256 startXs = _mm256_set1_ps((float)startX);
+    const __m256 startYs = _mm256_set1_ps((float)startY);
+    __m256 sideX = _mm256_blendv_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(startXs, one), originXs), deltaX),
+                                    _mm256_mul_ps(_mm256_sub_ps(originXs, startXs), deltaX), negativeX);
+    __m256 sideY = _mm256_blendv_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(startYs, one), originYs), deltaY),
+                                    _mm256_mul_ps(_mm256_sub_ps(originYs, startYs), deltaY), negativeY);
+
+    const __m256 maxDepth = _mm256_set1_ps((float)MAX_RAY_DEPTH);
+    const __m256i zeroInt = _mm256_setzero_si256();
+    const __m256i widths = _mm256_set1_epi32(map.width);
+    const __m256i lastX = _mm256_set1_epi32(map.width - 1);
+    const __m256i lastY = _mm256_set1_epi32(map.height - 1);
+
+    __m256i mapX = _mm256_set1_epi32(startX);
+    __m256i mapY = _mm256_set1_epi32(startY);
+    __m256 active = allOnes;
+
+    __m256 endDistance = zero;
+    __m256i endMapX = mapX;
+    __m256i endMapY = mapY;
+    __m256 endVertical = zero;
+    __m256 endWall = zero;
+
+    while (true)
+    {
+        __m256 crossedVertical = _mm256_cmp_ps(sideX, sideY, _CMP_LT_OQ);
+        __m256 distance = _mm256_blendv_ps(sideY, sideX, crossedVertical);
+        sideX = _mm256_blendv_ps(sideX, _mm256_add_ps(sideX, deltaX), crossedVertical);
+        sideY = _mm256_blendv_ps(_mm256_add_ps(sideY, deltaY), sideY, crossedVertical);
+        mapX = _mm256_add_epi32(mapX, _mm256_and_si256(stepX, _mm256_castps_si256(crossedVertical)));
+        mapY = _mm256_add_epi32(mapY, _mm256_andnot_si256(_mm256_castps_si256(crossedVertical), stepY));
+
+        __m256i outside = _mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi32(zeroInt, mapX), _mm256_cmpgt_epi32(mapX, lastX)),
+                                          _mm256_or_si256(_mm256_cmpgt_epi32(zeroInt, mapY), _mm256_cmpgt_epi32(mapY, lastY)));
+        __m256 leave = _mm256_or_ps(_mm256_cmp_ps(distance, maxDepth, _CMP_GE_OQ), _mm256_castsi256_ps(outside));
+
+        __m256i index = _mm256_andnot_si256(_mm256_castps_si256(leave),
+                                            _mm256_add_epi32(_mm256_mullo_epi32(mapY, widths), mapX));
+        __m256i cell = _mm256_srli_epi32(_mm256_i32gather_epi32(cellWords, index, 1), 24);
+        __m256 empty = _mm256_castsi256_ps(_mm256_cmpeq_epi32(cell, zeroInt));
+        __m256 wall = _mm256_andnot_ps(_mm256_or_ps(leave, empty), allOnes);
+
+        __m256 done = _mm256_and_ps(active, _mm256_or_ps(leave, wall));
+        endDistance = _mm256_blendv_ps(endDistance, distance, done);
+        endMapX = _mm256_blendv_epi8(endMapX, mapX, _mm256_castps_si256(done));
+        endMapY = _mm256_blendv_epi8(endMapY, mapY, _mm256_castps_si256(done));
+        endVertical = _mm256_blendv_ps(endVertical, crossedVertical, done);
+        endWall = _mm256_blendv_ps(endWall, wall, done);
+        active = _mm256_andnot_ps(done, active);
+        if (_mm256_movemask_ps(active) == 0)
+        {
+            break;
+        }
+    }
+
+    alignas(32) float distances[AVX2_PACKET_SIZE];
+    alignas(32) int mapXs[AVX2_PACKET_SIZE];
+    alignas(32) int mapYs[AVX2_PACKET_SIZE];
+    _mm256_store_ps(distances, endDistance);
+    _mm256_store_si256((__m256i *)mapXs, endMapX);
+    _mm256_store_si256((__m256i *)mapYs, endMapY);
+    int vertical = _mm256_movemask_ps(endVertical);
+    int wall = _mm256_movemask_ps(endWall);
+    for (int i = 0; i < AVX2_PACKET_SIZE; ++i)
+    {
+        fill_ray_hit(hits[i], map, originX, originY, rayX[i], rayY[i], (wall >> i) & 1,
+                     distances[i], mapXs[i], mapYs[i], (vertical >> i) & 1);
+    }
+}
+
+#endif
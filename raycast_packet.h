@@ -0,0 +1,58 @@
+// raycast_packet.h - Packet raycasters, casting 4 (SSE4.1) or 8 (AVX2) rays
+//                    from the same origin at once, one ray per SIMD lane.
+//                    Only built for x86, picked at runtime by 'cast_rays'
+//                    (raycast.h) depending on what the CPU supports.
+//
+// Every lane does exactly the same float operations, in the same order, as
+// 'cast_ray' does when not skipping empty space, so the results are bit for
+// bit the same as RAYCASTER_SCALAR. The functions are compiled for their
+// instruction set with target attributes, the rest of the program isn't,
+// so it still runs on any x86-64 CPU.
+
+#ifndef RAYCAST_PACKET_H
+#define RAYCAST_PACKET_H
+
+struct RayHit;
+class Map;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RAYCAST_PACKETS 1
+#else
+#define RAYCAST_PACKETS 0
+#endif
+
+#define SSE_PACKET_SIZE 4
+#define AVX2_PACKET_SIZE 8
+
+// Maps wider or higher than this are raycast with RAYCASTER_SKIP when asked
+// for RAYCASTER_AUTO, rays get long enough for skipping to catch up with
+// the AVX2 packets (about even on a 2048x2048 map).
+#define PACKET_MAX_MAP_SIZE 1024
+
+// Fills in 'hit' for a ray that ended at 'distance' in tile 'mapX', 'mapY',
+// hitting a wall if 'wall' is true. Shared by all raycasters so they fill in
+// everything (face, texture coordinate) the same way. The distance to a wall
+// is worked out again from the border the ray crossed into it, instead of
+// taken from how far the raycaster added up to, so it comes out the same bit
+// for bit however the wall was found (see REUSING COLUMNS in view.h).
+// PARAMETERS:
+// map [in]              = The map the ray was cast in
+// originX, originY [in] = Position ray started from
+// rayX, rayY [in]       = Direction of the ray
+// crossedVertical [in]  = True if the last border crossed was a vertical one (x = whole number)
+void fill_ray_hit(RayHit &hit, const Map &map, float originX, float originY, float rayX, float rayY,
+                  bool wall, float distance, int mapX, int mapY, bool crossedVertical);
+
+#if RAYCAST_PACKETS
+// Casts SSE_PACKET_SIZE rays, directions in 'rayX[0..3]' and 'rayY[0..3]'.
+// CPU must support SSE4.1.
+void cast_ray_packet_sse(const Map &map, float originX, float originY,
+                         const float *rayX, const float *rayY, RayHit *hits);
+
+// Casts AVX2_PACKET_SIZE rays, directions in 'rayX[0..7]' and 'rayY[0..7]'.
+// CPU must support AVX2.
+void cast_ray_packet_avx2(const Map &map, float originX, float originY,
+                          const float *rayX, const float *rayY, RayHit *hits);
+#endif
+
+#endif
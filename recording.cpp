@@ -0,0 +1,587 @@
+#include "recording.h"
+#include "globals.h"
+#include "map.h"
+#include "session.h"
+#include <algorithm> // fill
+#include <cstring> // memcpy, memcmp
+#if defined(__SSE2__)
+#include <emmintrin.h> // SSE2
+#endif
+
+// Buffered records are written to the file once there are this many bytes
+#define RECORDER_FLUSH_SIZE 65536
+
+static void put_uint32(unsigned char *bytes, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        bytes[i] = (unsigned char)(value >> (i * 8));
+    }
+}
+
+static uint32_t get_uint32(const unsigned char *bytes)
+{
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static uint32_t float_bits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bits_float(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline void put_varint(std::vector<unsigned char> &out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((unsigned char)value);
+}
+
+// Signed time difference, zigzag encoded
+static void put_time(std::vector<unsigned char> &out, int64_t &last_time, int64_t time)
+{
+    int64_t difference = time - last_time;
+    put_varint(out, ((uint64_t)difference << 1) ^ (uint64_t)(difference >> 63));
+    last_time = time;
+}
+
+void recording_header_set(RecordingHeader &header, const Map &map, const Session &session)
+{
+    header.screen_width = screen_width;
+    header.screen_height = screen_height;
+    header.map_width = map.width;
+    header.map_height = map.height;
+    header.map_hash = map_hash(map);
+    header.start_x = session.sim.current.x;
+    header.start_y = session.sim.current.y;
+    header.start_angle = session.sim.current.angle;
+    header.toggles = (session.colored_output ? TOGGLE_COLORED : 0) |
+                     (session.textured ? TOGGLE_TEXTURED : 0) |
+                     (session.display_map ? TOGGLE_MAP : 0) |
+                     (session.display_profiler ? TOGGLE_PROFILER : 0) |
+                     (session.subcells_supported ? TOGGLE_SUBCELLS_SUPPORTED : 0) |
+                     ((uint32_t)session.subcells << TOGGLE_SUBCELLS_SHIFT);
+}
+
+void recording_header_apply(const RecordingHeader &header, Session &session)
+{
+    session.colored_output = (header.toggles & TOGGLE_COLORED) != 0;
+    session.textured = (header.toggles & TOGGLE_TEXTURED) != 0;
+    session.display_map = (header.toggles & TOGGLE_MAP) != 0;
+    session.display_profiler = (header.toggles & TOGGLE_PROFILER) != 0;
+    session.subcells_supported = (header.toggles & TOGGLE_SUBCELLS_SUPPORTED) != 0;
+    session.subcells = (SubcellMode)((header.toggles >> TOGGLE_SUBCELLS_SHIFT) % NUM_SUBCELL_MODES);
+}
+
+uint32_t map_hash(const Map &map)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    size_t cell_count = (size_t)map.width * map.height;
+    const uint8_t *cells = map.data();
+    for (size_t i = 0; i < cell_count; ++i)
+    {
+        hash ^= cells[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Frames are written straight into memory made room for up front, that is
+// a lot faster than appending to a vector a byte at a time.
+static inline unsigned char *write_varint(unsigned char *out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char)value;
+    return out;
+}
+
+// Writes a run of 'length' cells of 'kind' (its cells not included)
+static inline unsigned char *write_run(unsigned char *out, int kind, size_t length)
+{
+    return write_varint(out, (uint64_t)length << 2 | kind);
+}
+
+static inline unsigned char *write_cells(unsigned char *out, const Cell *cells, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        out[0] = (unsigned char)cells[i].glyph;
+        out[1] = (unsigned char)(cells[i].color_pair & 0xff);
+        out[2] = (unsigned char)((unsigned short)cells[i].color_pair >> 8);
+        out += 3;
+    }
+    return out;
+}
+
+// End of the run of cells from 'begin' on that are all the same as 'cells[begin]'
+static inline size_t repeat_run_end(const Cell *cells, size_t begin, size_t end)
+{
+    size_t i = begin + 1;
+    if (i >= end || cells[i] != cells[begin])
+    {
+        return i; // Most cells in a literal run, checked before setting up anything
+    }
+#if defined(__SSE2__)
+    // 4 cells at a time, compared as 32-bit lanes without the padding byte
+    static_assert(sizeof(Cell) == 4, "Cell layout doesn't match what repeat_run_end compares");
+    uint32_t first;
+    memcpy(&first, &cells[begin], sizeof(first));
+    const __m128i mask = _mm_set1_epi32((int)0xffff00ff);
+    const __m128i repeated = _mm_set1_epi32((int)(first & 0xffff00ff));
+    while (i + 4 <= end)
+    {
+        __m128i four = _mm_and_si128(_mm_loadu_si128((const __m128i *)(cells + i)), mask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(four, repeated)) != 0xffff)
+        {
+            break;
+        }
+        i += 4;
+    }
+#endif
+    while (i < end && cells[i] == cells[begin])
+    {
+        ++i;
+    }
+    return i;
+}
+
+// Writes cells [begin, end) of 'cells', the same cell three or more times in
+// a row (rows of ceiling and floor) as RUN_REPEAT, the rest as RUN_LITERAL.
+// Takes at most 4 bytes per cell (a run header is no longer than its run).
+static unsigned char *write_changed_cells(unsigned char *out, const Cell *cells, size_t begin, size_t end)
+{
+    size_t literal_begin = begin;
+    size_t i = begin;
+    while (i < end)
+    {
+        size_t repeat_end = repeat_run_end(cells, i, end);
+        if (repeat_end - i < 3)
+        {
+            i = repeat_end;
+            continue;
+        }
+
+        if (literal_begin < i)
+        {
+            out = write_run(out, RUN_LITERAL, i - literal_begin);
+            out = write_cells(out, cells + literal_begin, i - literal_begin);
+        }
+        out = write_run(out, RUN_REPEAT, repeat_end - i);
+        out = write_cells(out, cells + i, 1);
+        i = repeat_end;
+        literal_begin = i;
+    }
+    if (literal_begin < end)
+    {
+        out = write_run(out, RUN_LITERAL, end - literal_begin);
+        out = write_cells(out, cells + literal_begin, end - literal_begin);
+    }
+    return out;
+}
+
+// Longest a varint can be
+#define MAX_VARINT_BYTES 10
+
+void encode_frame(const FrameBuffer &frame, const std::vector<PresentRun> &runs, std::vector<unsigned char> &out)
+{
+    size_t changed = 0;
+    for (const PresentRun &run : runs)
+    {
+        changed += run.end - run.begin;
+    }
+    // Written to scratch space that only ever grows first, so only the
+    // bytes written have to be copied to 'out' instead of it having to be
+    // filled with zeros up to the most bytes that could be written
+    static thread_local std::vector<unsigned char> scratch;
+    size_t max_size = changed * 4 + (runs.size() + 3) * MAX_VARINT_BYTES;
+    if (scratch.size() < max_size)
+    {
+        scratch.resize(max_size);
+    }
+    unsigned char *begin = scratch.data();
+    unsigned char *end = begin;
+
+    end = write_varint(end, frame.width);
+    end = write_varint(end, frame.height);
+
+    // Everything in between the changed runs is RUN_SAME
+    const Cell *cells = frame.cells.data();
+    size_t pos = 0;
+    for (const PresentRun &run : runs)
+    {
+        size_t run_begin = (size_t)run.y * frame.width + run.begin;
+        size_t run_end = (size_t)run.y * frame.width + run.end;
+        if (run_begin > pos)
+        {
+            end = write_run(end, RUN_SAME, run_begin - pos);
+        }
+        end = write_changed_cells(end, cells, run_begin, run_end);
+        pos = run_end;
+    }
+    if (pos < frame.cells.size())
+    {
+        end = write_run(end, RUN_SAME, frame.cells.size() - pos);
+    }
+    out.insert(out.end(), begin, end);
+}
+
+// Writes out the buffered records
+static void recorder_flush(Recorder &recorder)
+{
+    if (!recorder.buffer.empty() &&
+        fwrite(recorder.buffer.data(), 1, recorder.buffer.size(), recorder.file) != recorder.buffer.size())
+    {
+        recorder.failed = true;
+    }
+    recorder.buffer.clear();
+}
+
+// Nanoseconds from the start of the recording to 'time'
+static int64_t recording_time(const Recorder &recorder, std::chrono::steady_clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - recorder.start).count();
+}
+
+bool recorder_open(Recorder &recorder, const std::string &path, const RecordingHeader &header,
+                   std::chrono::steady_clock::time_point start)
+{
+    recorder.file = fopen(path.c_str(), "wb");
+    if (recorder.file == nullptr)
+    {
+        return false;
+    }
+    recorder.frames = (header.flags & RECORDING_FRAMES) != 0;
+    recorder.start = start;
+    recorder.last_time = 0;
+    recorder.buffer.reserve(RECORDER_FLUSH_SIZE * 2);
+    recorder.failed = false;
+
+    const uint32_t fields[RECORDING_HEADER_FIELDS] =
+    {
+        header.version, header.flags, header.screen_width, header.screen_height,
+        header.map_width, header.map_height, header.map_hash, float_bits(header.fov),
+        float_bits(header.start_x), float_bits(header.start_y), float_bits(header.start_angle), header.toggles,
+    };
+    unsigned char bytes[8 + RECORDING_HEADER_FIELDS * 4];
+    memcpy(bytes, RECORDING_MAGIC, 8);
+    for (int i = 0; i < RECORDING_HEADER_FIELDS; ++i)
+    {
+        put_uint32(bytes + 8 + i * 4, fields[i]);
+    }
+    recorder.buffer.insert(recorder.buffer.end(), bytes, bytes + sizeof(bytes));
+    return true;
+}
+
+void record_key_event(Recorder &recorder, const KeyEvent &event)
+{
+    std::vector<unsigned char> &out = recorder.buffer;
+    out.push_back(RECORD_KEY);
+    put_time(out, recorder.last_time, recording_time(recorder, event.time));
+    put_varint(out, (uint64_t)event.key);
+    out.push_back((unsigned char)event.type);
+}
+
+void record_resize(Recorder &recorder, int width, int height)
+{
+    std::vector<unsigned char> &out = recorder.buffer;
+    out.push_back(RECORD_RESIZE);
+    put_varint(out, (uint64_t)width);
+    put_varint(out, (uint64_t)height);
+}
+
+void record_column_step(Recorder &recorder, int step)
+{
+    std::vector<unsigned char> &out = recorder.buffer;
+    out.push_back(RECORD_COLUMN_STEP);
+    put_varint(out, (uint64_t)step);
+}
+
+void record_frame(Recorder &recorder, std::chrono::steady_clock::time_point now, const FrameBuffer *frame,
+                  const std::vector<PresentRun> &runs)
+{
+    std::vector<unsigned char> &out = recorder.buffer;
+    bool cells = recorder.frames && frame != nullptr;
+    out.push_back(RECORD_FRAME);
+    put_time(out, recorder.last_time, recording_time(recorder, now));
+    out.push_back((frame != nullptr ? FRAME_DRAWN : 0) | (cells ? FRAME_CELLS : 0));
+    if (cells)
+    {
+        encode_frame(*frame, runs, out);
+    }
+
+    if (out.size() >= RECORDER_FLUSH_SIZE)
+    {
+        recorder_flush(recorder);
+    }
+}
+
+bool recorder_close(Recorder &recorder)
+{
+    if (recorder.file == nullptr)
+    {
+        return false;
+    }
+    recorder.buffer.push_back(RECORD_END);
+    recorder_flush(recorder);
+    bool ok = fclose(recorder.file) == 0 && !recorder.failed;
+    recorder.file = nullptr;
+    return ok;
+}
+
+bool replay_open(Replay &replay, const std::string &path, std::string &error)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        error = "could not open '" + path + "'";
+        return false;
+    }
+    unsigned char bytes[8 + RECORDING_HEADER_FIELDS * 4];
+    if (fread(bytes, 1, sizeof(bytes), file) != sizeof(bytes) || memcmp(bytes, RECORDING_MAGIC, 8) != 0)
+    {
+        fclose(file);
+        error = "'" + path + "' is not a recording";
+        return false;
+    }
+    uint32_t fields[RECORDING_HEADER_FIELDS];
+    for (int i = 0; i < RECORDING_HEADER_FIELDS; ++i)
+    {
+        fields[i] = get_uint32(bytes + 8 + i * 4);
+    }
+    RecordingHeader &header = replay.header;
+    header.version = fields[0];
+    header.flags = fields[1];
+    header.screen_width = fields[2];
+    header.screen_height = fields[3];
+    header.map_width = fields[4];
+    header.map_height = fields[5];
+    header.map_hash = fields[6];
+    header.fov = bits_float(fields[7]);
+    header.start_x = bits_float(fields[8]);
+    header.start_y = bits_float(fields[9]);
+    header.start_angle = bits_float(fields[10]);
+    header.toggles = fields[11];
+    if (header.version != RECORDING_VERSION)
+    {
+        fclose(file);
+        error = "'" + path + "' is a recording of version " + std::to_string(header.version) +
+                ", expected " + std::to_string(RECORDING_VERSION);
+        return false;
+    }
+    if (header.screen_width == 0 || header.screen_height == 0 ||
+        header.screen_width > 10000 || header.screen_height > 10000)
+    {
+        fclose(file);
+        error = "'" + path + "' has an invalid screen size";
+        return false;
+    }
+
+    // The records, all at once
+    replay.data.clear();
+    unsigned char chunk[65536];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+        replay.data.insert(replay.data.end(), chunk, chunk + read);
+    }
+    fclose(file);
+    replay.pos = 0;
+    replay.last_time = 0;
+    replay.frame = FrameBuffer();
+    replay.screen_width = (int)header.screen_width;
+    replay.screen_height = (int)header.screen_height;
+    replay.column_step = 1;
+    return true;
+}
+
+// Reads records from 'replay.data', keeping track of whether it ran past the end
+struct RecordReader
+{
+    Replay &replay;
+    bool ok = true;
+
+    unsigned char byte()
+    {
+        if (replay.pos >= replay.data.size())
+        {
+            ok = false;
+            return 0;
+        }
+        return replay.data[replay.pos++];
+    }
+
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            unsigned char b = byte();
+            value |= (uint64_t)(b & 0x7f) << shift;
+            if ((b & 0x80) == 0)
+            {
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+
+    // Time of the record in nanoseconds since the start
+    int64_t time()
+    {
+        uint64_t zigzag = varint();
+        int64_t difference = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+        replay.last_time += difference;
+        return replay.last_time;
+    }
+
+    Cell cell()
+    {
+        char glyph = (char)byte();
+        unsigned char low = byte();
+        unsigned char high = byte();
+        return Cell{glyph, (short)(low | (high << 8))};
+    }
+};
+
+// Decodes the cells of a frame into 'replay.frame'. Returns false if they are broken.
+static bool decode_frame(RecordReader &reader)
+{
+    FrameBuffer &frame = reader.replay.frame;
+    uint64_t width = reader.varint();
+    uint64_t height = reader.varint();
+    if (!reader.ok || width == 0 || height == 0 || width > 10000 || height > 10000)
+    {
+        return false;
+    }
+    if ((int)width != frame.width || (int)height != frame.height)
+    {
+        fb_reset(frame, (int)width, (int)height, Cell{' ', 0});
+    }
+
+    Cell *cells = frame.cells.data();
+    size_t count = frame.cells.size();
+    size_t i = 0;
+    while (i < count)
+    {
+        uint64_t run = reader.varint();
+        size_t length = run >> 2;
+        int kind = run & 3;
+        if (!reader.ok || length == 0 || length > count - i)
+        {
+            return false;
+        }
+        if (kind == RUN_REPEAT)
+        {
+            Cell cell = reader.cell();
+            std::fill(cells + i, cells + i + length, cell);
+        }
+        else if (kind == RUN_LITERAL)
+        {
+            for (size_t j = i; j < i + length; ++j)
+            {
+                cells[j] = reader.cell();
+            }
+        }
+        else if (kind != RUN_SAME)
+        {
+            return false;
+        }
+        i += length;
+    }
+    return reader.ok;
+}
+
+bool replay_next_frame(Replay &replay, std::chrono::steady_clock::time_point start, ReplayFrame &frame,
+                       std::string &error)
+{
+    frame.events.clear();
+    error.clear();
+    RecordReader reader{replay};
+    while (true)
+    {
+        unsigned char type = reader.byte();
+        if (!reader.ok)
+        {
+            error = "recording ends without an end record";
+            return false;
+        }
+        if (type == RECORD_END)
+        {
+            return false;
+        }
+        else if (type == RECORD_KEY)
+        {
+            KeyEvent event;
+            int64_t time = reader.time();
+            event.key = (int)reader.varint();
+            event.type = (KeyEventType)reader.byte();
+            event.time = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                     std::chrono::nanoseconds(time));
+            if (!reader.ok || event.type > KEY_EVENT_TEXT)
+            {
+                error = "broken key event in recording";
+                return false;
+            }
+            frame.events.push_back(event);
+        }
+        else if (type == RECORD_FRAME)
+        {
+            int64_t time = reader.time();
+            unsigned char flags = reader.byte();
+            frame.time = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::nanoseconds(time));
+            frame.drawn = (flags & FRAME_DRAWN) != 0;
+            frame.has_cells = (flags & FRAME_CELLS) != 0;
+            if (!reader.ok || (frame.has_cells && !decode_frame(reader)))
+            {
+                error = "broken frame in recording";
+                return false;
+            }
+            return true;
+        }
+        else if (type == RECORD_RESIZE)
+        {
+            uint64_t width = reader.varint();
+            uint64_t height = reader.varint();
+            if (!reader.ok || width == 0 || height == 0 || width > 10000 || height > 10000)
+            {
+                error = "broken resize in recording";
+                return false;
+            }
+            replay.screen_width = (int)width;
+            replay.screen_height = (int)height;
+        }
+        else if (type == RECORD_COLUMN_STEP)
+        {
+            uint64_t step = reader.varint();
+            if (!reader.ok || step == 0 || step > 10000)
+            {
+                error = "broken column step in recording";
+                return false;
+            }
+            replay.column_step = (int)step;
+        }
+        else
+        {
+            error = "unknown record type " + std::to_string(type) + " in recording";
+            return false;
+        }
+    }
+}
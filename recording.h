@@ -0,0 +1,181 @@
+// recording.h - Records a session to a file (--record), and reads it back
+//               to replay it (--replay, --bench-replay). What gets recorded
+//               is what the game loop goes by: the key events it handled and
+//               the time of every frame, so feeding them to a Session (see
+//               session.h) moves the player exactly the same way again.
+//               Optionally the frames drawn are recorded as well
+//               (--record-frames), each as what changed since the one before.
+//
+// ---- FILE FORMAT: ----
+// Header: RECORDING_MAGIC (8 bytes), then the fields of 'RecordingHeader'
+//         as little endian uint32s (floats as their bits).
+// Then records, each starting with its type byte:
+//   RECORD_KEY    time, key, event type (KeyEventType)
+//   RECORD_FRAME  time, frame flags (FRAME_DRAWN, FRAME_CELLS), and the
+//                 cells if FRAME_CELLS (see FRAMES below)
+//   RECORD_RESIZE width and height of the view ('screen_width',
+//                 'screen_height') from the next frame on, the terminal was resized
+//   RECORD_COLUMN_STEP  columns raycast from the next frame on (see
+//                 'ViewSettings::column_step'), adaptive resolution changed it
+//   RECORD_END    end of the recording
+// Numbers are varints: 7 bits at a time, lowest first, with the top bit set
+// on every byte but the last. Times are nanoseconds since the recording
+// started, stored as the difference from the time of the record before.
+// A key event can be read a little before the frame before it started, so
+// the difference is signed, zigzag encoded (0, -1, 1, -2... = 0, 1, 2, 3...).
+//
+// ---- FRAMES: ----
+// Width and height (varints), then runs of cells covering the frame row by
+// row. Each run starts with the varint 'length << 2 | kind':
+//   RUN_SAME     next 'length' cells are the same as in the frame before
+//   RUN_REPEAT   one cell, repeated 'length' times
+//   RUN_LITERAL  'length' cells
+// A cell is its glyph byte and color pair (2 bytes, little endian). Before
+// the first frame (and when the size changes) the frame before is all blank.
+// While the player stands still a frame takes a couple of bytes, walking
+// around on a 200x60 screen a few kilobytes.
+
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include "framebuffer.h"
+#include "input.h" // KeyEvent
+#include "presenter.h" // PresentRun
+#include <chrono> // steady_clock
+#include <cstdint> // uint32_t, int64_t
+#include <cstdio> // FILE
+#include <string> // std::string
+#include <vector> // vector
+
+#define RECORDING_MAGIC "ASCIIREC"
+#define RECORDING_VERSION 3
+
+// Record types
+#define RECORD_END 0
+#define RECORD_KEY 1
+#define RECORD_FRAME 2
+#define RECORD_RESIZE 3
+#define RECORD_COLUMN_STEP 4
+
+// Frame flags
+#define FRAME_DRAWN 1 // The frame was drawn (not skipped, see --skip-unchanged)
+#define FRAME_CELLS 2 // The cells of the frame follow
+
+// Run kinds, see FRAMES above
+#define RUN_SAME 0
+#define RUN_REPEAT 1
+#define RUN_LITERAL 2
+
+// Recording flags
+#define RECORDING_FRAMES 1 // Frames drawn are recorded
+
+// Session toggles at the start of the recording
+#define TOGGLE_COLORED 1
+#define TOGGLE_TEXTURED 2
+#define TOGGLE_MAP 4
+#define TOGGLE_PROFILER 8
+#define TOGGLE_SUBCELLS_SUPPORTED 16
+#define TOGGLE_SUBCELLS_SHIFT 8 // Sub-cell mode is stored in the bits from here on
+
+class Map;
+struct Session;
+
+struct RecordingHeader
+{
+    uint32_t version = RECORDING_VERSION;
+    uint32_t flags = 0;         // RECORDING_FRAMES
+    uint32_t screen_width = 0;  // Size of the view ('screen_width', 'screen_height'),
+    uint32_t screen_height = 0; // recorded frames have STATUS_ROWS more rows
+    uint32_t map_width = 0;     // Map the session was played on, to make sure
+    uint32_t map_height = 0;    // it is replayed on the same one
+    uint32_t map_hash = 0;
+    float fov = 0.0f;           // Field of view angle, in radians
+    float start_x = 0.0f;       // Player at the start
+    float start_y = 0.0f;
+    float start_angle = 0.0f;
+    uint32_t toggles = 0;       // TOGGLE_ bits
+};
+
+// Number of uint32s in the header after RECORDING_MAGIC
+#define RECORDING_HEADER_FIELDS 12
+
+// Fills in the map and session parts of 'header'
+void recording_header_set(RecordingHeader &header, const Map &map, const Session &session);
+// Sets up the toggles of 'session' the way they were at the start of the recording
+void recording_header_apply(const RecordingHeader &header, Session &session);
+// Hash of the cells of 'map', to tell if a recording was made on it
+uint32_t map_hash(const Map &map);
+
+// Appends the cells of 'frame' to 'out' in the format described under FRAMES.
+// 'runs' are the cells that changed since the frame before, as found by the
+// presenter (see 'find_changed_runs'), so unchanged cells aren't even looked at.
+void encode_frame(const FrameBuffer &frame, const std::vector<PresentRun> &runs, std::vector<unsigned char> &out);
+
+// ---- Recording ----
+
+struct Recorder
+{
+    FILE *file = nullptr;
+    bool frames = false; // Record the frames drawn
+    std::chrono::steady_clock::time_point start; // Time 0 of the recording
+    int64_t last_time = 0;                       // Of the record before
+    std::vector<unsigned char> buffer; // Written out once it is big enough
+    bool failed = false;               // Couldn't write to the file
+};
+
+// Creates the recording file at 'path' and writes 'header' to it.
+// 'start' is the time the session started. Returns false if the file couldn't be created.
+bool recorder_open(Recorder &recorder, const std::string &path, const RecordingHeader &header,
+                   std::chrono::steady_clock::time_point start);
+
+// Records a key event the game loop handled
+void record_key_event(Recorder &recorder, const KeyEvent &event);
+
+// Records that the view is 'width' x 'height' from the next frame on
+void record_resize(Recorder &recorder, int width, int height);
+
+// Records that every 'step' columns is raycast from the next frame on
+void record_column_step(Recorder &recorder, int step);
+
+// Records a frame at time 'now'. 'frame' is what was drawn, nullptr if no
+// frame was drawn. 'runs' are the cells of it that changed since the frame
+// drawn before ('Presenter::runs' after presenting it).
+void record_frame(Recorder &recorder, std::chrono::steady_clock::time_point now, const FrameBuffer *frame,
+                  const std::vector<PresentRun> &runs);
+
+// Ends the recording and closes the file. Returns false if anything couldn't be written.
+bool recorder_close(Recorder &recorder);
+
+// ---- Replaying ----
+
+struct Replay
+{
+    RecordingHeader header;
+    std::vector<unsigned char> data; // The records (whole file after the header)
+    size_t pos = 0;                  // Next record in 'data'
+    int64_t last_time = 0;           // Of the record before
+    FrameBuffer frame;               // Last recorded frame read
+    int screen_width = 0;            // Size of the view for the last frame read, the
+    int screen_height = 0;           // header's until a RECORD_RESIZE changes it
+    int column_step = 1;             // Columns raycast for the last frame read
+};
+
+// One frame of the game loop, as it was recorded
+struct ReplayFrame
+{
+    std::vector<KeyEvent> events; // Key events handled in the frame
+    std::chrono::steady_clock::duration time; // Since the start of the recording
+    bool drawn;                   // The frame was drawn
+    bool has_cells;               // The frame's cells were recorded, they are in 'Replay::frame'
+};
+
+// Reads the recording at 'path'. Returns false and sets 'error' if it can't be read.
+bool replay_open(Replay &replay, const std::string &path, std::string &error);
+
+// Reads the next frame (and the key events before it) into 'frame'. Key event
+// times are made relative to 'start', the time replaying started.
+// Returns false at the end of the recording, with 'error' set if the file is broken.
+bool replay_next_frame(Replay &replay, std::chrono::steady_clock::time_point start, ReplayFrame &frame,
+                       std::string &error);
+
+#endif
@@ -1,180 +1,123 @@
 #include "rendering.h"
 #include "globals.h"
+#include "shading.h"
+#include "sprite.h"
+#include "subcell.h"
+#include "texture.h"
 #include <cassert> // assert
-#include <ncurses.h> // move, printw
-#include <vector> // vector
+#include <ncurses.h> // init_color, init_pair
+#include <algorithm> // min, max
+#include <cmath> // ceilf
+#include <cstdint> // uint64_t
+#include <cstdlib> // abs
 
+// Draws one whole column of the view: the wall in rows ['wall_begin', 'wall_end'),
+// and above and below it the ceiling and floor, copied from 'background'
+// (what each row looks like without a wall in front). Every cell is written
+// once, the ceiling and floor behind the wall are never drawn.
+// The wall is made out of 'num_spans' spans of rows, span i is 'span_rows[i]'
+// rows of 'span_values[i]' (the last span is cut off at 'wall_end').
+// Draws cells into a FrameBuffer, or pixels into a PixelBuffer.
 // PARAMETERS:
-// x [in]          = Which column (in x-axis) that we are currently shading
-// ceiling [in]    = y-coordinate at which ceiling starts (from the wall).
-//                   Can also be seen as the lowest y-coordinate that is part of the ceiling
-// floor [in]      = y-coordinate at which floor starts (from the wall).
-//                   Can also be seen as the highest y-coordinate that is part of the floor
-// distanceToWall [in] = Distance to wall for the column determined by parameter 'x'
-// screen [in/out]     = Variable that holds the characters that will be printed to represent
-//                       our field-of-view. Every call to this function fills up one column
-//                       in this variable. Which column is determined by the parameter 'x'
-void ascii_shade_column(int x, int ceiling, int floor, float distanceToWall, std::string &screen)
+// column [out]         = Top of the column in the buffer
+// stride [in]          = Distance from one row to the next in the buffer
+// height [in]          = Rows in the column
+template<typename T>
+static void draw_column(T *column, int stride, int height, int wall_begin, int wall_end,
+                        const T *span_values, const int *span_rows, int num_spans, const T *background)
 {
-    // Character that will be rendered, will differ to represent
-    // different shade depending on distance/depth of vision.
-    char shade = ' ';
-
-    // Iterating top to bottom, all squares in the column we are currently rendering
-    for (int y = 0; y < screen_height; ++y)
+    wall_end = std::min(wall_end, height);
+    T *value = column;
+    int y = 0;
+    for (; y < wall_begin; ++y, value += stride)
     {
-        if (y < ceiling)
-        {
-            // This pixel is part of the ceiling
-            screen[y * screen_width + x] = ' ';
-        }
-        else if (y >= ceiling && y <= floor)
-        {
-            // Get shade based on current distance
-            // 1. Get precentage of how far the distance is
-            //    1.0f (100%) means that distance is MAX_DEPTH
-            //    (The max of what we can see
-            float sight_distance = distanceToWall / MAX_DEPTH;
-            // 2. Figure out which level of shade based on the precentage
-            std::string shades = "@%#*=- "; // Characters that make up the total grayscale of shade.
-                                            // Goes from brightest to darkest, or to be more exact, from shade
-                                            // at closest distance to wall to shade at longest or infinite distance to wall.
-
-            assert(shades.length() > 0); // Otherwise, shade_index on next line could be negative
-            int shade_index = sight_distance * (shades.length() - 1);
-            shade = shades[shade_index];
-
-            // This pixel is part of the wall (neither ceiling or floor)
-            screen[y * screen_width + x] = shade;
-        }
-        else
+        *value = background[y];
+    }
+    for (int span = 0; span < num_spans && y < wall_end; ++span)
+    {
+        int span_end = std::min(y + span_rows[span], wall_end);
+        T span_value = span_values[span];
+        for (; y < span_end; ++y, value += stride)
         {
-            // This pixel is part of the floor
-
-            // precentage of how far down on screen our current y-coordinate is.
-            // 1.0f means its in the very middle of screen, 0.0f means its at the very bottom.
-            float b = 1.0f - (((float)y - screen_height / 2.0f) / ((float)screen_height / 2.0f));
-            if (b < 0.4)
-                shade = '+';
-            else
-                shade = '.';
-
-            screen[y * screen_width + x] = shade;
+            *value = span_value;
         }
     }
+    for (; y < height; ++y, value += stride)
+    {
+        *value = background[y];
+    }
 }
 
-// Draw the the ascii characters we have stored in the variable 'screen'
-// with each call to 'ascii_shaded_column'.
-// - Also does some last touches, adding newlines for example
-//   before doing the actual print
-void ascii_draw(std::string &screen)
+// Where the rows of a textured wall sample its texture, see 'texture_walk'
+struct TextureWalk
 {
-    // Sacrifice the right most column for newlines
-    for (int i = 0; i < screen_height; ++i)
-    {
-        int last_pixel = i * (screen_width) + (screen_width-1); // Get last pixel/char of row
-        screen[last_pixel] = '\n';
-    }
+    const Texel *texels; // Column of the texture the ray hit
+    unsigned v;          // Where the middle of the first wall row on screen is
+                         // down the texture, in texels (16.16 fixed point)
+    unsigned v_step;     // How much further down each row after it is
+    int first;           // Texels 'first' to 'last' show on screen
+    int last;            // (none if 'last' < 'first')
+};
 
-    // Move to top-left corner of terminal before we print/draw/render.
-    move(0,0);
-    // This is essentially our function call for the "Drawing/Rendering" to happen
-    printw("%s", screen.c_str());
+// Works out where the rows of the wall of 'column' sample a texture
+// 'texture_size' texels high, for the 'wall_rows' rows of it on screen.
+// Every texel covers at least one row (the mip level is picked so the wall
+// has at least as many rows as the texture).
+static TextureWalk texture_walk(const ColumnResult &column, const Texel *texels, int texture_size, int wall_rows)
+{
+    TextureWalk walk;
+    int u = std::min((int)(column.texX * texture_size), texture_size - 1);
+    walk.texels = texels + u * texture_size;
+
+    float texels_per_row = texture_size / column.wall_height;
+    walk.v_step = std::max((unsigned)(texels_per_row * 65536.0f), 1u);
+    walk.v = (unsigned)(std::max(column.ceiling + 0.5f - column.wall_top, 0.0f) * texels_per_row * 65536.0f);
+    walk.first = (int)(walk.v >> 16);
+    uint64_t last_v = walk.v + (uint64_t)std::max(wall_rows - 1, 0) * walk.v_step;
+    walk.last = (int)std::min(last_v >> 16, (uint64_t)(texture_size - 1));
+    return walk;
 }
 
-void init_colors()
+// Draws a textured wall from 'wall_begin' to 'wall_end' (cut off at
+// 'height') with the background above and below it, like 'draw_column'.
+// Each wall row gets the value of the texel its middle lands in,
+// 'texel_values[i]' for texel i of the texture column 'walk' goes down.
+// One row at a time with no branches, a span of rows per texel would cost
+// a mispredicted branch every two or three rows.
+// The wall rows are rounded, so the last one or two can reach a little
+// past the end of the texture, those repeat the last texel (and the
+// background shows through after them).
+template<typename T>
+static void draw_texture_column(T *column, int stride, int height, int wall_begin, int wall_end,
+                                const TextureWalk &walk, int texture_size, const T *texel_values,
+                                const T *background)
 {
-    /* initialize colors */
+    wall_end = std::min(wall_end, height);
+    unsigned v = walk.v;
+    unsigned v_end = (unsigned)texture_size << 16;
+    int wall_rows = 0;
+    if (v < v_end)
+    {
+        // Rows whose middle lands inside the texture, and the two after them
+        int texture_rows = (int)((v_end - v + walk.v_step - 1) / walk.v_step) + 2;
+        wall_rows = std::max(std::min(wall_end - wall_begin, texture_rows), 0);
+    }
 
-    if (has_colors() == FALSE) {
-        endwin();
-        printf("Your terminal does not support color\n");
-        exit(1);
+    T *value = column;
+    int y = 0;
+    for (; y < wall_begin; ++y, value += stride)
+    {
+        *value = background[y];
     }
-    if (can_change_color() == FALSE) {
-        endwin();
-        printf("Your terminal does not support color change\n");
-        exit(1);
+    int last = texture_size - 1;
+    for (int row = 0; row < wall_rows; ++row, ++y, value += stride, v += walk.v_step)
+    {
+        *value = texel_values[std::min((int)(v >> 16), last)];
+    }
+    for (; y < height; ++y, value += stride)
+    {
+        *value = background[y];
     }
-
-    start_color();
-
-    // init_color
-    // param 1     : color name
-    // param 2, 3, 4 : rgb content min = 0, max = 1000 */
-
-    // ncurses has colors from 1 to 8 already predefined,
-    // so lets start from 9 (eventhough we could just override
-    // the predefined 1 to 8 colors with init_color call probably)
-    // but, anyway, fuck it...
-
-    // foreground color (only because its neccessary for init_pair)
-    assert(init_color(9, 255, 255, 255) == OK);
-
-    // Wall background colors/shades
-    // (From brightest to darkest)
-    assert(init_color(10, 584, 584, 686) == OK);
-    assert(init_color(11, 529, 529, 623) == OK);
-    assert(init_color(12, 474, 474, 561) == OK);
-    assert(init_color(13, 423, 423, 498) == OK);
-    assert(init_color(14, 368, 368, 435) == OK);
-    assert(init_color(15, 318, 318, 372) == OK);
-    assert(init_color(16, 263, 263, 310) == OK);
-    assert(init_color(17, 212, 212, 247) == OK);
-    assert(init_color(18, 157, 157, 184) == OK);
-    assert(init_color(19, 104, 104, 121) == OK);
-    assert(init_color(20,  50,  50,  59) == OK);
-
-    assert(init_color(21, 614, 614, 716) == OK);
-    assert(init_color(22, 559, 559, 653) == OK);
-    assert(init_color(23, 494, 494, 591) == OK);
-    assert(init_color(24, 453, 453, 528) == OK);
-    assert(init_color(25, 398, 398, 465) == OK);
-
-    // Floor and Ceiling background colors/shades
-    // (From brightest to darkest)
-    assert(init_color(30, 498, 165, 98) == OK);
-    assert(init_color(31, 435, 145, 86) == OK);
-    assert(init_color(32, 372, 122, 74) == OK);
-    assert(init_color(33, 310, 102, 59) == OK);
-    assert(init_color(34, 247,  82, 47) == OK);
-    assert(init_color(35, 184,  59, 35) == OK);
-    assert(init_color(36, 122,  39, 24) == OK);
-    assert(init_color(37,  47,  16,  8) == OK);
-
-    // Need to setup pairs before we can apply them
-    // - Creates a pair out of a foreground (color of text) and
-    //   background (color of text background) color
-
-    // Wall shades
-    init_pair(10, 9, 10);
-    init_pair(11, 9, 11);
-    init_pair(12, 9, 12);
-    init_pair(13, 9, 13);
-    init_pair(14, 9, 14);
-    init_pair(15, 9, 15);
-    init_pair(16, 9, 16);
-    init_pair(17, 9, 17);
-    init_pair(18, 9, 18);
-    init_pair(19, 9, 19);
-    init_pair(20, 9, 20);
-
-    init_pair(21, 9, 21);
-    init_pair(22, 9, 22);
-    init_pair(23, 9, 23);
-    init_pair(24, 9, 24);
-    init_pair(25, 9, 25);
-
-    // Floor/Ceiling shades
-    init_pair(30, 9, 30);
-    init_pair(31, 9, 31);
-    init_pair(32, 9, 32);
-    init_pair(33, 9, 33);
-    init_pair(34, 9, 34);
-    init_pair(35, 9, 35);
-    init_pair(36, 9, 36);
-    init_pair(37, 9, 37);
 }
 
 // PARAMETERS:
@@ -183,268 +126,269 @@ void init_colors()
 //                   Can also be seen as the lowest y-coordinate that is part of the ceiling
 // floor [in]      = y-coordinate at which floor starts (from the wall).
 //                   Can also be seen as the highest y-coordinate that is part of the floor
-// distanceToWall [in] = Distance to wall for the column determined by parameter 'x'
-void colored_draw_wall_column(int x, int ceiling, int floor, float distanceToWall)
+// wall_shade [in] = Character to draw the wall with, from 'compute_column'
+// fb [in/out]     = Frame buffer that holds the characters that will be printed to represent
+//                   our field-of-view. Every call to this function fills up one column
+//                   in this buffer. Which column is determined by the parameter 'x'
+void ascii_shade_column(int x, int ceiling, int floor, char wall_shade, FrameBuffer &fb)
 {
-    // Get shade based on current distance
-    // 1. Get precentage of how far the distance is
-    //    1.0f (100%) means that distance is MAX_DEPTH
-    //    (The max of what we can see
-    float sight_distance = distanceToWall / MAX_DEPTH;
-    int wall_length = floor - ceiling;
+    // In ascii the row at 'floor' is part of the wall as well
+    Cell wall{wall_shade, 0};
+    int rows = floor + 1 - ceiling;
+    draw_column(&fb.at(x, 0), fb.width, screen_height, ceiling, floor + 1, &wall, &rows, 1,
+                shade_tables.background_ascii.data());
+}
 
-    if (sight_distance < 0.05f)
-    {
-        attron(COLOR_PAIR(10));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(10));
-    }
-    else if (sight_distance < 0.1f)
-    {
-        attron(COLOR_PAIR(11));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(11));
-    }
-    else if (sight_distance < 0.15f)
-    {
-        attron(COLOR_PAIR(12));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(12));
-    }
-    else if (sight_distance < 0.2f)
-    {
-        attron(COLOR_PAIR(13));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(13));
-    }
-    else if (sight_distance < 0.25f)
+bool color_pair_rgb(short color_pair, RGB &fg, RGB &bg)
+{
+    short fg_id, bg_id;
+    const PalettePair *pair = find_palette_pair(palette, color_pair);
+    if (pair != nullptr)
     {
-        attron(COLOR_PAIR(14));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(14));
+        fg_id = pair->fg;
+        bg_id = pair->bg;
     }
-    else if (sight_distance < 0.3f)
+    else if (!subcell_pair_colors(color_pair, fg_id, bg_id))
     {
-        attron(COLOR_PAIR(15));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(15));
+        return false;
     }
-    else if (sight_distance < 0.35f)
+    const PaletteColor *fg_color = find_palette_color(palette, fg_id);
+    const PaletteColor *bg_color = find_palette_color(palette, bg_id);
+    assert(fg_color != nullptr && bg_color != nullptr);
+
+    // Scale from 0-1000 to 0-255
+    fg = RGB{(unsigned char)(fg_color->r * 255 / 1000), (unsigned char)(fg_color->g * 255 / 1000), (unsigned char)(fg_color->b * 255 / 1000)};
+    bg = RGB{(unsigned char)(bg_color->r * 255 / 1000), (unsigned char)(bg_color->g * 255 / 1000), (unsigned char)(bg_color->b * 255 / 1000)};
+    return true;
+}
+
+// For terminals where we can't define our own colors. Finds the color, out of
+// the ones the terminal already has, that is closest to one of our colors.
+// - 256 color terminals have a 6x6x6 color cube at 16-231 and a gray ramp at 232-255
+// - Otherwise we only have the 8 basic colors to choose from
+static short closest_terminal_color(const PaletteColor &color)
+{
+    int r = color.r * 255 / 1000;
+    int g = color.g * 255 / 1000;
+    int b = color.b * 255 / 1000;
+
+    if (COLORS >= 256)
     {
-        attron(COLOR_PAIR(16));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(16));
+        static const int cube_levels[6] = {0, 95, 135, 175, 215, 255};
+        int rgb[3] = {r, g, b};
+        int cube_index[3];
+        int cube_error = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            int best = 0;
+            for (int level = 1; level < 6; ++level)
+            {
+                if (abs(cube_levels[level] - rgb[i]) < abs(cube_levels[best] - rgb[i]))
+                {
+                    best = level;
+                }
+            }
+            cube_index[i] = best;
+            cube_error += (cube_levels[best] - rgb[i]) * (cube_levels[best] - rgb[i]);
+        }
+
+        int gray_index = std::min(23, std::max(0, ((r + g + b) / 3 - 8 + 5) / 10));
+        int gray = 8 + gray_index * 10;
+        int gray_error = (gray - r) * (gray - r) + (gray - g) * (gray - g) + (gray - b) * (gray - b);
+
+        if (gray_error < cube_error)
+        {
+            return 232 + gray_index;
+        }
+        return 16 + cube_index[0] * 36 + cube_index[1] * 6 + cube_index[2];
     }
-    else if (sight_distance < 0.4f)
-    {
-        attron(COLOR_PAIR(17));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(17));
+
+    // Basic colors, each channel either fully on or off (bit 0 = red, 1 = green, 2 = blue)
+    return (r >= 128 ? 1 : 0) | (g >= 128 ? 2 : 0) | (b >= 128 ? 4 : 0);
+}
+
+bool init_colors(bool &subcell_pairs)
+{
+    subcell_pairs = false;
+    /* initialize colors */
+
+    if (has_colors() == FALSE) {
+        return false;
     }
-    else if (sight_distance < 0.45f)
+
+    start_color();
+
+    // If the terminal doesn't let us define our own colors (or doesn't have
+    // enough of them), every color is swapped for the closest one the terminal has.
+    short max_color_id = 0;
+    for (const PaletteColor &color : palette.colors)
     {
-        attron(COLOR_PAIR(18));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(18));
+        max_color_id = std::max(max_color_id, color.id);
     }
-    else if (sight_distance < 0.5f)
+    bool custom_colors = (can_change_color() == TRUE && COLORS > max_color_id);
+
+    if (custom_colors)
     {
-        attron(COLOR_PAIR(19));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(19));
+        for (const PaletteColor &color : palette.colors)
+        {
+            init_color(color.id, color.r, color.g, color.b);
+        }
     }
-    else if (sight_distance < 0.6f)
+
+    // Need to setup pairs before we can apply them
+    for (const PalettePair &pair : palette.pairs)
     {
-        attron(COLOR_PAIR(20));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(20));
+        short fg = pair.fg;
+        short bg = pair.bg;
+        if (!custom_colors)
+        {
+            fg = closest_terminal_color(*find_palette_color(palette, fg));
+            bg = closest_terminal_color(*find_palette_color(palette, bg));
+        }
+        init_pair(pair.id, fg, bg);
     }
-    else
+
+    // A pair for every combination of two of our colors, if there are enough
+    // pairs. (Terminals with 256 colors tend to have 65536 pairs.)
+    if (pixel_colors_build() &&
+        pixel_tables.pair_base + pixel_tables.num_colors * pixel_tables.num_colors <= COLOR_PAIRS)
     {
-        // Make the shade for longest distance to wall the same
-        // as the longest distance/darkest shade for ceiling/floor
-        // so that the most distant wall just blends into the background.
-        attron(COLOR_PAIR(37));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(37));
+        short terminal_colors[MAX_PIXEL_COLORS];
+        for (int i = 0; i < pixel_tables.num_colors; ++i)
+        {
+            short id = pixel_tables.colors[i];
+            terminal_colors[i] = custom_colors ? id : closest_terminal_color(*find_palette_color(palette, id));
+        }
+        for (int fg = 0; fg < pixel_tables.num_colors; ++fg)
+        {
+            for (int bg = 0; bg < pixel_tables.num_colors; ++bg)
+            {
+                init_pair(subcell_pair(fg, bg), terminal_colors[fg], terminal_colors[bg]);
+            }
+        }
+        subcell_pairs = true;
     }
+    return true;
 }
 
-
 // PARAMETERS:
 // x [in]          = Which column (in x-axis) that we are currently shading
 // ceiling [in]    = y-coordinate at which ceiling starts (from the wall).
 //                   Can also be seen as the lowest y-coordinate that is part of the ceiling
 // floor [in]      = y-coordinate at which floor starts (from the wall).
 //                   Can also be seen as the highest y-coordinate that is part of the floor
-// distanceToWall [in] = Distance to wall for the column determined by parameter 'x'
-void colored_draw_wall_column_2(int x, int ceiling, int floor, float distanceToWall)
+// color_pair [in] = Color pair to draw the wall with, from 'compute_column'
+// fb [in/out]     = Frame buffer to draw the column into, ceiling and floor included
+void colored_draw_wall_column(int x, int ceiling, int floor, int color_pair, FrameBuffer &fb)
 {
-    // Get shade based on current distance
-    // 1. Get precentage of how far the distance is
-    //    1.0f (100%) means that distance is MAX_DEPTH
-    //    (The max of what we can see
-    float sight_distance = distanceToWall / MAX_DEPTH;
-    int wall_length = floor - ceiling;
+    Cell wall{' ', (short)color_pair};
+    int rows = floor - ceiling;
+    draw_column(&fb.at(x, 0), fb.width, screen_height, ceiling, floor, &wall, &rows, 1,
+                shade_tables.background.data());
+}
 
-    if (sight_distance < 0.025f)
-    {
-        attron(COLOR_PAIR(21));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(22));
-    }
-    else if (sight_distance < 0.05f)
-    {
-        attron(COLOR_PAIR(10));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(10));
-    }
-    else if (sight_distance < 0.075f)
-    {
-        attron(COLOR_PAIR(23));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(23));
-    }
-    else if (sight_distance < 0.1f)
-    {
-        attron(COLOR_PAIR(11));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(11));
-    }
-    else if (sight_distance < 0.125f)
-    {
-        attron(COLOR_PAIR(24));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(24));
-    }
-    else if (sight_distance < 0.15f)
-    {
-        attron(COLOR_PAIR(12));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(12));
-    }
-    else if (sight_distance < 0.175f)
-    {
-        attron(COLOR_PAIR(25));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(25));
-    }
-    else if (sight_distance < 0.2f)
-    {
-        attron(COLOR_PAIR(13));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(13));
-    }
-    else if (sight_distance < 0.25f)
-    {
-        attron(COLOR_PAIR(14));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(14));
-    }
-    else if (sight_distance < 0.3f)
-    {
-        attron(COLOR_PAIR(15));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(15));
-    }
-    else if (sight_distance < 0.35f)
-    {
-        attron(COLOR_PAIR(16));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(16));
-    }
-    else if (sight_distance < 0.5f)
-    {
-        attron(COLOR_PAIR(17));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(17));
-    }
-    else if (sight_distance < 0.6f)
-    {
-        attron(COLOR_PAIR(18));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(18));
-    }
-    else if (sight_distance < 0.7f)
+void textured_draw_wall_column(int x, const ColumnResult &column, const Texel *texels, int texture_size,
+                               bool colored_output, FrameBuffer &fb)
+{
+    // In ascii the row at 'floor' is part of the wall as well
+    int wall_end = colored_output ? column.floor : column.floor + 1;
+    TextureWalk walk = texture_walk(column, texels, texture_size, std::min(wall_end, screen_height) - column.ceiling);
+
+    // A texel's shade moves it further along the wall gradient (darker).
+    // Pure ascii has nothing but the character to show shade with, so there
+    // the texture shows up as darker and lighter characters.
+    Cell texel_cells[TEXTURE_SIZE];
+    int shade_index = column.shade_index;
+    for (int i = walk.first; i <= walk.last; ++i)
     {
-        attron(COLOR_PAIR(19));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(19));
-    }
-    else if (sight_distance < 0.8f)
+        const Texel &texel = walk.texels[i];
+        int index = std::min(shade_index + texel.shade * TEXEL_SHADE_STEP, SHADE_TABLE_SIZE);
+        texel_cells[i] = colored_output ? Cell{texel.glyph, shade_tables.wall[index]}
+                                        : Cell{(char)shade_tables.wall_ascii[index], 0};
+    }
+    draw_texture_column(&fb.at(x, 0), fb.width, screen_height, column.ceiling, wall_end, walk, texture_size,
+                        texel_cells, colored_output ? shade_tables.background.data()
+                                                    : shade_tables.background_ascii.data());
+}
+
+void pixels_draw_wall_column(int x, const ColumnResult &column, const Texel *texels, int texture_size,
+                             PixelBuffer &pixels)
+{
+    unsigned char *top = &pixels.at(x, 0);
+    const unsigned char *background = pixel_tables.background.data();
+    int shade_index = column.shade_index;
+    if (texels == nullptr)
     {
-        attron(COLOR_PAIR(20));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(20));
+        unsigned char wall = pixel_tables.wall[shade_index];
+        int rows = column.floor - column.ceiling;
+        draw_column(top, pixels.width, pixels.height, column.ceiling, column.floor, &wall, &rows, 1, background);
+        return;
     }
-    else
+
+    // Same as 'textured_draw_wall_column', only the glyphs of the texture are
+    // left out (the pixels are made into block characters later)
+    TextureWalk walk = texture_walk(column, texels, texture_size,
+                                    std::min(column.floor, pixels.height) - column.ceiling);
+    unsigned char texel_pixels[TEXTURE_SIZE];
+    for (int i = walk.first; i <= walk.last; ++i)
     {
-        // Make the shade for longest distance to wall the same
-        // as the longest distance/darkest shade for ceiling/floor
-        // so that the most distant wall just blends into the background.
-        attron(COLOR_PAIR(37));
-        mvvline(ceiling, x, ' ', wall_length);
-        attron(COLOR_PAIR(37));
+        int index = std::min(shade_index + walk.texels[i].shade * TEXEL_SHADE_STEP, SHADE_TABLE_SIZE);
+        texel_pixels[i] = pixel_tables.wall[index];
     }
+    draw_texture_column(top, pixels.width, pixels.height, column.ceiling, column.floor, walk, texture_size,
+                        texel_pixels, background);
 }
 
-void colored_draw_ceiling_and_floor()
+// Goes through the texels of a sprite covering 'rect' that land on the view
+// (every column and row whose middle is inside 'rect'), in the columns where
+// the sprite is nearer than the wall, and calls 'plot(x, y, texel)' for the
+// ones that aren't see-through.
+template<typename Plot>
+static void sprite_texels(const SpriteRect &rect, const SpriteImage &image, float depth, const ColumnResult *columns,
+                          int view_width, int view_height, Plot plot)
 {
-    for (int y = 0; y < screen_height; ++y)
+    int x_begin = std::max((int)ceilf(rect.left - 0.5f), 0);
+    int x_end = std::min((int)ceilf(rect.left + rect.width - 0.5f), view_width);
+    int y_begin = std::max((int)ceilf(rect.top - 0.5f), 0);
+    int y_end = std::min((int)ceilf(rect.top + rect.height - 0.5f), view_height);
+    float u_step = SPRITE_SIZE / rect.width;
+    float v_step = SPRITE_SIZE / rect.height;
+    for (int x = x_begin; x < x_end; ++x)
     {
-        // Precentage value of where the current pixel is
-        // ( This is to make sure where shadings start/end
-        //   scales in accordance to change in screen_width/height
-        // - 0.0f means top of screen, 1.0f means bottom of screen
-        float y_prec = y / (float)screen_height;
-
-        if (y_prec < 0.02f || y_prec > 0.98f)
-        {
-            attron(COLOR_PAIR(30));
-            mvhline(y, 0, ' ', screen_width);
-            attron(COLOR_PAIR(30));
-        }
-        else if (y_prec < 0.05f || y_prec > 0.95f)
+        if (columns[x].distance <= depth)
         {
-            attron(COLOR_PAIR(31));
-            mvhline(y, 0, ' ', screen_width);
-            attron(COLOR_PAIR(31));
+            continue; // Behind the wall
         }
-        else if (y_prec < 0.08f || y_prec > 0.92f)
+        int u = std::min(std::max((int)((x + 0.5f - rect.left) * u_step), 0), SPRITE_SIZE - 1);
+        const Texel *texels = &image.texels[u * SPRITE_SIZE];
+        for (int y = y_begin; y < y_end; ++y)
         {
-            attron(COLOR_PAIR(32));
-            mvhline(y, 0, ' ', screen_width);
-            attron(COLOR_PAIR(32));
-        }
-        else if (y_prec < 0.13f || y_prec > 0.87f)
-        {
-            attron(COLOR_PAIR(33));
-            mvhline(y, 0, ' ', screen_width);
-            attron(COLOR_PAIR(33));
-        }
-        else if (y_prec < 0.16f || y_prec > 0.84f)
-        {
-            attron(COLOR_PAIR(34));
-            mvhline(y, 0, ' ', screen_width);
-            attron(COLOR_PAIR(34));
-        }
-        else if (y_prec < 0.20f || y_prec > 0.80f)
-        {
-            attron(COLOR_PAIR(35));
-            mvhline(y, 0, ' ', screen_width);
-            attron(COLOR_PAIR(35));
-        }
-        else if (y_prec < 0.25f || y_prec > 0.75f)
-        {
-            attron(COLOR_PAIR(36));
-            mvhline(y, 0, ' ', screen_width);
-            attron(COLOR_PAIR(36));
-        }
-        else
-        {
-            attron(COLOR_PAIR(37));
-            mvhline(y, 0, ' ', screen_width);
-            attron(COLOR_PAIR(37));
+            int v = std::min(std::max((int)((y + 0.5f - rect.top) * v_step), 0), SPRITE_SIZE - 1);
+            if (texels[v].shade != SPRITE_TRANSPARENT)
+            {
+                plot(x, y, texels[v]);
+            }
         }
     }
 }
+
+void draw_sprite(const SpriteRect &rect, const SpriteImage &image, float depth, int shade_index,
+                 const ColumnResult *columns, bool colored_output, FrameBuffer &fb)
+{
+    // Shaded like the texels of a textured wall, along the sprite gradient
+    sprite_texels(rect, image, depth, columns, fb.width, screen_height, [&](int x, int y, const Texel &texel)
+    {
+        int index = std::min(shade_index + texel.shade * TEXEL_SHADE_STEP, SHADE_TABLE_SIZE);
+        fb.at(x, y) = Cell{texel.glyph, colored_output ? shade_tables.sprite[index] : (short)0};
+    });
+}
+
+void pixels_draw_sprite(const SpriteRect &rect, const SpriteImage &image, float depth, int shade_index,
+                        const ColumnResult *columns, PixelBuffer &pixels)
+{
+    sprite_texels(rect, image, depth, columns, pixels.width, pixels.height, [&](int x, int y, const Texel &texel)
+    {
+        int index = std::min(shade_index + texel.shade * TEXEL_SHADE_STEP, SHADE_TABLE_SIZE);
+        pixels.at(x, y) = pixel_tables.sprite[index];
+    });
+}
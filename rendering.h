@@ -1,21 +1,168 @@
+#ifndef RENDERING_H
+#define RENDERING_H
+
+#include "framebuffer.h"
 #include <string> // std::string
+#include <vector> // vector
+
+// Result of raycasting one screen column, calculated before anything is drawn
+struct ColumnResult
+{
+    float distance; // Distance to wall
+    int ceiling;    // y-coordinate at which ceiling ends and wall starts
+    int floor;      // y-coordinate at which wall ends and floor starts
+    int shade;      // Color pair (colored output) or character (ascii output)
+                    // to draw the wall with
+    int shade_index; // Index into the distance tables 'shade' is from, by distance
+                     // and the light on the wall (see shading.h and light.h)
+    int cell;       // Cell type id of the wall, CELL_EMPTY if there is none
+    float texX;     // Texture coordinate across the wall, 0.0f to 1.0f
+    float wall_top;    // Where the wall starts on screen, before being
+    float wall_height; // cut off at the top and bottom of the screen
+};
+
+struct Texel;
+struct PixelBuffer;
+struct SpriteImage;
+struct SpriteRect;
+
+// Draws/Renders one column of the wall, ceiling and floor in ascii
+// ('shade_tables' must be built for 'screen_height')
+void ascii_shade_column(int x, int ceiling, int floor, char wall_shade, FrameBuffer &fb);
+
+// 24-bit color, each channel 0-255
+struct RGB
+{
+    unsigned char r, g, b;
+};
+
+// Sets up our colors and color pairs in ncurses.
+// If terminal can't change its colors, the closest colors it has are used instead.
+// The pairs for sub-cell drawing (see subcell.h) are set up as well if the
+// terminal has enough color pairs for them, 'subcell_pairs' tells if it did.
+// Returns false if terminal has no colors at all.
+bool init_colors(bool &subcell_pairs);
+
+// Get the foreground and background color of one of our color pairs
+// (sub-cell pairs included).
+// Returns false if 'color_pair' isn't one of ours (like 0, terminal default colors)
+bool color_pair_rgb(short color_pair, RGB &fg, RGB &bg);
+
+// Draws one column of a textured wall, the ceiling and floor around it as in
+// 'colored_draw_wall_column' and 'ascii_shade_column'.
+// PARAMETERS:
+// x [in]              = Which column (in x-axis) that we are currently drawing
+// column [in]         = Raycasting result for the column
+// texels [in]         = Mip level of the texture to draw the wall with, column by column
+// texture_size [in]   = Width and height of that level
+// colored_output [in] = Draw in color, or in pure ascii
+// fb [in/out]         = Frame buffer to draw the column into
+void textured_draw_wall_column(int x, const ColumnResult &column, const Texel *texels, int texture_size,
+                               bool colored_output, FrameBuffer &fb);
+
+// Draws one column of the view into 'pixels' (view is 'pixels.height' rows
+// high, 'pixel_tables' must be built for that), for sub-cell drawing.
+// PARAMETERS:
+// x [in]            = Which column of pixels to draw
+// column [in]       = Raycasting result for the column
+// texels [in]       = Mip level of the texture to draw the wall with, flat shaded if nullptr
+// texture_size [in] = Width and height of that level
+// pixels [in/out]   = Pixel buffer to draw the column into
+void pixels_draw_wall_column(int x, const ColumnResult &column, const Texel *texels, int texture_size,
+                             PixelBuffer &pixels);
+
+// Draws a sprite (see sprite.h) into the top 'screen_height' rows of 'fb', over
+// what is drawn there already, in the columns where it is nearer than the wall.
+// PARAMETERS:
+// rect [in]           = Where it is on screen, from 'project_sprite'
+// image [in]          = What it looks like
+// depth [in]          = Its distance to the camera plane
+// shade_index [in]    = Index into the distance tables it is shaded at, by
+//                       'depth' and the light on it (see light.h)
+// columns [in]        = Raycasting result of every column, for the distance to the wall
+// colored_output [in] = Draw in color, or in pure ascii (the characters of the image)
+// fb [in/out]         = Frame buffer to draw the sprite into
+void draw_sprite(const SpriteRect &rect, const SpriteImage &image, float depth, int shade_index,
+                 const ColumnResult *columns, bool colored_output, FrameBuffer &fb);
+
+// Same as 'draw_sprite', into 'pixels' (for sub-cell drawing)
+void pixels_draw_sprite(const SpriteRect &rect, const SpriteImage &image, float depth, int shade_index,
+                        const ColumnResult *columns, PixelBuffer &pixels);
+
+// Draws/Renders one column of the wall with each call, along with the
+// ceiling and floor above and below it (copied from the rows cached in
+// 'shade_tables', which must be built for 'screen_height')
+void colored_draw_wall_column(int x, int ceiling, int floor, int color_pair, FrameBuffer &fb);
+
+// Where finished frames are printed to. The Presenter works out which cells
+// changed, and the backend decides how to get them onto the terminal.
+class OutputBackend
+{
+public:
+    virtual ~OutputBackend() {}
+
+    // Take over the terminal. Returns false if colors can't be shown.
+    virtual bool init() = 0;
+    // Give the terminal back the way it was
+    virtual void shutdown() = 0;
+    // Called whenever size of the frames to print changes
+    virtual void resize(int width, int height) { (void)width; (void)height; }
+    // True if it can print the block characters and color pairs of sub-cell
+    // drawing (see subcell.h). Only known after 'init'.
+    virtual bool supports_subcells() const { return false; }
+
+    // Print cells [x_begin, x_end) of row 'y' in 'fb'
+    virtual void print_run(const FrameBuffer &fb, int y, int x_begin, int x_end) = 0;
+    // Make everything printed since last call show up on the terminal
+    virtual void flush() = 0;
+};
+
+// Prints through ncurses. Input is read through ncurses as well
+// in this case, so 'init_input' must be called before 'init'.
+class NcursesBackend : public OutputBackend
+{
+public:
+    bool init() override;
+    void shutdown() override;
+    void resize(int width, int height) override;
+    bool supports_subcells() const override { return subcell_pairs; }
+    void print_run(const FrameBuffer &fb, int y, int x_begin, int x_end) override;
+    void flush() override;
+
+private:
+    std::string run_glyphs;     // Scratch space for the characters of a run (UTF-8)
+    bool subcell_pairs = false; // True if 'init_colors' set up the sub-cell pairs
+};
 
-void ascii_shade_column(int x, int ceiling, int floor, float distanceToWall, std::string &screen);
-void ascii_draw(std::string &screen);
+// Writes ANSI escape sequences with 24-bit (truecolor) colors straight to
+// stdout. Everything for a frame is gathered in one buffer and written with
+// a single write() call. Doesn't need the terminal to support redefining
+// its colors. Use with 'init_raw_input' instead of 'init_input'.
+class AnsiBackend : public OutputBackend
+{
+public:
+    // Writes to file descriptor 'fd' instead of stdout (the benchmark writes to /dev/null)
+    explicit AnsiBackend(int fd = 1) : fd(fd) {}
+    // Appends to 'sink' instead of writing anywhere (the server sends it on to a client)
+    explicit AnsiBackend(std::vector<char> *sink) : fd(-1), sink(sink) {}
 
-void init_colors();
+    bool init() override;
+    void shutdown() override;
+    void resize(int width, int height) override;
+    bool supports_subcells() const override { return true; }
+    void print_run(const FrameBuffer &fb, int y, int x_begin, int x_end) override;
+    void flush() override;
 
-// Draws/Renders one column of the wall with each call
-void colored_draw_wall_column(int x, int ceiling, int floor, float distanceToWall);
+private:
+    void append(const char *text, size_t length);
+    void append_uint(unsigned value);
+    void write_all(const char *data, size_t length);
 
-// Secondary version of function with similar name
-// Holds more shades of gray than the other version of this function.
-void colored_draw_wall_column_2(int x, int ceiling, int floor, float distanceToWall);
+    int fd;                // Where to write to
+    std::vector<char> *sink = nullptr; // Or where to append to, if not nullptr
+    std::vector<char> out; // Allocated up front, big enough for a full frame
+    size_t out_length = 0;
+    short current_pair = -1; // Color pair last switched to, -1 = unknown
+};
 
-// Draws/Renders the colored ceiling and floor
-// ( Needs only to be called once per frame
-//   not once per column drawn.
-//   Also important that its called before wall is rendered
-//   as Wall is meant to be rendered ontop of what is rendered
-//   by this function. )
-void colored_draw_ceiling_and_floor();
+#endif
@@ -0,0 +1,443 @@
+#include "server.h"
+#include "camera.h"
+#include "globals.h"
+#include "input.h"
+#include "map.h"
+#include "presenter.h"
+#include "profiler.h"
+#include "rendering.h"
+#include "session.h"
+#include "simulation.h"
+#include "thread_pool.h"
+#include "view.h"
+#include <algorithm> // max, remove_if
+#include <cerrno> // errno
+#include <chrono> // steady_clock
+#include <csignal> // signal
+#include <cstdio> // printf, snprintf
+#include <cstring> // memset, strerror
+#include <memory> // unique_ptr
+#include <vector> // vector
+#include <fcntl.h> // fcntl
+#include <netdb.h> // getaddrinfo
+#include <netinet/in.h> // IPPROTO_TCP
+#include <netinet/tcp.h> // TCP_NODELAY
+#include <poll.h> // poll
+#include <sys/socket.h> // socket, bind, listen, accept, send, recv
+#include <sys/un.h> // sockaddr_un
+#include <unistd.h> // close, unlink
+
+// Set when the server has been asked to stop (Ctrl-C)
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop_signal(int)
+{
+    stop_requested = 1;
+}
+
+struct Client
+{
+    int fd = -1;
+    int id = 0; // Number shown in the log and on the status rows
+
+    KeyParser parser;             // Key events in the bytes the client sends
+    std::vector<KeyEvent> events; // Scratch space for 'parse_key_bytes'
+    Session session;
+    PlayerState drawn_player;     // Player in the last frame sent
+
+    Camera camera;
+    Presenter presenter;
+    std::vector<char> output; // Bytes printed for the client, not sent yet
+    size_t output_sent = 0;   // Bytes at the start of 'output' already sent
+    AnsiBackend backend{&output};
+
+    bool closing = false; // Sent its last bytes (Ctrl-C), drop once they are gone
+    bool failed = false;  // Connection broke, drop right away
+};
+
+static void set_nonblocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+// Creates a socket listening on 'address' (see ServerOptions). Returns its
+// file descriptor, or -1 with 'error' set. 'unix_path' is set to the path of
+// a Unix socket, so it can be removed again.
+static int open_listener(const std::string &address, std::string &error, std::string &unix_path)
+{
+    if (address.compare(0, 5, "unix:") == 0)
+    {
+        std::string path = address.substr(5);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path))
+        {
+            error = "Unix socket path '" + path + "' is empty or too long";
+            return -1;
+        }
+        memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0)
+        {
+            error = "Could not listen on '" + path + "': " + strerror(errno);
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            return -1;
+        }
+        unix_path = path;
+        set_nonblocking(fd);
+        return fd;
+    }
+
+    // "HOST:PORT" or just "PORT"
+    size_t colon = address.rfind(':');
+    std::string host = (colon == std::string::npos) ? "127.0.0.1" : address.substr(0, colon);
+    std::string port = (colon == std::string::npos) ? address : address.substr(colon + 1);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    struct addrinfo *addresses = nullptr;
+    int result = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &addresses);
+    if (result != 0)
+    {
+        error = "Could not resolve '" + address + "': " + gai_strerror(result);
+        return -1;
+    }
+
+    int fd = -1;
+    error = "Could not listen on '" + address + "'";
+    for (struct addrinfo *ai = addresses; ai != nullptr; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+        {
+            continue;
+        }
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 16) == 0)
+        {
+            break;
+        }
+        error = "Could not listen on '" + address + "': " + strerror(errno);
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd >= 0)
+    {
+        set_nonblocking(fd);
+    }
+    return fd;
+}
+
+// Sends as much of the client's output as the connection takes right now
+static void send_output(Client &client)
+{
+    while (client.output_sent < client.output.size())
+    {
+        ssize_t sent = send(client.fd, client.output.data() + client.output_sent,
+                            client.output.size() - client.output_sent, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                client.failed = true;
+            }
+            return;
+        }
+        client.output_sent += sent;
+    }
+    // All sent, keep the capacity for the next frame
+    client.output.clear();
+    client.output_sent = 0;
+}
+
+// Reads what the client sent, and hands the key events to its session
+static void receive_input(Client &client)
+{
+    unsigned char bytes[256];
+    while (true)
+    {
+        ssize_t count = recv(client.fd, bytes, sizeof(bytes), 0);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return;
+        }
+        if (count <= 0)
+        {
+            client.failed = true; // Closed or broken
+            return;
+        }
+
+        client.events.clear();
+        parse_key_bytes(client.parser, bytes, (int)count, std::chrono::steady_clock::now(), client.events);
+        for (const KeyEvent &event : client.events)
+        {
+            session_key_event(client.session, event);
+        }
+    }
+}
+
+// Takes the client's terminal over the way AnsiBackend does our own
+static void start_client(Client &client, const ServerOptions &options, std::chrono::steady_clock::time_point now)
+{
+    client.session.textured = options.textured;
+    client.session.subcells = options.subcells;
+    client.session.subcells_supported = client.backend.supports_subcells();
+    session_init(client.session, PlayerState{options.map->start_x, options.map->start_y, START_ANGLE}, now);
+    client.drawn_player = client.session.sim.current;
+
+    presenter_resize(client.presenter, screen_width, screen_height + STATUS_ROWS);
+    client.backend.resize(screen_width, screen_height + STATUS_ROWS);
+    client.backend.init();
+    client.output.insert(client.output.end(), KITTY_KEYBOARD_ON, KITTY_KEYBOARD_ON + strlen(KITTY_KEYBOARD_ON));
+}
+
+// Gives the client's terminal back, and sends what is left of its output
+static void stop_client(Client &client)
+{
+    client.output.insert(client.output.end(), KITTY_KEYBOARD_OFF, KITTY_KEYBOARD_OFF + strlen(KITTY_KEYBOARD_OFF));
+    client.backend.shutdown();
+    client.closing = true;
+    send_output(client);
+}
+
+// Renders the client's view and prints what changed into its output
+static void draw_client(Client &client, const ServerOptions &options, PlayerState player, int num_clients,
+                        ThreadPool &pool, ViewBuffers &view_buffers)
+{
+    Session &session = client.session;
+    FrameBuffer &screen = client.presenter.back;
+
+    ViewSettings view_settings;
+    view_settings.raycaster = options.raycaster;
+    view_settings.colored_output = session.colored_output;
+    view_settings.textures = session.textured ? options.textures : nullptr;
+    view_settings.subcells = session.subcells;
+    view_settings.sprites = options.sprites;
+    view_settings.lights = options.lights;
+    camera_resize(client.camera, view_columns(view_settings), options.fov);
+    if (client.camera.angle != player.angle)
+    {
+        camera_set_angle(client.camera, player.angle);
+    }
+    render_view(*options.map, player.x, player.y, client.camera, view_settings, pool, view_buffers, screen);
+
+    for (int y = screen_height; y < screen.height; ++y)
+    {
+        fb_fill_row(screen, 0, y, screen.width, Cell{' ', 0});
+    }
+    char line[256];
+    double frame_ms = profiler_stats(STAGE_FRAME).last;
+    double idle_ms = profiler_stats(STAGE_IDLE).last;
+    snprintf(line, sizeof(line), "Server FrameTime: %.3f ms (%.3f ms not waiting)", frame_ms, frame_ms - idle_ms);
+    fb_print(screen, 0, screen_height, line, 0);
+    snprintf(line, sizeof(line), "client %d of %d connected, cells sent = %d", client.id, num_clients,
+             client.presenter.cells_printed);
+    fb_print(screen, 0, screen_height + 1, line, 0);
+    snprintf(line, sizeof(line), "player pos (x,y) = %.3f,%.3f playerA = %.3f", player.x, player.y, player.angle);
+    fb_print(screen, 0, screen_height + 2, line, 0);
+
+    if (session.display_map)
+    {
+        draw_map_overlay(*options.map, player.x, player.y, screen);
+    }
+    if (session.display_profiler)
+    {
+        profiler_draw_overlay(screen, screen_width - PROFILER_OVERLAY_WIDTH, 0);
+    }
+
+    ScopedTimer present_timer(STAGE_PRESENT);
+    present(client.presenter, client.backend);
+}
+
+int run_server(const ServerOptions &options)
+{
+    std::string error;
+    std::string unix_path;
+    int listen_fd = open_listener(options.address, error, unix_path);
+    if (listen_fd < 0)
+    {
+        printf("%s\n", error.c_str());
+        return 1;
+    }
+    printf("Serving %dx%d frames on '%s' at %d fps, Ctrl-C stops the server.\n", screen_width,
+           screen_height + STATUS_ROWS, options.address.c_str(), options.frame_cap);
+    std::string connect = !unix_path.empty() ? "UNIX-CONNECT:" + unix_path
+                        : (options.address.find(':') == std::string::npos) ? "TCP:127.0.0.1:" + options.address
+                        : "TCP:" + options.address;
+    printf("Connect from a terminal at least that big with:  socat -,raw,echo=0 %s\n", connect.c_str());
+    fflush(stdout);
+
+    stop_requested = 0;
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+
+    ThreadPool pool(options.threads);
+    ViewBuffers view_buffers; // Shared, clients are rendered one after the other
+    std::vector<std::unique_ptr<Client>> clients;
+    std::vector<struct pollfd> fds;
+    int next_id = 1;
+
+    auto frame_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>((options.frame_cap > 0) ? 1.0 / options.frame_cap : 0.0));
+    auto next_frame = std::chrono::steady_clock::now();
+
+    while (!stop_requested)
+    {
+        profiler_begin_frame();
+        ScopedTimer frame_timer(STAGE_FRAME);
+
+        // Move every player up to now. (Their key events were handled as they came in)
+        auto now = std::chrono::steady_clock::now();
+        {
+            ScopedTimer input_timer(STAGE_INPUT);
+            for (std::unique_ptr<Client> &client : clients)
+            {
+                session_update(client->session, *options.map, now);
+                if (client->session.quit && !client->closing)
+                {
+                    printf("Client %d left\n", client->id);
+                    stop_client(*client);
+                }
+            }
+        }
+
+        // Render for every client that is ready for a new frame and has
+        // something new to see, and start sending it
+        for (std::unique_ptr<Client> &client : clients)
+        {
+            Session &session = client->session;
+            if (client->closing || client->failed || !client->output.empty())
+            {
+                continue;
+            }
+            PlayerState player = sim_interpolate(session.sim);
+            if (!session.redraw && !session.display_profiler && player == client->drawn_player &&
+                !client->presenter.full_redraw)
+            {
+                continue;
+            }
+            draw_client(*client, options, player, (int)clients.size(), pool, view_buffers);
+            client->drawn_player = player;
+            session.redraw = false;
+            send_output(*client);
+        }
+
+        // Drop clients that are gone
+        clients.erase(std::remove_if(clients.begin(), clients.end(), [](const std::unique_ptr<Client> &client)
+        {
+            if (client->failed && !client->closing)
+            {
+                printf("Client %d disconnected\n", client->id);
+            }
+            bool drop = client->failed || (client->closing && client->output.empty());
+            if (drop)
+            {
+                close(client->fd);
+            }
+            return drop;
+        }), clients.end());
+        fflush(stdout);
+
+        // Until the next frame is due: accept clients, read their keys and
+        // send them what is left of their frames, as the sockets get ready
+        ScopedTimer idle_timer(STAGE_IDLE);
+        next_frame = std::max(next_frame + frame_interval, std::chrono::steady_clock::now());
+        while (!stop_requested)
+        {
+            fds.clear();
+            fds.push_back(pollfd{listen_fd, POLLIN, 0});
+            for (std::unique_ptr<Client> &client : clients)
+            {
+                short wanted = POLLIN | (client->output.empty() ? 0 : POLLOUT);
+                fds.push_back(pollfd{client->fd, wanted, 0});
+            }
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                next_frame - std::chrono::steady_clock::now() + std::chrono::microseconds(999));
+            if (poll(fds.data(), fds.size(), std::max(0, (int)wait.count())) <= 0)
+            {
+                break; // Time for the next frame (or interrupted by a signal)
+            }
+
+            for (size_t i = 1; i < fds.size(); ++i)
+            {
+                Client &client = *clients[i - 1];
+                if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+                {
+                    receive_input(client);
+                }
+                if ((fds[i].revents & POLLOUT) && !client.failed)
+                {
+                    send_output(client);
+                }
+            }
+
+            if (fds[0].revents & POLLIN)
+            {
+                int fd;
+                while ((fd = accept(listen_fd, nullptr, nullptr)) >= 0)
+                {
+                    if (clients.size() >= SERVER_MAX_CLIENTS)
+                    {
+                        const char *full = "Server is full\r\n";
+                        ssize_t sent = send(fd, full, strlen(full), MSG_NOSIGNAL);
+                        (void)sent;
+                        close(fd);
+                        continue;
+                    }
+                    set_nonblocking(fd);
+                    int on = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // Fails harmlessly on Unix sockets
+
+                    std::unique_ptr<Client> client(new Client());
+                    client->fd = fd;
+                    client->id = next_id++;
+                    start_client(*client, options, std::chrono::steady_clock::now());
+                    send_output(*client);
+                    printf("Client %d connected (%d connected)\n", client->id, (int)clients.size() + 1);
+                    clients.push_back(std::move(client));
+                }
+            }
+            fflush(stdout);
+
+            if (std::chrono::steady_clock::now() >= next_frame)
+            {
+                break;
+            }
+        }
+    }
+
+    // Give every client its terminal back before going
+    for (std::unique_ptr<Client> &client : clients)
+    {
+        if (!client->closing && !client->failed)
+        {
+            stop_client(*client);
+        }
+        close(client->fd);
+    }
+    close(listen_fd);
+    if (!unix_path.empty())
+    {
+        unlink(unix_path.c_str());
+    }
+    printf("Server stopped\n");
+    return 0;
+}
@@ -0,0 +1,60 @@
+// server.h - Server mode (--serve). Serves the game to any number of players
+//            at once over TCP or a Unix socket, instead of playing it in
+//            this terminal. Every client is a terminal of its own (connected
+//            with something like "socat -,raw,echo=0 TCP:localhost:7777"):
+//            it sends its key presses, and gets its frames back as ANSI
+//            escape sequences.
+//
+// ---- SESSIONS: ----
+// Each client has its own Session (player, held keys, display toggles, see
+// session.h) and its own Presenter, so it is only sent the cells that
+// changed on its screen since its last frame. All clients walk around the
+// same map, and get frames of the same size ('screen_width', 'screen_height').
+//
+// ---- FRAMES: ----
+// Once per frame (--fps) the server moves every player, and renders a frame
+// for each client whose player or toggles changed. The screen columns of each
+// of those frames are raycast in parallel on one shared thread pool. Frames
+// are printed into the client's output buffer with an AnsiBackend, and sent
+// from there with non-blocking writes, while waiting for the next frame.
+// A client that hasn't taken all of its last frame yet (slow connection)
+// isn't rendered for until it has, then it gets the latest frame straight
+// away instead of every frame it missed.
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "raycast.h" // Raycaster
+#include "subcell.h" // SubcellMode
+#include <string> // std::string
+
+// Most clients connected at once, more are turned away
+#define SERVER_MAX_CLIENTS 64
+
+class Map;
+struct LightMap;
+struct Sprites;
+struct TextureAtlas;
+
+struct ServerOptions
+{
+    // Where to listen: "PORT" or "HOST:PORT" for TCP (HOST is 127.0.0.1 if
+    // left out, only reachable from this machine), "unix:PATH" for a Unix socket
+    std::string address;
+    const Map *map = nullptr;               // Map every client plays on
+    const TextureAtlas *textures = nullptr; // Textures for clients that switch them on
+    const Sprites *sprites = nullptr;       // Sprites on the map
+    const LightMap *lights = nullptr;       // Light baked for the map, unlit if nullptr
+    bool textured = false;                  // Clients start out with textured walls
+    SubcellMode subcells = SUBCELL_NONE;    // Sub-cell mode clients start out in
+    float fov = 0.0f;                       // Field of view angle, in radians
+    Raycaster raycaster = RAYCASTER_AUTO;   // How the screen columns are raycast
+    int threads = 1;                        // Threads to raycast the columns on
+    int frame_cap = 60;                     // Frames per second, as fast as possible if 0
+};
+
+// Runs the server until Ctrl-C (SIGINT) or SIGTERM, and prints clients
+// connecting and leaving to stdout. Returns exit code for the program.
+int run_server(const ServerOptions &options);
+
+#endif
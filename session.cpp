@@ -0,0 +1,67 @@
+#include "session.h"
+#include "map.h"
+
+void session_init(Session &session, PlayerState start, std::chrono::steady_clock::time_point now)
+{
+    sim_init(session.sim, start);
+    session.keys = KeyStates();
+    session.last_update = now;
+    session.quit = false;
+    session.redraw = true;
+}
+
+void session_key_event(Session &session, const KeyEvent &event)
+{
+    key_states_update(session.keys, event);
+    if (event.type != KEY_EVENT_PRESS && event.type != KEY_EVENT_TEXT)
+    {
+        // Toggles only on the first press, not while the key repeats
+        return;
+    }
+
+    int key = event.key;
+    if (key == KEY_CTRL_C) // Quit (only a key with the kitty keyboard protocol, else a signal)
+    {
+        session.quit = true;
+    }
+    else if (key == 'v') // Switch visual mode (toggle between ascii and colorized drawing)
+    {
+        session.colored_output = !session.colored_output;
+        session.redraw = true;
+    }
+    else if (key == 't') // Toggle textured walls
+    {
+        session.textured = !session.textured;
+        session.redraw = true;
+    }
+    else if (key == 'h' && session.subcells_supported) // Next sub-cell mode (none, half, quad)
+    {
+        session.subcells = (SubcellMode)((session.subcells + 1) % NUM_SUBCELL_MODES);
+        session.redraw = true;
+    }
+    else if (key == 'm') // Toggle display map
+    {
+        session.display_map = !session.display_map;
+        session.redraw = true;
+    }
+    else if (key == 'p') // Toggle display of frame timings
+    {
+        session.display_profiler = !session.display_profiler;
+        session.redraw = true;
+    }
+}
+
+void session_update(Session &session, const Map &map, std::chrono::steady_clock::time_point now)
+{
+    KeyStates &keys = session.keys;
+    Simulation &sim = session.sim;
+    sim_set_action(sim, ACTION_TURN_LEFT, key_held(keys, 'k', now));     // rotate ccw
+    sim_set_action(sim, ACTION_TURN_RIGHT, key_held(keys, 'l', now));    // rotate cw
+    sim_set_action(sim, ACTION_FORWARD, key_held(keys, 'w', now));       // move forwards
+    sim_set_action(sim, ACTION_BACKWARD, key_held(keys, 's', now));      // move backwards
+    sim_set_action(sim, ACTION_STRAFE_LEFT, key_held(keys, 'a', now));   // strafe left
+    sim_set_action(sim, ACTION_STRAFE_RIGHT, key_held(keys, 'd', now));  // strafe right
+
+    sim_advance(sim, map, std::chrono::duration<double>(now - session.last_update).count());
+    session.last_update = now;
+}
@@ -0,0 +1,55 @@
+// session.h - State of one game session: where the player is (the
+//             simulation), which keys are held down, and what is shown
+//             (the display toggles). Key events and the passing of time are
+//             applied to it the same way whether they come from the
+//             terminal or from a recording being replayed (see recording.h).
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "input.h" // KeyEvent, KeyStates
+#include "simulation.h" // Simulation, PlayerState
+#include "subcell.h" // SubcellMode
+#include <chrono> // steady_clock
+
+class Map;
+
+struct Session
+{
+    Simulation sim;
+    KeyStates keys;
+    std::chrono::steady_clock::time_point last_update; // Time simulated up to
+
+    // True = Colorized rendering/output
+    // False = Pure ascii (white text on black background) rendering/output
+    bool colored_output = true;
+    // True = Walls are drawn with textures
+    // False = Walls are flat shaded by distance
+    bool textured = false;
+    // Draw at a higher resolution than the terminal, with block characters
+    SubcellMode subcells = SUBCELL_NONE;
+    // False if the terminal can't draw sub-cells, then H does nothing
+    bool subcells_supported = true;
+    // True = Display map
+    // False = Don't display map
+    bool display_map = false;
+    // True = Display table of how long each stage of the frame takes
+    // False = Don't display it
+    bool display_profiler = false;
+
+    bool quit = false;   // Ctrl-C was pressed (as a key, see KEY_CTRL_C)
+    bool redraw = true;  // Something other than the player changed that shows on
+                         // screen (a toggle key was pressed), cleared by the caller
+};
+
+// Starts 'session' with the player at 'start' at time 'now'.
+// (Leaves the toggles as they are)
+void session_init(Session &session, PlayerState start, std::chrono::steady_clock::time_point now);
+
+// Handles 'event': keeps track of held keys, and flips the toggles on key presses
+void session_key_event(Session &session, const KeyEvent &event);
+
+// Moves and turns the player for as long as the keys are held, up to 'now'
+void session_update(Session &session, const Map &map, std::chrono::steady_clock::time_point now);
+
+#endif
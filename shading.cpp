@@ -0,0 +1,382 @@
+#include "shading.h"
+#include <cmath> // INFINITY
+#include <cstdio> // snprintf
+#include <fstream> // ifstream
+#include <sstream> // istringstream
+#include <algorithm> // min
+
+Palette palette = []()
+{
+    Palette built_in;
+    default_palette(built_in);
+    return built_in;
+}();
+ShadeTables shade_tables;
+
+// Everything past the last step of a gradient
+#define GRADIENT_END INFINITY
+
+void default_palette(Palette &palette)
+{
+    // ncurses has colors from 1 to 8 already predefined,
+    // so lets start from 9 (eventhough we could just override
+    // the predefined 1 to 8 colors with init_color call probably)
+    palette.colors =
+    {
+        // foreground color (only because its neccessary for init_pair)
+        { 9, 255, 255, 255},
+
+        // Wall background colors/shades
+        // (From brightest to darkest)
+        {10, 584, 584, 686},
+        {11, 529, 529, 623},
+        {12, 474, 474, 561},
+        {13, 423, 423, 498},
+        {14, 368, 368, 435},
+        {15, 318, 318, 372},
+        {16, 263, 263, 310},
+        {17, 212, 212, 247},
+        {18, 157, 157, 184},
+        {19, 104, 104, 121},
+        {20,  50,  50,  59},
+
+        {21, 614, 614, 716},
+        {22, 559, 559, 653},
+        {23, 494, 494, 591},
+        {24, 453, 453, 528},
+        {25, 398, 398, 465},
+
+        // Sprite background colors/shades
+        // (From brightest to darkest)
+        {40, 545, 600, 310},
+        {41, 475, 525, 270},
+        {42, 410, 455, 235},
+        {43, 345, 385, 200},
+        {44, 280, 315, 160},
+        {45, 215, 240, 125},
+        {46, 150, 170,  90},
+        {47,  90, 100,  50},
+
+        // Floor and Ceiling background colors/shades
+        // (From brightest to darkest)
+        {30, 498, 165, 98},
+        {31, 435, 145, 86},
+        {32, 372, 122, 74},
+        {33, 310, 102, 59},
+        {34, 247,  82, 47},
+        {35, 184,  59, 35},
+        {36, 122,  39, 24},
+        {37,  47,  16,  8},
+    };
+
+    palette.pairs =
+    {
+        // Wall shades
+        {10, 9, 10}, {11, 9, 11}, {12, 9, 12}, {13, 9, 13},
+        {14, 9, 14}, {15, 9, 15}, {16, 9, 16}, {17, 9, 17},
+        {18, 9, 18}, {19, 9, 19}, {20, 9, 20},
+
+        {21, 9, 21}, {22, 9, 22}, {23, 9, 23}, {24, 9, 24}, {25, 9, 25},
+
+        // Sprite shades
+        {40, 9, 40}, {41, 9, 41}, {42, 9, 42}, {43, 9, 43},
+        {44, 9, 44}, {45, 9, 45}, {46, 9, 46}, {47, 9, 47},
+
+        // Floor/Ceiling shades
+        {30, 9, 30}, {31, 9, 31}, {32, 9, 32}, {33, 9, 33},
+        {34, 9, 34}, {35, 9, 35}, {36, 9, 36}, {37, 9, 37},
+    };
+
+    palette.gradients[GRADIENT_WALL] =
+    {
+        {0.05f, 10}, {0.1f, 11}, {0.15f, 12}, {0.2f, 13}, {0.25f, 14}, {0.3f, 15},
+        {0.35f, 16}, {0.4f, 17}, {0.45f, 18}, {0.5f, 19}, {0.6f, 20},
+        // Make the shade for longest distance to wall the same
+        // as the longest distance/darkest shade for ceiling/floor
+        // so that the most distant wall just blends into the background.
+        {GRADIENT_END, 37},
+    };
+
+    // Goes from brightest to darkest, or to be more exact, from shade
+    // at closest distance to wall to shade at longest or infinite distance to wall.
+    palette.gradients[GRADIENT_WALL_ASCII] =
+    {
+        {1.0f / 6, '@'}, {2.0f / 6, '%'}, {3.0f / 6, '#'}, {4.0f / 6, '*'},
+        {5.0f / 6, '='}, {1.0f, '-'}, {GRADIENT_END, ' '},
+    };
+
+    palette.gradients[GRADIENT_CEILING_FLOOR] =
+    {
+        {0.02f, 30}, {0.05f, 31}, {0.08f, 32}, {0.13f, 33},
+        {0.16f, 34}, {0.20f, 35}, {0.25f, 36}, {GRADIENT_END, 37},
+    };
+
+    palette.gradients[GRADIENT_FLOOR_ASCII] =
+    {
+        {0.4f, '+'}, {GRADIENT_END, '.'},
+    };
+
+    // Like the wall gradient, fading into the darkest floor shade far away
+    palette.gradients[GRADIENT_SPRITE] =
+    {
+        {0.1f, 40}, {0.2f, 41}, {0.3f, 42}, {0.4f, 43}, {0.5f, 44},
+        {0.6f, 45}, {0.7f, 46}, {0.85f, 47}, {GRADIENT_END, 37},
+    };
+}
+
+const PaletteColor *find_palette_color(const Palette &palette, short id)
+{
+    for (const PaletteColor &color : palette.colors)
+    {
+        if (color.id == id)
+        {
+            return &color;
+        }
+    }
+    return nullptr;
+}
+
+const PalettePair *find_palette_pair(const Palette &palette, short id)
+{
+    for (const PalettePair &pair : palette.pairs)
+    {
+        if (pair.id == id)
+        {
+            return &pair;
+        }
+    }
+    return nullptr;
+}
+
+static const char *gradient_names[NUM_GRADIENTS] = {"wall", "wall_ascii", "ceiling_floor", "floor_ascii", "sprite"};
+
+// True for gradients of characters, false for gradients of color pairs
+static bool is_ascii_gradient(int gradient)
+{
+    return gradient == GRADIENT_WALL_ASCII || gradient == GRADIENT_FLOOR_ASCII;
+}
+
+// Checks that everything in 'palette' refers to things that exist, and
+// that the gradients are in order. Returns false, and what's wrong in 'error', if not.
+static bool check_palette(const Palette &palette, std::string &error)
+{
+    char message[128];
+    for (const PalettePair &pair : palette.pairs)
+    {
+        if (find_palette_color(palette, pair.fg) == nullptr || find_palette_color(palette, pair.bg) == nullptr)
+        {
+            snprintf(message, sizeof(message), "color pair %d uses a color that isn't defined", pair.id);
+            error = message;
+            return false;
+        }
+    }
+    for (int gradient = 0; gradient < NUM_GRADIENTS; ++gradient)
+    {
+        const std::vector<GradientStop> &stops = palette.gradients[gradient];
+        for (size_t i = 0; i < stops.size(); ++i)
+        {
+            if (i > 0 && stops[i].limit <= stops[i - 1].limit)
+            {
+                snprintf(message, sizeof(message), "steps of gradient '%s' aren't in increasing order", gradient_names[gradient]);
+                error = message;
+                return false;
+            }
+            if (!is_ascii_gradient(gradient) && find_palette_pair(palette, stops[i].value) == nullptr)
+            {
+                snprintf(message, sizeof(message), "gradient '%s' uses color pair %d that isn't defined",
+                         gradient_names[gradient], stops[i].value);
+                error = message;
+                return false;
+            }
+        }
+        if (stops.empty() || stops.back().limit != GRADIENT_END)
+        {
+            snprintf(message, sizeof(message), "gradient '%s' must end with a '*' step", gradient_names[gradient]);
+            error = message;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool load_palette(const std::string &path, Palette &palette, std::string &error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = "could not open '" + path + "'";
+        return false;
+    }
+
+    default_palette(palette);
+    bool replaced[NUM_GRADIENTS] = {};
+
+    std::string line;
+    for (int line_number = 1; std::getline(file, line); ++line_number)
+    {
+        std::istringstream words(line);
+        std::string kind;
+        if (!(words >> kind) || kind[0] == '#')
+        {
+            continue;
+        }
+        error = "line " + std::to_string(line_number) + ": ";
+
+        if (kind == "color")
+        {
+            PaletteColor color;
+            if (!(words >> color.id >> color.r >> color.g >> color.b))
+            {
+                error += "expected 'color ID R G B'";
+                return false;
+            }
+            PaletteColor *existing = (PaletteColor *)find_palette_color(palette, color.id);
+            if (existing != nullptr)
+            {
+                *existing = color;
+            }
+            else
+            {
+                palette.colors.push_back(color);
+            }
+            continue;
+        }
+        if (kind == "pair")
+        {
+            PalettePair pair;
+            if (!(words >> pair.id >> pair.fg >> pair.bg))
+            {
+                error += "expected 'pair ID FG BG'";
+                return false;
+            }
+            PalettePair *existing = (PalettePair *)find_palette_pair(palette, pair.id);
+            if (existing != nullptr)
+            {
+                *existing = pair;
+            }
+            else
+            {
+                palette.pairs.push_back(pair);
+            }
+            continue;
+        }
+
+        int gradient = 0;
+        while (gradient < NUM_GRADIENTS && kind != gradient_names[gradient])
+        {
+            ++gradient;
+        }
+        if (gradient == NUM_GRADIENTS)
+        {
+            error += "unknown entry '" + kind + "'";
+            return false;
+        }
+
+        GradientStop stop;
+        std::string limit;
+        if (!(words >> limit))
+        {
+            error += "expected '" + kind + " LIMIT VALUE'";
+            return false;
+        }
+        if (limit == "*")
+        {
+            stop.limit = GRADIENT_END;
+        }
+        else
+        {
+            try
+            {
+                stop.limit = std::stof(limit);
+            }
+            catch (const std::exception &e)
+            {
+                error += "could not parse limit '" + limit + "'";
+                return false;
+            }
+        }
+
+        if (is_ascii_gradient(gradient))
+        {
+            // Character in single quotes (can be a space, so not read as a word)
+            std::string rest;
+            std::getline(words, rest);
+            size_t quote = rest.find('\'');
+            if (quote == std::string::npos || quote + 2 >= rest.size() || rest[quote + 2] != '\'')
+            {
+                error += "expected a character in single quotes, like '#'";
+                return false;
+            }
+            stop.value = rest[quote + 1];
+        }
+        else if (!(words >> stop.value))
+        {
+            error += "expected color pair id";
+            return false;
+        }
+
+        if (!replaced[gradient])
+        {
+            palette.gradients[gradient].clear();
+            replaced[gradient] = true;
+        }
+        palette.gradients[gradient].push_back(stop);
+    }
+
+    return check_palette(palette, error);
+}
+
+short gradient_value(const std::vector<GradientStop> &gradient, float position)
+{
+    for (const GradientStop &stop : gradient)
+    {
+        if (position < stop.limit)
+        {
+            return stop.value;
+        }
+    }
+    return gradient.back().value;
+}
+
+void shade_tables_build(int height)
+{
+    // Each entry gets the value at the near end of the distances it covers
+    for (int i = 0; i <= SHADE_TABLE_SIZE; ++i)
+    {
+        float sight_distance = (float)i / SHADE_TABLE_SIZE;
+        shade_tables.wall[i] = gradient_value(palette.gradients[GRADIENT_WALL], sight_distance);
+        shade_tables.wall_ascii[i] = gradient_value(palette.gradients[GRADIENT_WALL_ASCII], sight_distance);
+        shade_tables.sprite[i] = gradient_value(palette.gradients[GRADIENT_SPRITE], sight_distance);
+    }
+    shade_rows_build(height);
+}
+
+void shade_rows_build(int height)
+{
+    shade_tables.height = height;
+    shade_tables.background.resize(height);
+    shade_tables.background_ascii.resize(height);
+    for (int y = 0; y < height; ++y)
+    {
+        // Precentage value of how far the row is from the top or bottom of screen
+        // ( This is to make sure where shadings start/end
+        //   scales in accordance to change in screen_width/height
+        // - 0.0f means top or bottom row of screen, 0.5f means the middle
+        float edge_distance = std::min(y, height - y) / (float)height;
+        shade_tables.background[y] = Cell{' ', gradient_value(palette.gradients[GRADIENT_CEILING_FLOOR], edge_distance)};
+
+        // In ascii the ceiling is blank. Walls are centered, so rows in
+        // the top half can only be ceiling and rows in the bottom half floor.
+        if (y < height / 2.0f)
+        {
+            shade_tables.background_ascii[y] = Cell{' ', 0};
+        }
+        else
+        {
+            // precentage of how far down on screen the row is.
+            // 1.0f means its in the very middle of screen, 0.0f means its at the very bottom.
+            float b = 1.0f - (((float)y - height / 2.0f) / ((float)height / 2.0f));
+            shade_tables.background_ascii[y] = Cell{(char)gradient_value(palette.gradients[GRADIENT_FLOOR_ASCII], b), 0};
+        }
+    }
+}
@@ -0,0 +1,161 @@
+// shading.h - The palette (colors, color pairs and shade gradients) the view
+//             is drawn with, and the lookup tables built from it.
+//
+// A gradient is a list of steps, each one a limit and a value (a color pair,
+// or a character for the ascii gradients). A position gets the value of the
+// first step whose limit it is below. Instead of walking through the steps for
+// every column or row drawn, each gradient is turned into a table up front,
+// so shading is a single lookup.
+//
+// ---- PALETTE FILE FORMAT: ----
+// One entry per line, lines starting with '#' are comments. Starts out from
+// the built in palette, so a file only needs the parts it changes.
+// color ID R G B        = Define (or redefine) color ID, channels 0-1000.
+//                         Ids 1-8 are the terminal's own colors, use 9 and up.
+// pair ID FG BG         = Define (or redefine) color pair ID out of two colors
+// GRADIENT LIMIT VALUE  = Step of a gradient, positions below LIMIT (and not
+//                         below any earlier step) get VALUE. Steps must come
+//                         in increasing order, and the last one must have
+//                         LIMIT '*' (everything else). The first step of a
+//                         gradient in a file replaces all of its built in steps.
+// Gradients (and what position they go by):
+// wall          = Color pair by distance to wall / MAX_DEPTH
+// wall_ascii    = Character by distance to wall / MAX_DEPTH
+// ceiling_floor = Color pair by distance from top or bottom edge of the
+//                 view, as fraction of view height (0.0 to 0.5)
+// floor_ascii   = Character by how far a floor row is from the bottom of
+//                 the view, as fraction of the way up to the middle (0.0 to 1.0)
+// sprite        = Color pair by distance to sprite / MAX_DEPTH (see sprite.h)
+// Characters are given in single quotes, like '#' or ' '.
+
+#ifndef SHADING_H
+#define SHADING_H
+
+#include "framebuffer.h" // Cell
+#include "globals.h" // MAX_DEPTH
+#include <string> // std::string
+#include <vector> // vector
+
+// Distance tables have this many entries, spread out evenly from 0 to MAX_DEPTH.
+// Steps at multiples of 1/40 and 1/6 of MAX_DEPTH land exactly on an entry.
+// One more entry after them (index SHADE_TABLE_SIZE) has the far end of the
+// gradient, for MAX_DEPTH and beyond (and rays that hit nothing).
+#define SHADE_TABLE_SIZE 1200
+
+// A color we define ourselves
+// r, g, b = rgb content min = 0, max = 1000 (same as ncurses init_color)
+struct PaletteColor
+{
+    short id;
+    short r, g, b;
+};
+
+// A pair out of a foreground (color of text) and
+// background (color of text background) color
+struct PalettePair
+{
+    short id;
+    short fg;
+    short bg;
+};
+
+// One step of a gradient
+struct GradientStop
+{
+    float limit; // Positions below this (and not below the step before) get 'value'
+    short value; // Color pair or character
+};
+
+enum Gradient
+{
+    GRADIENT_WALL,
+    GRADIENT_WALL_ASCII,
+    GRADIENT_CEILING_FLOOR,
+    GRADIENT_FLOOR_ASCII,
+    GRADIENT_SPRITE,
+    NUM_GRADIENTS
+};
+
+struct Palette
+{
+    std::vector<PaletteColor> colors;
+    std::vector<PalettePair> pairs;
+    std::vector<GradientStop> gradients[NUM_GRADIENTS];
+};
+
+// Palette the view is drawn with, the built in one unless another is loaded.
+// Load it before 'init_colors' and 'shade_tables_build' are called.
+extern Palette palette;
+
+// Fills 'palette' with the built in palette
+void default_palette(Palette &palette);
+
+// Loads a palette file on top of the built in palette, see format above.
+// Returns false, and a description of what went wrong in 'error', if it failed.
+bool load_palette(const std::string &path, Palette &palette, std::string &error);
+
+// Color of 'id' in 'palette', nullptr if there isn't one
+const PaletteColor *find_palette_color(const Palette &palette, short id);
+// Color pair 'id' in 'palette', nullptr if there isn't one
+const PalettePair *find_palette_pair(const Palette &palette, short id);
+
+// Value 'gradient' has at 'position'
+short gradient_value(const std::vector<GradientStop> &gradient, float position);
+
+// Number of distance table entries a texel with shade 1 is moved along the
+// wall gradient (1/20 of MAX_DEPTH, one step of the built in wall gradient)
+#define TEXEL_SHADE_STEP (SHADE_TABLE_SIZE / 20)
+
+// Tables built out of the gradients of 'palette'
+struct ShadeTables
+{
+    // Indexed by distance / MAX_DEPTH * SHADE_TABLE_SIZE (see 'shade_table_index')
+    short wall[SHADE_TABLE_SIZE + 1];
+    short wall_ascii[SHADE_TABLE_SIZE + 1];
+    short sprite[SHADE_TABLE_SIZE + 1];
+
+    // What each row of the view looks like where there is no wall in
+    // front, for a view 'height' rows high. Colored and ascii.
+    // (Columns are drawn by copying the rows above and below the wall from here)
+    int height = -1;
+    std::vector<Cell> background;
+    std::vector<Cell> background_ascii;
+};
+
+extern ShadeTables shade_tables;
+
+// Build the distance tables from 'palette', and the row tables
+// for a view 'height' rows high.
+void shade_tables_build(int height);
+
+// Rebuild only the row tables, for a view 'height' rows high (the distance
+// tables don't depend on it). Reuses their memory.
+void shade_rows_build(int height);
+
+// Build the tables if they aren't yet, or rebuild the row tables if view is
+// no longer 'height' rows high
+inline void shade_tables_resize(int height)
+{
+    if (shade_tables.height < 0)
+    {
+        shade_tables_build(height);
+    }
+    else if (height != shade_tables.height)
+    {
+        shade_rows_build(height);
+    }
+}
+
+// Index into the distance tables for 'distance'
+inline int shade_table_index(float distance)
+{
+    float sight_distance = distance / MAX_DEPTH;
+    if (!(sight_distance < 1.0f))
+    {
+        return SHADE_TABLE_SIZE; // Far end of the gradient
+    }
+    int index = (int)(sight_distance * SHADE_TABLE_SIZE);
+    return index < SHADE_TABLE_SIZE - 1 ? index : SHADE_TABLE_SIZE - 1;
+}
+
+#endif
@@ -0,0 +1,80 @@
+#include "simulation.h"
+#include "map.h"
+#include "physics.h" // move_and_slide, PLAYER_RADIUS
+#include <cmath> // sinf, cosf, sqrtf, fmod
+
+void sim_init(Simulation &sim, PlayerState start)
+{
+    sim = Simulation();
+    sim.previous = start;
+    sim.current = start;
+}
+
+void sim_set_action(Simulation &sim, Action action, bool on)
+{
+    sim.actions[action] = on;
+}
+
+// Moves the player one tick forward
+static void sim_tick(Simulation &sim, const Map &map)
+{
+    sim.previous = sim.current;
+    PlayerState &player = sim.current;
+
+    // +1, -1 or 0 if both or neither of the two opposite actions are going
+    auto direction = [&sim](Action positive, Action negative)
+    {
+        return (float)(sim.actions[positive] - sim.actions[negative]);
+    };
+    float turn = direction(ACTION_TURN_RIGHT, ACTION_TURN_LEFT);
+    float forward = direction(ACTION_FORWARD, ACTION_BACKWARD);
+    float strafe = direction(ACTION_STRAFE_RIGHT, ACTION_STRAFE_LEFT);
+
+    player.angle += turn * TURN_SPEED * (float)SIM_TICK;
+
+    // Right of the view direction (dirX, dirY) is (dirY, -dirX)
+    float dirX = sinf(player.angle);
+    float dirY = cosf(player.angle);
+    float step = MOVE_SPEED * (float)SIM_TICK;
+    // Moving forward and sideways at once goes no faster than either alone
+    float length = sqrtf(forward * forward + strafe * strafe);
+    if (length > 0.0f)
+    {
+        forward /= length;
+        strafe /= length;
+    }
+    // Slides along walls instead of stopping dead when walking into them at an angle
+    move_and_slide(map, player.x, player.y, (dirX * forward + dirY * strafe) * step,
+                   (dirY * forward - dirX * strafe) * step, PLAYER_RADIUS);
+
+    sim.time += SIM_TICK;
+}
+
+int sim_advance(Simulation &sim, const Map &map, double elapsed)
+{
+    sim.unsimulated += elapsed;
+    int ticks = 0;
+    while (sim.unsimulated >= SIM_TICK)
+    {
+        if (ticks == MAX_TICKS_PER_FRAME)
+        {
+            // Too far behind, drop the time we didn't get to
+            sim.unsimulated = fmod(sim.unsimulated, SIM_TICK);
+            break;
+        }
+        sim_tick(sim, map);
+        sim.unsimulated -= SIM_TICK;
+        ++ticks;
+    }
+    return ticks;
+}
+
+PlayerState sim_interpolate(const Simulation &sim)
+{
+    float t = (float)(sim.unsimulated / SIM_TICK);
+    const PlayerState &from = sim.previous;
+    const PlayerState &to = sim.current;
+    return PlayerState{from.x + (to.x - from.x) * t,
+                       from.y + (to.y - from.y) * t,
+                       from.angle + (to.angle - from.angle) * t};
+}
@@ -0,0 +1,77 @@
+// simulation.h - Moves the player in fixed time steps (ticks), independent of
+//                how often frames are drawn. Frames are drawn in between two
+//                ticks, with the player placed part of the way from the
+//                previous tick to the current one, so movement looks smooth
+//                at any frame rate.
+//
+// Which actions (moving, turning) are going is set by the game loop every
+// frame, from the keys held down (see input.h).
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+class Map;
+
+// Ticks per second
+#define SIM_TICK_RATE 60
+// Length of a tick, in seconds
+#define SIM_TICK (1.0 / SIM_TICK_RATE)
+// Most ticks run to catch up in one frame. If a frame took longer than this
+// (the process was stopped, say) the rest of that time is dropped instead of
+// running ticks for it all at once.
+#define MAX_TICKS_PER_FRAME 8
+
+// Tiles per second moved while a move key is held
+#define MOVE_SPEED 10.0f
+// Radians per second turned while a turn key is held
+#define TURN_SPEED 1.6f
+
+enum Action
+{
+    ACTION_FORWARD,
+    ACTION_BACKWARD,
+    ACTION_STRAFE_LEFT,
+    ACTION_STRAFE_RIGHT,
+    ACTION_TURN_LEFT,
+    ACTION_TURN_RIGHT,
+    NUM_ACTIONS
+};
+
+struct PlayerState
+{
+    float x;     // Position in map
+    float y;
+    float angle; // Angle of direction player is looking in (see camera.h)
+
+    bool operator==(const PlayerState &other) const
+    {
+        return x == other.x && y == other.y && angle == other.angle;
+    }
+    bool operator!=(const PlayerState &other) const { return !(*this == other); }
+};
+
+struct Simulation
+{
+    PlayerState previous; // Player after the tick before the last one
+    PlayerState current;  // Player after the last tick
+    double time = 0.0;    // Seconds simulated so far (ticks run * SIM_TICK)
+    double unsimulated = 0.0; // Seconds of real time not simulated yet (less than a tick)
+
+    // Actions going on, see 'sim_set_action'
+    bool actions[NUM_ACTIONS] = {};
+};
+
+// Start simulation with player at 'start'
+void sim_init(Simulation &sim, PlayerState start);
+
+// Start ('on' true) or stop doing 'action', from the next tick on
+void sim_set_action(Simulation &sim, Action action, bool on);
+
+// Runs the ticks that fit in the 'elapsed' seconds of real time since the
+// last call (plus what was left over then). Returns the number of ticks run.
+int sim_advance(Simulation &sim, const Map &map, double elapsed);
+
+// Player as it should be drawn now, in between the last two ticks
+PlayerState sim_interpolate(const Simulation &sim);
+
+#endif
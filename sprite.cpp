@@ -0,0 +1,347 @@
+#include "sprite.h"
+#include "map.h"
+#include <algorithm> // sort, min, max
+#include <cmath> // sqrtf, floorf
+
+// Builds a sprite image out of SPRITE_SIZE rows of characters and SPRITE_SIZE
+// rows of shades, the same as a texture (see texture.h), only a space in the
+// shades makes the texel see-through
+static SpriteImage make_sprite_image(float width, float height, const char *const glyphs[SPRITE_SIZE],
+                                     const char *const shades[SPRITE_SIZE])
+{
+    SpriteImage image;
+    image.width = width;
+    image.height = height;
+    for (int y = 0; y < SPRITE_SIZE; ++y)
+    {
+        for (int x = 0; x < SPRITE_SIZE; ++x)
+        {
+            char shade = shades[y][x];
+            image.texels[x * SPRITE_SIZE + y] =
+                Texel{glyphs[y][x], (int8_t)((shade >= '0' && shade <= '9') ? shade - '0' : SPRITE_TRANSPARENT)};
+        }
+    }
+    return image;
+}
+
+static const char *const barrel_glyphs[SPRITE_SIZE] =
+{
+    "   .--------.   ",
+    "  /          \\  ",
+    " |============| ",
+    " |            | ",
+    " |            | ",
+    " |            | ",
+    " |============| ",
+    " |            | ",
+    " |            | ",
+    " |            | ",
+    " |============| ",
+    " |            | ",
+    " |            | ",
+    " |            | ",
+    "  \\==========/  ",
+    "   '--------'   ",
+};
+static const char *const barrel_shades[SPRITE_SIZE] =
+{
+    "   2111111112   ",
+    "  211111111112  ",
+    " 21111111111112 ",
+    " 21000000000012 ",
+    " 21000000000012 ",
+    " 21000000000012 ",
+    " 21111111111112 ",
+    " 21000000000012 ",
+    " 21000000000012 ",
+    " 21000000000012 ",
+    " 21111111111112 ",
+    " 21000000000012 ",
+    " 21000000000012 ",
+    " 21000000000012 ",
+    "  211111111112  ",
+    "   2222222222   ",
+};
+
+static const char *const pillar_glyphs[SPRITE_SIZE] =
+{
+    "################",
+    " ============== ",
+    "  |  |    |  |  ",
+    "  |  |    |  |  ",
+    "  |  |    |  |  ",
+    "  |  |    |  |  ",
+    "  |  |    |  |  ",
+    "  |  |    |  |  ",
+    "  |  |    |  |  ",
+    "  |  |    |  |  ",
+    "  |  |    |  |  ",
+    "  |  |    |  |  ",
+    "  |  |    |  |  ",
+    "  |  |    |  |  ",
+    " ============== ",
+    "################",
+};
+static const char *const pillar_shades[SPRITE_SIZE] =
+{
+    "2111111111111112",
+    " 21111111111112 ",
+    "  210000000012  ",
+    "  210000000012  ",
+    "  210000000012  ",
+    "  210000000012  ",
+    "  210000000012  ",
+    "  210000000012  ",
+    "  210000000012  ",
+    "  210000000012  ",
+    "  210000000012  ",
+    "  210000000012  ",
+    "  210000000012  ",
+    "  210000000012  ",
+    " 21111111111112 ",
+    "3222222222222223",
+};
+
+static const char *const lamp_glyphs[SPRITE_SIZE] =
+{
+    "     .----.     ",
+    "    /  ..  \\    ",
+    "   |  (  )  |   ",
+    "    \\  ''  /    ",
+    "     '----'     ",
+    "       ||       ",
+    "       ||       ",
+    "       ||       ",
+    "       ||       ",
+    "       ||       ",
+    "       ||       ",
+    "       ||       ",
+    "       ||       ",
+    "       ||       ",
+    "      /__\\      ",
+    "    [______]    ",
+};
+static const char *const lamp_shades[SPRITE_SIZE] =
+{
+    "     100001     ",
+    "    10000001    ",
+    "   1000000001   ",
+    "    10000001    ",
+    "     111111     ",
+    "       23       ",
+    "       23       ",
+    "       23       ",
+    "       23       ",
+    "       23       ",
+    "       23       ",
+    "       23       ",
+    "       23       ",
+    "       23       ",
+    "      2223      ",
+    "    33333333    ",
+};
+
+const SpriteImage sprite_images[NUM_SPRITE_KINDS] =
+{
+    make_sprite_image(0.5f, 0.45f, barrel_glyphs, barrel_shades),
+    make_sprite_image(0.4f, 1.0f, pillar_glyphs, pillar_shades),
+    make_sprite_image(0.5f, 0.9f, lamp_glyphs, lamp_shades),
+};
+
+void sprites_add(Sprites &sprites, float x, float y, SpriteKind kind)
+{
+    sprites.x.push_back(x);
+    sprites.y.push_back(y);
+    sprites.kind.push_back((uint8_t)kind);
+}
+
+void sprites_build_grid(Sprites &sprites, int map_width, int map_height)
+{
+    int grid_width = std::max(1, (map_width + SPRITE_GRID_SIZE - 1) / SPRITE_GRID_SIZE);
+    int grid_height = std::max(1, (map_height + SPRITE_GRID_SIZE - 1) / SPRITE_GRID_SIZE);
+    int num_cells = grid_width * grid_height;
+    int count = (int)sprites.x.size();
+
+    auto cell_of = [&](int i)
+    {
+        int cx = std::min(std::max((int)floorf(sprites.x[i]) >> SPRITE_GRID_SHIFT, 0), grid_width - 1);
+        int cy = std::min(std::max((int)floorf(sprites.y[i]) >> SPRITE_GRID_SHIFT, 0), grid_height - 1);
+        return cy * grid_width + cx;
+    };
+
+    // Counting sort by cell, keeping the order sprites were in within a cell
+    std::vector<int> cell_start(num_cells + 1, 0);
+    for (int i = 0; i < count; ++i)
+    {
+        ++cell_start[cell_of(i) + 1];
+    }
+    for (int cell = 0; cell < num_cells; ++cell)
+    {
+        cell_start[cell + 1] += cell_start[cell];
+    }
+    std::vector<int> next = cell_start;
+    std::vector<float> x(count), y(count);
+    std::vector<uint8_t> kind(count);
+    for (int i = 0; i < count; ++i)
+    {
+        int to = next[cell_of(i)]++;
+        x[to] = sprites.x[i];
+        y[to] = sprites.y[i];
+        kind[to] = sprites.kind[i];
+    }
+
+    sprites.x.swap(x);
+    sprites.y.swap(y);
+    sprites.kind.swap(kind);
+    sprites.grid_width = grid_width;
+    sprites.grid_height = grid_height;
+    sprites.cell_start.swap(cell_start);
+}
+
+void scatter_sprites(Sprites &sprites, const Map &map, int count, unsigned seed)
+{
+    // Same small random number generator as 'generate_map'
+    uint32_t state = seed * 2654435761u + 1;
+    auto next_random = [&state]() -> float
+    {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    };
+
+    int start_x = (int)map.start_x;
+    int start_y = (int)map.start_y;
+    int placed = 0;
+    // (Gives up on a map with next to no empty tiles rather than searching forever)
+    for (long tries = 0; placed < count && tries < 100L * count + 1000; ++tries)
+    {
+        float x = next_random() * map.width;
+        float y = next_random() * map.height;
+        if (map.is_wall((int)x, (int)y) || ((int)x == start_x && (int)y == start_y))
+        {
+            continue;
+        }
+        // Keep it away from the walls of the tile, so it doesn't stick into them
+        x = floorf(x) + 0.25f + 0.5f * (x - floorf(x));
+        y = floorf(y) + 0.25f + 0.5f * (y - floorf(y));
+        sprites_add(sprites, x, y, (SpriteKind)(placed % NUM_SPRITE_KINDS));
+        ++placed;
+    }
+    sprites_build_grid(sprites, map.width, map.height);
+}
+
+// Checks sprite 'i' against the view, and adds it to 'visible' if it is in it
+static inline void check_sprite(const Sprites &sprites, int i, float cameraX, float cameraY, float dirX, float dirY,
+                                float planeX, float planeY, float plane_length, std::vector<VisibleSprite> &visible)
+{
+    float relX = sprites.x[i] - cameraX;
+    float relY = sprites.y[i] - cameraY;
+    float depth = relX * dirX + relY * dirY;
+    if (depth < SPRITE_NEAR_DISTANCE || depth > SPRITE_DRAW_DISTANCE)
+    {
+        return;
+    }
+    // Distance to the right of the view direction, in map tiles
+    float side = (relX * planeX + relY * planeY) / plane_length;
+    float half_width = sprite_images[sprites.kind[i]].width / 2.0f;
+    if (fabsf(side) - half_width > depth * plane_length)
+    {
+        return; // Off the left or right edge of the view
+    }
+    visible.push_back(VisibleSprite{depth, side / (depth * plane_length), i});
+}
+
+void find_visible_sprites(const Sprites &sprites, float cameraX, float cameraY, float dirX, float dirY,
+                          float planeX, float planeY, bool use_grid,
+                          std::vector<VisibleSprite> &visible, int &considered)
+{
+    visible.clear();
+    considered = 0;
+    float plane_length = sqrtf(planeX * planeX + planeY * planeY);
+
+    if (!use_grid || sprites.cell_start.empty())
+    {
+        considered = (int)sprites.x.size();
+        for (int i = 0; i < considered; ++i)
+        {
+            check_sprite(sprites, i, cameraX, cameraY, dirX, dirY, planeX, planeY, plane_length, visible);
+        }
+    }
+    else
+    {
+        // Bounding box of the view triangle: the camera, and the far left
+        // and far right corners. Widened by the widest sprite, which can
+        // stick into the view from outside of it.
+        float far = SPRITE_DRAW_DISTANCE;
+        float margin = 0.0f;
+        for (const SpriteImage &image : sprite_images)
+        {
+            margin = std::max(margin, image.width / 2.0f);
+        }
+        float leftX = cameraX + (dirX - planeX) * far;
+        float leftY = cameraY + (dirY - planeY) * far;
+        float rightX = cameraX + (dirX + planeX) * far;
+        float rightY = cameraY + (dirY + planeY) * far;
+        auto grid_cell = [](float position, int cells)
+        {
+            return std::min(std::max((int)floorf(position) >> SPRITE_GRID_SHIFT, 0), cells - 1);
+        };
+        int cx_begin = grid_cell(std::min(cameraX, std::min(leftX, rightX)) - margin, sprites.grid_width);
+        int cx_end = grid_cell(std::max(cameraX, std::max(leftX, rightX)) + margin, sprites.grid_width) + 1;
+        int cy_begin = grid_cell(std::min(cameraY, std::min(leftY, rightY)) - margin, sprites.grid_height);
+        int cy_end = grid_cell(std::max(cameraY, std::max(leftY, rightY)) + margin, sprites.grid_height) + 1;
+
+        // A cell is left out when its middle is further outside one of the
+        // edges of the view than any point of the cell (or sprite sticking
+        // out of it) can be from its middle. The edges are measured in map
+        // tiles, so the side edges are scaled by 1 / sqrt(1 + plane_length^2).
+        float cell_radius = SPRITE_GRID_SIZE * 0.70711f + margin;
+        float side_scale = 1.0f / sqrtf(1.0f + plane_length * plane_length);
+        for (int cy = cy_begin; cy < cy_end; ++cy)
+        {
+            for (int cx = cx_begin; cx < cx_end; ++cx)
+            {
+                float relX = (cx + 0.5f) * SPRITE_GRID_SIZE - cameraX;
+                float relY = (cy + 0.5f) * SPRITE_GRID_SIZE - cameraY;
+                float depth = relX * dirX + relY * dirY;
+                float side = (relX * planeX + relY * planeY) / plane_length;
+                if (depth < -cell_radius || depth - far > cell_radius ||
+                    (side - depth * plane_length) * side_scale > cell_radius ||
+                    (-side - depth * plane_length) * side_scale > cell_radius)
+                {
+                    continue;
+                }
+
+                int cell = cy * sprites.grid_width + cx;
+                int end = sprites.cell_start[cell + 1];
+                considered += end - sprites.cell_start[cell];
+                for (int i = sprites.cell_start[cell]; i < end; ++i)
+                {
+                    check_sprite(sprites, i, cameraX, cameraY, dirX, dirY, planeX, planeY, plane_length, visible);
+                }
+            }
+        }
+    }
+
+    // Far to near. Ties go by index, so the order doesn't depend on the order they were found in.
+    std::sort(visible.begin(), visible.end(), [](const VisibleSprite &a, const VisibleSprite &b)
+    {
+        return a.depth > b.depth || (a.depth == b.depth && a.index < b.index);
+    });
+}
+
+SpriteRect project_sprite(const VisibleSprite &sprite, const SpriteImage &image, float plane_length,
+                          int view_width, int view_height)
+{
+    // Same height as a wall at that distance has (see 'compute_column'), standing on the floor
+    float pixels_per_row = (float)(view_height / screen_height);
+    float half_wall_height = (float)(MAX_DEPTH * 4) / sprite.depth * pixels_per_row;
+    float floor = view_height / 2.0f + half_wall_height;
+
+    SpriteRect rect;
+    rect.height = image.height * 2.0f * half_wall_height;
+    rect.top = floor - rect.height;
+    // The view is 2 * plane_length * depth map tiles wide at that distance
+    rect.width = image.width / (2.0f * plane_length * sprite.depth) * view_width;
+    rect.left = (sprite.offset + 1.0f) / 2.0f * view_width - rect.width / 2.0f;
+    return rect;
+}
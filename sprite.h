@@ -0,0 +1,131 @@
+// sprite.h - Sprites: things standing around the map that aren't walls
+//            (barrels, pillars, lamps). Each is drawn as a flat image that
+//            always faces the camera (billboard), scaled by its distance
+//            the same way walls are, and hidden behind walls column by
+//            column using the distance each screen column's ray went before
+//            hitting a wall (the depth buffer, 'ColumnResult::distance').
+//
+// ---- STORAGE: ----
+// Sprites are kept as a struct of arrays (all x's, all y's, all kinds), so
+// going through thousands of them to find the ones in view only touches the
+// positions. They are sorted by the cell of a coarse grid over the map they
+// stand in (SPRITE_GRID_SIZE x SPRITE_GRID_SIZE tiles per cell), so the
+// sprites in a grid cell are next to each other in memory.
+//
+// ---- CULLING: ----
+// Every frame only the grid cells that overlap the view are looked at: the
+// cells inside the bounding box of the view triangle (out to
+// SPRITE_DRAW_DISTANCE), and of those only the ones not entirely outside
+// its left, right or far edge. Each sprite in them is then checked against
+// the view on its own, and the ones in view are sorted far to near and drawn
+// in that order, so nearer sprites cover the ones behind them.
+
+#ifndef SPRITE_H
+#define SPRITE_H
+
+#include "globals.h" // MAX_DEPTH
+#include "texture.h" // Texel, TEXTURE_SIZE
+#include <cstdint> // uint8_t
+#include <vector> // vector
+
+class Map;
+
+// Width and height of a sprite image, in texels
+#define SPRITE_SIZE TEXTURE_SIZE
+// Shade of the texels of a sprite image that aren't drawn (see-through)
+#define SPRITE_TRANSPARENT -1
+
+// Width and height of a cell of the sprite grid, in map tiles
+#define SPRITE_GRID_SHIFT 3
+#define SPRITE_GRID_SIZE (1 << SPRITE_GRID_SHIFT)
+
+// Sprites further away than this aren't drawn. At this distance they have
+// faded into the darkest shade, the same as the floor far away.
+#define SPRITE_DRAW_DISTANCE ((float)MAX_DEPTH)
+// Sprites closer than this to the camera plane aren't drawn
+#define SPRITE_NEAR_DISTANCE 0.2f
+
+enum SpriteKind
+{
+    SPRITE_BARREL,
+    SPRITE_PILLAR,
+    SPRITE_LAMP,
+    NUM_SPRITE_KINDS
+};
+
+// What a kind of sprite looks like
+struct SpriteImage
+{
+    float width;  // In map tiles
+    float height; // As a share of the height of a wall, standing on the floor
+    // SPRITE_SIZE x SPRITE_SIZE texels, column by column like textures.
+    // Texels with shade SPRITE_TRANSPARENT aren't drawn.
+    Texel texels[SPRITE_SIZE * SPRITE_SIZE];
+};
+
+// Image of each SpriteKind
+extern const SpriteImage sprite_images[NUM_SPRITE_KINDS];
+
+// All sprites on the map, see STORAGE above
+struct Sprites
+{
+    // One entry per sprite. In the order of the grid cells the sprites are
+    // in after 'sprites_build_grid', in the order added before that.
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<uint8_t> kind; // SpriteKind
+
+    // Grid over the map. Sprites in cell 'cx', 'cy' are entries
+    // [cell_start[i], cell_start[i + 1]) with i = cy * grid_width + cx.
+    int grid_width = 0;
+    int grid_height = 0;
+    std::vector<int> cell_start;
+};
+
+// A sprite in view, as found by 'find_visible_sprites'
+struct VisibleSprite
+{
+    float depth;  // Distance to the camera plane (the same as walls, see 'compute_column')
+    float offset; // Where its middle is across the view, -1.0f (left edge) to 1.0f (right edge)
+    int index;    // Into the arrays of 'Sprites'
+};
+
+// Adds a sprite standing at 'x', 'y'. Call 'sprites_build_grid' once done adding.
+void sprites_add(Sprites &sprites, float x, float y, SpriteKind kind);
+
+// Sorts the sprites into the grid cells of a map 'map_width' x 'map_height'
+// tiles big. Sprites outside of the map go in the cell closest to them.
+void sprites_build_grid(Sprites &sprites, int map_width, int map_height);
+
+// Places 'count' sprites, of every kind in turn, at random spots in empty
+// tiles of 'map' (not the player's start), and builds the grid. Same seed
+// gives the same sprites.
+void scatter_sprites(Sprites &sprites, const Map &map, int count, unsigned seed);
+
+// Finds the sprites in view of a camera at 'cameraX', 'cameraY' looking in
+// direction 'dirX', 'dirY', with camera plane 'planeX', 'planeY' (see camera.h),
+// through the grid (see CULLING above). They go into 'visible' sorted far to near.
+// 'considered' is set to the number of sprites in the grid cells looked at.
+// PARAMETERS:
+// use_grid [in] = Look through the grid. If false every sprite is checked,
+//                 only there to check the grid against (same result either way).
+void find_visible_sprites(const Sprites &sprites, float cameraX, float cameraY, float dirX, float dirY,
+                          float planeX, float planeY, bool use_grid,
+                          std::vector<VisibleSprite> &visible, int &considered);
+
+// Screen space rectangle a sprite in view covers, in columns and rows
+// (or pixels, when drawing sub-cells) of a view 'view_width' x 'view_height'
+struct SpriteRect
+{
+    float left;
+    float top;
+    float width;
+    float height;
+};
+
+// Where 'sprite' goes on a view 'view_width' x 'view_height' (a multiple of
+// 'screen_height' high), seen with a camera plane 'plane_length' long
+SpriteRect project_sprite(const VisibleSprite &sprite, const SpriteImage &image, float plane_length,
+                          int view_width, int view_height);
+
+#endif
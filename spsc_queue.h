@@ -0,0 +1,56 @@
+// spsc_queue.h - Fixed size queue for handing items from one thread (the
+//                producer) to one other thread (the consumer) without locks.
+//                Used to get key events from the input thread to the game loop.
+//
+// ---- HOW IT WORKS: ----
+// A ring buffer with two counters that only ever go up: 'tail' is only
+// written by the producer (after it has written the item), 'head' only by
+// the consumer (after it has read the item). Each side reads the other's
+// counter to see how much room or how many items there are. The counters
+// are on cache lines of their own so the two threads don't fight over one.
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic> // atomic
+
+// CAPACITY must be a power of two
+template<typename T, unsigned CAPACITY>
+class SpscQueue
+{
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    // Producer only. Returns false (and drops 'item') if the queue is full.
+    bool push(const T &item)
+    {
+        unsigned current_tail = tail.load(std::memory_order_relaxed);
+        if (current_tail - head.load(std::memory_order_acquire) == CAPACITY)
+        {
+            return false;
+        }
+        items[current_tail & (CAPACITY - 1)] = item;
+        tail.store(current_tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false if the queue is empty.
+    bool pop(T &item)
+    {
+        unsigned current_head = head.load(std::memory_order_relaxed);
+        if (current_head == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = items[current_head & (CAPACITY - 1)];
+        head.store(current_head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    alignas(64) std::atomic<unsigned> head{0}; // Next item to pop
+    alignas(64) std::atomic<unsigned> tail{0}; // Next slot to push to
+    alignas(64) T items[CAPACITY];
+};
+
+#endif
@@ -0,0 +1,270 @@
+#include "subcell.h"
+#include <algorithm> // max, min, stable_sort
+#include <cstddef> // offsetof
+#include <cstring> // strcmp
+#if defined(__SSE2__)
+#include <emmintrin.h> // SSE2
+#endif
+
+PixelTables pixel_tables;
+
+static const char *subcell_mode_names[NUM_SUBCELL_MODES] = {"none", "half", "quad"};
+
+const char *subcell_mode_name(SubcellMode mode)
+{
+    return subcell_mode_names[mode];
+}
+
+bool parse_subcell_mode(const char *name, SubcellMode &mode)
+{
+    for (int i = 0; i < NUM_SUBCELL_MODES; ++i)
+    {
+        if (strcmp(name, subcell_mode_names[i]) == 0)
+        {
+            mode = (SubcellMode)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void pixel_buffer_resize(PixelBuffer &pixels, int width, int height)
+{
+    pixels.width = width;
+    pixels.height = height;
+    pixels.pixels.resize((size_t)width * height);
+}
+
+bool pixel_colors_build()
+{
+    pixel_tables.num_colors = 0;
+    int num_colors = (int)palette.colors.size();
+    if (num_colors > MAX_PIXEL_COLORS)
+    {
+        return false;
+    }
+
+    // The sub-cell pairs come after the palette's own pairs
+    short max_pair_id = 0;
+    for (const PalettePair &pair : palette.pairs)
+    {
+        max_pair_id = std::max(max_pair_id, pair.id);
+    }
+    if (max_pair_id + 1 + num_colors * num_colors > 32767)
+    {
+        return false;
+    }
+
+    // Darkest first, by perceived brightness
+    std::vector<PaletteColor> sorted = palette.colors;
+    std::stable_sort(sorted.begin(), sorted.end(), [](const PaletteColor &a, const PaletteColor &b)
+    {
+        return a.r * 299 + a.g * 587 + a.b * 114 < b.r * 299 + b.g * 587 + b.b * 114;
+    });
+    for (int i = 0; i < num_colors; ++i)
+    {
+        pixel_tables.colors[i] = sorted[i].id;
+    }
+    pixel_tables.num_colors = num_colors;
+    pixel_tables.pair_base = max_pair_id + 1;
+    return true;
+}
+
+// Pixel color of what shows on a cell drawn with 'color_pair' and a space
+// (the background color of the pair)
+static unsigned char pair_pixel_color(short color_pair)
+{
+    const PalettePair *pair = find_palette_pair(palette, color_pair);
+    if (pair != nullptr)
+    {
+        for (int i = 0; i < pixel_tables.num_colors; ++i)
+        {
+            if (pixel_tables.colors[i] == pair->bg)
+            {
+                return (unsigned char)i;
+            }
+        }
+    }
+    return 0;
+}
+
+void pixel_tables_build(int height)
+{
+    pixel_colors_build();
+
+    for (int i = 0; i <= SHADE_TABLE_SIZE; ++i)
+    {
+        pixel_tables.wall[i] = pair_pixel_color(shade_tables.wall[i]);
+        pixel_tables.sprite[i] = pair_pixel_color(shade_tables.sprite[i]);
+    }
+    pixel_rows_build(height);
+}
+
+void pixel_rows_build(int height)
+{
+    // Same as the colored rows in 'shade_rows_build', with more rows
+    pixel_tables.height = height;
+    pixel_tables.background.resize(height);
+    for (int y = 0; y < height; ++y)
+    {
+        float edge_distance = std::min(y, height - y) / (float)height;
+        short color_pair = gradient_value(palette.gradients[GRADIENT_CEILING_FLOOR], edge_distance);
+        pixel_tables.background[y] = pair_pixel_color(color_pair);
+    }
+}
+
+bool subcell_pair_colors(short color_pair, short &fg, short &bg)
+{
+    int num_colors = pixel_tables.num_colors;
+    int index = color_pair - pixel_tables.pair_base;
+    if (num_colors == 0 || index < 0 || index >= num_colors * num_colors)
+    {
+        return false;
+    }
+    fg = pixel_tables.colors[index / num_colors];
+    bg = pixel_tables.colors[index % num_colors];
+    return true;
+}
+
+// Cell showing pixel 'top' above pixel 'bottom'
+static inline Cell half_block_cell(int top, int bottom)
+{
+    char glyph = (top == bottom) ? ' ' : (char)(GLYPH_QUADRANTS | QUADRANT_TOP_HALF);
+    return Cell{glyph, subcell_pair(top, bottom)};
+}
+
+// Cell showing 2x2 pixels, see QUADRANTS in subcell.h
+static inline Cell quadrant_cell(int top_left, int top_right, int bottom_left, int bottom_right)
+{
+    int darkest = std::min(std::min(top_left, top_right), std::min(bottom_left, bottom_right));
+    int brightest = std::max(std::max(top_left, top_right), std::max(bottom_left, bottom_right));
+
+    // Pixels closer to the brightest color than the darkest are foreground
+    int middle = darkest + brightest;
+    int mask = (top_left * 2 > middle ? QUADRANT_TOP_LEFT : 0) |
+               (top_right * 2 > middle ? QUADRANT_TOP_RIGHT : 0) |
+               (bottom_left * 2 > middle ? QUADRANT_BOTTOM_LEFT : 0) |
+               (bottom_right * 2 > middle ? QUADRANT_BOTTOM_RIGHT : 0);
+    char glyph = (mask == 0) ? ' ' : (char)(GLYPH_QUADRANTS | mask);
+    return Cell{glyph, subcell_pair(brightest, darkest)};
+}
+
+// Packs cells [x_begin, x_end) of row 'y' one at a time
+static void pack_row_reference(SubcellMode mode, const PixelBuffer &pixels, int y, int x_begin, int x_end,
+                               FrameBuffer &fb)
+{
+    const unsigned char *top = &pixels.pixels[(size_t)(y * 2) * pixels.width];
+    const unsigned char *bottom = top + pixels.width;
+    Cell *out = &fb.at(0, y);
+    for (int x = x_begin; x < x_end; ++x)
+    {
+        if (mode == SUBCELL_HALF)
+        {
+            out[x] = half_block_cell(top[x], bottom[x]);
+        }
+        else
+        {
+            out[x] = quadrant_cell(top[x * 2], top[x * 2 + 1], bottom[x * 2], bottom[x * 2 + 1]);
+        }
+    }
+}
+
+void pack_pixels_reference(SubcellMode mode, const PixelBuffer &pixels, FrameBuffer &fb)
+{
+    int cells_across = pixels.width / subcell_columns(mode);
+    for (int y = 0; y < pixels.height / 2; ++y)
+    {
+        pack_row_reference(mode, pixels, y, 0, cells_across, fb);
+    }
+}
+
+#if defined(__SSE2__)
+// The packed cells are written straight into the frame buffer as 32-bit
+// lanes, glyph in the low 16 bits (the byte after it is padding) and color
+// pair in the high 16 bits.
+static_assert(sizeof(Cell) == 4 && offsetof(Cell, glyph) == 0 && offsetof(Cell, color_pair) == 2,
+              "Cell layout doesn't match what pack_pixels writes");
+
+// Interleaves 8 glyphs and 8 color pairs into 8 cells at 'out'
+static inline void store_cells(Cell *out, __m128i glyph, __m128i pair)
+{
+    _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi16(glyph, pair));
+    _mm_storeu_si128((__m128i *)(out + 4), _mm_unpackhi_epi16(glyph, pair));
+}
+
+// Packs 8 cells at a time, everything in 16-bit lanes, one cell per lane.
+// Returns the number of cells packed, the rest is left to 'pack_row_reference'.
+static int pack_row_sse2(SubcellMode mode, const PixelBuffer &pixels, int y, int cells_across, FrameBuffer &fb)
+{
+    const unsigned char *top = &pixels.pixels[(size_t)(y * 2) * pixels.width];
+    const unsigned char *bottom = top + pixels.width;
+    Cell *out = &fb.at(0, y);
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i num_colors = _mm_set1_epi16((short)pixel_tables.num_colors);
+    const __m128i pair_base = _mm_set1_epi16(pixel_tables.pair_base);
+    const __m128i space = _mm_set1_epi16(' ');
+
+    int x = 0;
+    if (mode == SUBCELL_HALF)
+    {
+        const __m128i upper_half = _mm_set1_epi16(GLYPH_QUADRANTS | QUADRANT_TOP_HALF);
+        for (; x + 8 <= cells_across; x += 8)
+        {
+            __m128i top_pixels = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)&top[x]), zero);
+            __m128i bottom_pixels = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)&bottom[x]), zero);
+
+            __m128i pair = _mm_add_epi16(pair_base, _mm_add_epi16(_mm_mullo_epi16(top_pixels, num_colors), bottom_pixels));
+            __m128i same = _mm_cmpeq_epi16(top_pixels, bottom_pixels);
+            __m128i glyph = _mm_or_si128(_mm_and_si128(same, space), _mm_andnot_si128(same, upper_half));
+            store_cells(&out[x], glyph, pair);
+        }
+        return x;
+    }
+
+    const __m128i low_byte = _mm_set1_epi16(0x00ff);
+    const __m128i quadrants = _mm_set1_epi16(GLYPH_QUADRANTS);
+    for (; x + 8 <= cells_across; x += 8)
+    {
+        // 16 pixels from each row, the left and right pixel of 8 cells
+        __m128i top_row = _mm_loadu_si128((const __m128i *)&top[x * 2]);
+        __m128i bottom_row = _mm_loadu_si128((const __m128i *)&bottom[x * 2]);
+        __m128i top_left = _mm_and_si128(top_row, low_byte);
+        __m128i top_right = _mm_srli_epi16(top_row, 8);
+        __m128i bottom_left = _mm_and_si128(bottom_row, low_byte);
+        __m128i bottom_right = _mm_srli_epi16(bottom_row, 8);
+
+        __m128i darkest = _mm_min_epi16(_mm_min_epi16(top_left, top_right), _mm_min_epi16(bottom_left, bottom_right));
+        __m128i brightest = _mm_max_epi16(_mm_max_epi16(top_left, top_right), _mm_max_epi16(bottom_left, bottom_right));
+        __m128i middle = _mm_add_epi16(darkest, brightest);
+
+        __m128i mask = _mm_and_si128(_mm_cmpgt_epi16(_mm_add_epi16(top_left, top_left), middle),
+                                     _mm_set1_epi16(QUADRANT_TOP_LEFT));
+        mask = _mm_or_si128(mask, _mm_and_si128(_mm_cmpgt_epi16(_mm_add_epi16(top_right, top_right), middle),
+                                                _mm_set1_epi16(QUADRANT_TOP_RIGHT)));
+        mask = _mm_or_si128(mask, _mm_and_si128(_mm_cmpgt_epi16(_mm_add_epi16(bottom_left, bottom_left), middle),
+                                                _mm_set1_epi16(QUADRANT_BOTTOM_LEFT)));
+        mask = _mm_or_si128(mask, _mm_and_si128(_mm_cmpgt_epi16(_mm_add_epi16(bottom_right, bottom_right), middle),
+                                                _mm_set1_epi16(QUADRANT_BOTTOM_RIGHT)));
+
+        __m128i blank = _mm_cmpeq_epi16(mask, zero);
+        __m128i glyph = _mm_or_si128(_mm_and_si128(blank, space), _mm_andnot_si128(blank, _mm_or_si128(mask, quadrants)));
+        __m128i pair = _mm_add_epi16(pair_base, _mm_add_epi16(_mm_mullo_epi16(brightest, num_colors), darkest));
+        store_cells(&out[x], glyph, pair);
+    }
+    return x;
+}
+#endif
+
+void pack_pixels(SubcellMode mode, const PixelBuffer &pixels, FrameBuffer &fb)
+{
+    int cells_across = pixels.width / subcell_columns(mode);
+    for (int y = 0; y < pixels.height / 2; ++y)
+    {
+        int x = 0;
+#if defined(__SSE2__)
+        x = pack_row_sse2(mode, pixels, y, cells_across, fb);
+#endif
+        pack_row_reference(mode, pixels, y, x, cells_across, fb);
+    }
+}
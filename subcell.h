@@ -0,0 +1,133 @@
+// subcell.h - Drawing the view at a higher resolution than the terminal has
+//             character cells. The view is drawn into a PixelBuffer with two
+//             pixels per cell, one above the other (SUBCELL_HALF), or 2x2
+//             pixels per cell (SUBCELL_QUAD). That is then packed down into
+//             cells of block characters (like the upper half block), with the
+//             foreground color drawing some of the pixels and the background
+//             color the rest.
+//
+// ---- PIXEL COLORS: ----
+// A pixel is a single byte, an index into the pixel colors: all colors of the
+// palette, sorted from darkest to brightest. Every combination of two pixel
+// colors (foreground and background) has a color pair of its own, numbered
+// from 'pixel_tables.pair_base' up, so the color pair of a cell is worked
+// out with a multiply and an add instead of looked up.
+//
+// ---- QUADRANTS: ----
+// A cell only has two colors, but its four pixels can have up to four
+// different ones. Then the darkest and the brightest of them are used, and
+// every pixel gets the one that it is closest to in the pixel colors order.
+
+#ifndef SUBCELL_H
+#define SUBCELL_H
+
+#include "framebuffer.h" // Cell, FrameBuffer
+#include "shading.h" // SHADE_TABLE_SIZE
+#include <vector> // vector
+
+enum SubcellMode
+{
+    SUBCELL_NONE, // One cell is one pixel
+    SUBCELL_HALF, // Two pixels per cell, top and bottom half
+    SUBCELL_QUAD, // Four pixels per cell, 2x2
+    NUM_SUBCELL_MODES
+};
+
+// Name of mode, as given on the command line ("none", "half", "quad")
+const char *subcell_mode_name(SubcellMode mode);
+
+// Finds mode called 'name'. Returns false if there is none.
+bool parse_subcell_mode(const char *name, SubcellMode &mode);
+
+// Pixels across one cell
+inline int subcell_columns(SubcellMode mode)
+{
+    return (mode == SUBCELL_QUAD) ? 2 : 1;
+}
+
+// Pixels down one cell
+inline int subcell_rows(SubcellMode mode)
+{
+    return (mode == SUBCELL_NONE) ? 1 : 2;
+}
+
+// Most pixel colors a palette can have for sub-cell drawing
+// (the pairs for every combination of them have to fit in a short)
+#define MAX_PIXEL_COLORS 128
+
+struct PixelBuffer
+{
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels; // Row by row, width * height pixel colors
+
+    unsigned char &at(int x, int y) { return pixels[y * width + x]; }
+    const unsigned char &at(int x, int y) const { return pixels[y * width + x]; }
+};
+
+// Resize (if needed), without clearing
+void pixel_buffer_resize(PixelBuffer &pixels, int width, int height);
+
+// Tables built out of 'palette' for drawing pixels
+struct PixelTables
+{
+    int num_colors = 0;                // Number of pixel colors, 0 if not built yet
+    short colors[MAX_PIXEL_COLORS];    // Palette color id of each pixel color, darkest first
+    short pair_base = 0;               // Color pair id of pixel colors 0 on 0
+
+    // Pixel color of the wall, indexed like 'shade_tables.wall'
+    unsigned char wall[SHADE_TABLE_SIZE + 1];
+    // Pixel color of sprites, indexed like 'shade_tables.sprite'
+    unsigned char sprite[SHADE_TABLE_SIZE + 1];
+
+    // Pixel color of each pixel row where there is no wall in front,
+    // for a view 'height' pixels high
+    int height = -1;
+    std::vector<unsigned char> background;
+};
+
+extern PixelTables pixel_tables;
+
+// Sorts the colors of 'palette' into the pixel colors. Returns false if the
+// palette has more than MAX_PIXEL_COLORS colors, then there is no sub-cell drawing.
+bool pixel_colors_build();
+
+// Builds the pixel colors, the wall table (from 'shade_tables', which must be
+// built already) and the row table for a view 'height' pixels high
+void pixel_tables_build(int height);
+
+// Rebuild only the row table, for a view 'height' pixels high. Reuses its memory.
+void pixel_rows_build(int height);
+
+// Build the tables if they aren't yet, or rebuild the row table if view is
+// no longer 'height' pixels high
+inline void pixel_tables_resize(int height)
+{
+    if (pixel_tables.height < 0)
+    {
+        pixel_tables_build(height);
+    }
+    else if (height != pixel_tables.height)
+    {
+        pixel_rows_build(height);
+    }
+}
+
+// Color pair with pixel colors 'fg' and 'bg'
+inline short subcell_pair(int fg, int bg)
+{
+    return (short)(pixel_tables.pair_base + fg * pixel_tables.num_colors + bg);
+}
+
+// Palette color ids of the foreground and background of 'color_pair'.
+// Returns false if it isn't one of the sub-cell pairs.
+bool subcell_pair_colors(short color_pair, short &fg, short &bg);
+
+// Packs 'pixels' into the top 'pixels.height / subcell_rows(mode)' rows of 'fb'.
+// Packs 8 cells at a time with SSE2 where there is SSE2.
+void pack_pixels(SubcellMode mode, const PixelBuffer &pixels, FrameBuffer &fb);
+
+// Same as 'pack_pixels', one cell at a time. Only there to check 'pack_pixels' against.
+void pack_pixels_reference(SubcellMode mode, const PixelBuffer &pixels, FrameBuffer &fb);
+
+#endif
@@ -0,0 +1,211 @@
+#include "texture.h"
+#include <fstream> // ifstream
+#include <sstream> // istringstream
+
+// Fills in mip levels 1 and up of the texture starting at 'texels' from level 0.
+// Each texel is made out of the 2x2 texels it covers in the level above:
+// the average shade, and the character most of them have.
+static void build_mip_levels(Texel *texels)
+{
+    const Texel *above = texels;
+    Texel *level = texels + TEXTURE_SIZE * TEXTURE_SIZE;
+    for (int size = TEXTURE_SIZE / 2; size >= 1; size /= 2)
+    {
+        int above_size = size * 2;
+        for (int u = 0; u < size; ++u)
+        {
+            for (int v = 0; v < size; ++v)
+            {
+                const Texel covered[4] =
+                {
+                    above[(2 * u) * above_size + 2 * v],
+                    above[(2 * u + 1) * above_size + 2 * v],
+                    above[(2 * u) * above_size + 2 * v + 1],
+                    above[(2 * u + 1) * above_size + 2 * v + 1],
+                };
+
+                int shade_sum = 0;
+                int best = 0;
+                int best_count = 0;
+                for (int i = 0; i < 4; ++i)
+                {
+                    shade_sum += covered[i].shade;
+                    int count = 0;
+                    for (int j = 0; j < 4; ++j)
+                    {
+                        count += (covered[j].glyph == covered[i].glyph);
+                    }
+                    if (count > best_count)
+                    {
+                        best = i;
+                        best_count = count;
+                    }
+                }
+                level[u * size + v] = Texel{covered[best].glyph, (int8_t)((shade_sum + 2) / 4)};
+            }
+        }
+        above = level;
+        level += size * size;
+    }
+}
+
+// Parses textures in the text format (see texture.h) into 'atlas'
+static bool parse_textures(std::istream &input, TextureAtlas &atlas, std::string &error)
+{
+    std::string line;
+    int line_number = 0;
+    auto next_line = [&]() -> bool
+    {
+        ++line_number;
+        if (!std::getline(input, line))
+        {
+            return false;
+        }
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        return true;
+    };
+
+    while (next_line())
+    {
+        std::istringstream words(line);
+        std::string kind;
+        if (!(words >> kind) || kind[0] == '#')
+        {
+            continue;
+        }
+        int cell;
+        if (kind != "texture" || !(words >> cell) || cell <= 0 || cell >= MAX_CELL_TYPES)
+        {
+            error = "line " + std::to_string(line_number) + ": expected 'texture CELL_ID' (1 to " +
+                    std::to_string(MAX_CELL_TYPES - 1) + ")";
+            return false;
+        }
+
+        // Reuse the space of a texture that is replaced
+        int start = atlas.texture_start[cell];
+        if (start < 0)
+        {
+            start = (int)atlas.texels.size();
+            atlas.texels.resize(atlas.texels.size() + TEXTURE_TEXELS);
+            atlas.texture_start[cell] = start;
+        }
+        Texel *texels = &atlas.texels[start];
+
+        for (int y = 0; y < TEXTURE_SIZE; ++y)
+        {
+            if (!next_line())
+            {
+                error = "texture " + std::to_string(cell) + " ends before all its rows of characters";
+                return false;
+            }
+            for (int x = 0; x < TEXTURE_SIZE; ++x)
+            {
+                texels[x * TEXTURE_SIZE + y].glyph = (x < (int)line.size()) ? line[x] : ' ';
+            }
+        }
+        for (int y = 0; y < TEXTURE_SIZE; ++y)
+        {
+            if (!next_line())
+            {
+                error = "texture " + std::to_string(cell) + " ends before all its rows of shades";
+                return false;
+            }
+            for (int x = 0; x < TEXTURE_SIZE; ++x)
+            {
+                char shade = (x < (int)line.size()) ? line[x] : '0';
+                if (shade < '0' || shade > '9')
+                {
+                    error = "line " + std::to_string(line_number) + ": shades must be digits 0 to 9";
+                    return false;
+                }
+                texels[x * TEXTURE_SIZE + y].shade = shade - '0';
+            }
+        }
+        build_mip_levels(texels);
+    }
+    return true;
+}
+
+void default_textures(TextureAtlas &atlas)
+{
+    atlas.texels.clear();
+    for (int &start : atlas.texture_start)
+    {
+        start = -1;
+    }
+
+    std::string text;
+    // Bricks, for plain walls ('#')
+    text += "texture 1\n";
+    text += "________________\n";
+    text += "   |       |    \n";
+    text += "   |       |    \n";
+    text += "___|_______|____\n";
+    text += "_______________ \n";
+    text += "       |       |\n";
+    text += "       |       |\n";
+    text += "_______|_______|\n";
+    text += "________________\n";
+    text += "   |       |    \n";
+    text += "   |       |    \n";
+    text += "___|_______|____\n";
+    text += "_______________ \n";
+    text += "       |       |\n";
+    text += "       |       |\n";
+    text += "_______|_______|\n";
+    text += "2222222222222222\n";
+    text += "0001000000010000\n";
+    text += "0001000100010000\n";
+    text += "1112111111121111\n";
+    text += "2222222222222222\n";
+    text += "0000000100000001\n";
+    text += "0010000100000001\n";
+    text += "1111111211111112\n";
+    text += "2222222222222222\n";
+    text += "0001000000010010\n";
+    text += "0001000000010000\n";
+    text += "1112111111121111\n";
+    text += "2222222222222222\n";
+    text += "0000000100000001\n";
+    text += "0000000100100001\n";
+    text += "1111111211111112\n";
+    // Planks, for cell type 2
+    text += "texture 2\n";
+    for (int y = 0; y < TEXTURE_SIZE; ++y)
+    {
+        text += (y == 5 || y == 12) ? "|  o |   |  o | \n" : "|    |   |    | \n";
+    }
+    for (int y = 0; y < TEXTURE_SIZE; ++y)
+    {
+        text += (y % 4 == 1) ? "3110331013103110\n" : "3000300030003000\n";
+    }
+
+    std::istringstream input(text);
+    std::string error;
+    parse_textures(input, atlas, error);
+}
+
+bool load_textures(const std::string &path, TextureAtlas &atlas, std::string &error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = "could not open '" + path + "'";
+        return false;
+    }
+    default_textures(atlas);
+    return parse_textures(file, atlas, error);
+}
+
+int texture_level(float wall_height)
+{
+    int level = 0;
+    while (level < TEXTURE_LEVELS - 1 && (TEXTURE_SIZE >> level) > wall_height)
+    {
+        ++level;
+    }
+    return level;
+}
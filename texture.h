@@ -0,0 +1,88 @@
+// texture.h - Wall textures. Each map cell type can have a texture, a small
+//             square tile of characters with a shade for each of them.
+//             All textures, and all of their mip levels, are kept in one
+//             contiguous atlas.
+//
+// ---- MIP LEVELS: ----
+// Level 0 is the texture at full size (TEXTURE_SIZE x TEXTURE_SIZE), each
+// level after that is half the size of the one before, down to 1x1. Walls
+// far away are only a few rows high on screen, so they are drawn from a
+// smaller level, where each texel is made from the texels it covers in the
+// level above. That way a far away wall shows the overall look of the
+// texture instead of a few random texels from it.
+//
+// ---- TEXTURE FILE FORMAT: ----
+// Any number of textures, lines starting with '#' outside of a texture are
+// comments. Each texture is:
+// texture CELL_ID       = Cell type id (1 to MAX_CELL_TYPES - 1) the texture is for
+// TEXTURE_SIZE lines    = Characters of each row of the texture
+//                         (short lines are filled up with spaces)
+// TEXTURE_SIZE lines    = Shade of each texel, a digit '0' to '9'. 0 is the
+//                         shade the wall has at that distance, each step
+//                         up is one step darker on the wall gradient.
+
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "map.h" // MAX_CELL_TYPES
+#include <cstdint> // int8_t
+#include <string> // std::string
+#include <vector> // vector
+
+// Width and height of a texture, in texels (must be a power of two)
+#define TEXTURE_SIZE 16
+// Number of mip levels, TEXTURE_SIZE x TEXTURE_SIZE down to 1x1
+#define TEXTURE_LEVELS 5
+// Number of texels in a texture, all mip levels included
+#define TEXTURE_TEXELS ((TEXTURE_SIZE * TEXTURE_SIZE * 4 - 1) / 3)
+
+// One texel of a texture
+struct Texel
+{
+    char glyph;  // Character to draw
+    int8_t shade; // Steps darker than the wall's shade at that distance
+};
+
+struct TextureAtlas
+{
+    // All textures, TEXTURE_TEXELS each. Within a texture the levels come one
+    // after the other, largest first. Within a level the texels are stored a
+    // column at a time (top to bottom), since walls are drawn a column at a time.
+    std::vector<Texel> texels;
+
+    // Where in 'texels' the texture for each cell type starts, -1 if none
+    int texture_start[MAX_CELL_TYPES];
+};
+
+// Fills 'atlas' with the built in textures (bricks and planks)
+void default_textures(TextureAtlas &atlas);
+
+// Loads textures from a file on top of the built in ones, see format above.
+// Returns false, and a description of what went wrong in 'error', if it failed.
+bool load_textures(const std::string &path, TextureAtlas &atlas, std::string &error);
+
+// Mip level to draw a wall 'wall_height' rows high on screen with,
+// the biggest one that isn't taller than the wall
+int texture_level(float wall_height);
+
+// Texels of 'level' of the texture for 'cell', column by column
+// ((TEXTURE_SIZE >> level) texels each). nullptr if cell has no texture
+// (or isn't a cell type id at all).
+inline const Texel *texture_texels(const TextureAtlas &atlas, int cell, int level)
+{
+    if (cell < 0 || cell >= MAX_CELL_TYPES)
+    {
+        return nullptr;
+    }
+    int start = atlas.texture_start[cell];
+    if (start < 0)
+    {
+        return nullptr;
+    }
+    // Level l starts after levels 0..l-1, which have
+    // (TEXTURE_SIZE^2) * (1 + 1/4 + ... ) texels together
+    int level_start = (TEXTURE_SIZE * TEXTURE_SIZE * 4 - ((TEXTURE_SIZE * TEXTURE_SIZE * 4) >> (2 * level))) / 3;
+    return &atlas.texels[start + level_start];
+}
+
+#endif
@@ -0,0 +1,131 @@
+#include "thread_pool.h"
+#include <algorithm> // min
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_threads(num_threads < 1 ? 1 : num_threads),
+      ranges(this->num_threads),
+      job_call(nullptr),
+      job_func(nullptr),
+      job_count(0),
+      job_tile_size(1),
+      generation(0),
+      workers_busy(0),
+      stopping(false)
+{
+    // Index 0 is the thread calling 'parallel_for', so only start the rest
+    for (int i = 1; i < this->num_threads; ++i)
+    {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start_cv.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::run_job(int count, int tile_size, TileCall call, const void *func)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    if (tile_size < 1)
+    {
+        tile_size = 1;
+    }
+
+    // Single threaded fallback, nothing to share
+    if (num_threads == 1)
+    {
+        for (int begin = 0; begin < count; begin += tile_size)
+        {
+            call(func, begin, std::min(begin + tile_size, count));
+        }
+        return;
+    }
+
+    // Hand out an equal share of the tiles to each thread
+    int num_tiles = (count + tile_size - 1) / tile_size;
+    for (int i = 0; i < num_threads; ++i)
+    {
+        ranges[i].next.store((long)num_tiles * i / num_threads, std::memory_order_relaxed);
+        ranges[i].end = (long)num_tiles * (i + 1) / num_threads;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job_call = call;
+        job_func = func;
+        job_count = count;
+        job_tile_size = tile_size;
+        workers_busy = num_threads - 1;
+        ++generation;
+    }
+    start_cv.notify_all();
+
+    run_tiles(0);
+
+    // Wait for the workers to finish the tiles they took
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [this] { return workers_busy == 0; });
+    job_func = nullptr;
+}
+
+void ThreadPool::worker_loop(int index)
+{
+    unsigned long seen_generation = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cv.wait(lock, [&] { return stopping || generation != seen_generation; });
+            if (stopping)
+            {
+                return;
+            }
+            seen_generation = generation;
+        }
+
+        run_tiles(index);
+
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            last = (--workers_busy == 0);
+        }
+        if (last)
+        {
+            done_cv.notify_one();
+        }
+    }
+}
+
+// Works through the tiles of thread 'index' first, then goes around the
+// other threads and steals whatever tiles they haven't started yet.
+void ThreadPool::run_tiles(int index)
+{
+    for (int i = 0; i < num_threads; ++i)
+    {
+        TileRange &range = ranges[(index + i) % num_threads];
+        while (true)
+        {
+            int tile = range.next.fetch_add(1, std::memory_order_relaxed);
+            if (tile >= range.end)
+            {
+                break;
+            }
+            int begin = tile * job_tile_size;
+            int end = std::min(begin + job_tile_size, job_count);
+            job_call(job_func, begin, end);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+// thread_pool.h - A pool of worker threads that are started once and then
+//                 reused every frame, to split up work that can be done in
+//                 parallel (like calculating the screen columns) across cores.
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // num_threads = Total number of threads doing work, including the thread
+    //               calling 'parallel_for'. 1 (or less) means no worker
+    //               threads are started and all work is done by the caller.
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    // Calls 'func(begin, end)' for every tile of 'tile_size' items in the
+    // range [0, count) and returns once all tiles are done.
+    // - Each thread starts on its own share of the tiles, and when done
+    //   steals remaining tiles from the other threads' shares.
+    // - The calling thread takes part in the work as well.
+    // 'func' is called where it is, without copying it into a std::function
+    // (which would allocate for a lambda capturing more than a pointer or two).
+    template<typename Func>
+    void parallel_for(int count, int tile_size, const Func &func)
+    {
+        run_job(count, tile_size, &call_tile<Func>, &func);
+    }
+
+    int thread_count() const { return num_threads; }
+
+private:
+    // The share of tiles one thread starts out with. Tiles are taken from
+    // the front by bumping 'next', by the owner and thieves alike.
+    // (Aligned so two threads' shares don't end up on the same cache line)
+    struct alignas(64) TileRange
+    {
+        std::atomic<int> next;
+        int end;
+    };
+
+    // Calls a 'Func' at 'func' for the tiles from 'begin' to 'end'
+    template<typename Func>
+    static void call_tile(const void *func, int begin, int end)
+    {
+        (*static_cast<const Func *>(func))(begin, end);
+    }
+    typedef void (*TileCall)(const void *func, int begin, int end);
+
+    void run_job(int count, int tile_size, TileCall call, const void *func);
+    void worker_loop(int index);
+    void run_tiles(int index);
+
+    int num_threads;
+    std::vector<std::thread> workers;
+    std::vector<TileRange> ranges; // One per thread, index 0 is the calling thread
+
+    // Current job, only valid while a 'parallel_for' call is in progress
+    TileCall job_call;
+    const void *job_func;
+    int job_count;
+    int job_tile_size;
+
+    std::mutex mutex;
+    std::condition_variable start_cv; // Workers wait on this for a new job
+    std::condition_variable done_cv;  // Caller waits on this for workers to finish
+    unsigned long generation;         // Bumped for every new job
+    int workers_busy;                 // Workers that haven't finished current job
+    bool stopping;
+};
+
+#endif
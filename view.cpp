@@ -0,0 +1,484 @@
+#include "view.h"
+#include "camera.h"
+#include "globals.h"
+#include "light.h"
+#include "map.h"
+#include "profiler.h"
+#include "raycast.h"
+#include "raycast_packet.h" // fill_ray_hit
+#include "shading.h"
+#include "sprite.h"
+#include "texture.h"
+#include "thread_pool.h"
+#include <algorithm> // max, min
+#include <cassert> // assert
+#include <cmath> // sqrtf, floorf, fabsf
+
+// Sub-cell mode 'settings' is really drawn in (only colored output has sub-cells)
+static SubcellMode view_subcells(const ViewSettings &settings)
+{
+    return settings.colored_output ? settings.subcells : SUBCELL_NONE;
+}
+
+int view_columns(const ViewSettings &settings)
+{
+    return screen_width * subcell_columns(view_subcells(settings));
+}
+
+void compute_column(const RayHit &rayHit, bool colored_output, int view_height, const LightMap *lights,
+                    ColumnResult &column)
+{
+    // ---- WHY NOT THE DISTANCE TO THE PLAYER: ----
+    // The ray directions from the camera all reach one unit forward (they are
+    // the view direction plus some amount of the sideways camera plane), so
+    // the distance comes out measured straight ahead from the camera plane.
+    // Using the real distance to the player would make walls seen at the
+    // sides of the screen look further away than they are, and a flat wall
+    // straight ahead bulge in the middle (fisheye effect).
+    float distanceToWall = rayHit.distance;
+
+    // Calculate how much of ceiling and floor should show based on the distance
+    // (more ceiling and floor the further away wall is)
+
+    // We assume our eyes are at Horizon level, so the further away we are
+    // we can think the height of the wall as it appears shrinks closer and closer
+    // to the middle as we move further away, so it shrinks in how it appears equally
+    // from the floor as it does from the ceiling.
+    // (With sub-cells each row is several pixels high, the wall is as many pixels higher)
+    float pixels_per_row = (float)(view_height / screen_height);
+    float half_wall_height = (float)(MAX_DEPTH * 4) / ((float) distanceToWall) * pixels_per_row;
+    int ceiling = std::max( (float)(view_height / 2.0) - half_wall_height, 0.0f );
+
+    column.distance = distanceToWall;
+    column.ceiling = ceiling;
+    column.floor = view_height - ceiling;
+    // Light on the wall makes it look as bright as a nearer wall (one lookup, see light.h)
+    int shade_index = shade_table_index(distanceToWall);
+    if (lights != nullptr && rayHit.hit)
+    {
+        shade_index = std::max(shade_index - light_shade_offset(light_face_level(*lights, rayHit)), 0);
+    }
+    column.shade_index = shade_index;
+    column.shade = colored_output ? shade_tables.wall[shade_index] : shade_tables.wall_ascii[shade_index];
+    column.cell = rayHit.cell;
+    column.texX = rayHit.texX;
+    column.wall_top = view_height / 2.0f - half_wall_height;
+    column.wall_height = 2.0f * half_wall_height;
+}
+
+void adaptive_resolution_update(AdaptiveResolution &adaptive, double frame_ms)
+{
+    int step = adaptive.column_step;
+    adaptive.slow_frames = (frame_ms > adaptive.target_ms) ? adaptive.slow_frames + 1 : 0;
+    // Going down a step raycasts step / (step - 1) times as many columns. Assume
+    // all of the frame grows with them, so there is no going back and forth.
+    bool room = step > 1 && frame_ms * step / (step - 1) < adaptive.target_ms * ADAPTIVE_HEADROOM;
+    adaptive.fast_frames = room ? adaptive.fast_frames + 1 : 0;
+
+    if (adaptive.slow_frames >= ADAPTIVE_SLOW_FRAMES && step < ADAPTIVE_MAX_STEP)
+    {
+        adaptive.column_step = step + 1;
+        adaptive.slow_frames = 0;
+    }
+    else if (adaptive.fast_frames >= ADAPTIVE_FAST_FRAMES)
+    {
+        adaptive.column_step = step - 1;
+        adaptive.fast_frames = 0;
+    }
+}
+
+// Where along the wall plane of 'hit' (a row or column of the map) it hit.
+// Goes the same way for every face, unlike 'texX'.
+static float wall_position(const RayHit &hit)
+{
+    switch (hit.face)
+    {
+    case FACE_WEST:  return hit.mapY + 1.0f - hit.texX;
+    case FACE_EAST:  return hit.mapY + hit.texX;
+    case FACE_NORTH: return hit.mapX + hit.texX;
+    default:         return hit.mapX + 1.0f - hit.texX; // FACE_SOUTH
+    }
+}
+
+// Fills in 'hit' for a column 't' of the way from a column whose ray hit 'a'
+// to one whose ray hit 'b', see ADAPTIVE RESOLUTION in view.h. Returns false
+// if they aren't on the same flat stretch of wall.
+static bool interpolate_hit(const Map &map, const RayHit &a, const RayHit &b, float t, RayHit &hit)
+{
+    bool across_x = (a.face == FACE_WEST || a.face == FACE_EAST);
+    if (!a.hit || !b.hit || a.face != b.face || (across_x ? a.mapX != b.mapX : a.mapY != b.mapY))
+    {
+        return false;
+    }
+    float inverse = (1.0f - t) / a.distance + t / b.distance;
+    float position = ((1.0f - t) * wall_position(a) / a.distance + t * wall_position(b) / b.distance) / inverse;
+
+    // The tile there must be a wall with nothing in front of it, else the
+    // two rays hit the wall on either side of a gap in it
+    int tile = (int)floorf(position);
+    int mapX = across_x ? a.mapX : tile;
+    int mapY = across_x ? tile : a.mapY;
+    int frontX = mapX + (a.face == FACE_WEST ? -1 : a.face == FACE_EAST ? 1 : 0);
+    int frontY = mapY + (a.face == FACE_NORTH ? -1 : a.face == FACE_SOUTH ? 1 : 0);
+    if (!map.is_wall(mapX, mapY) || map.is_wall(frontX, frontY))
+    {
+        return false;
+    }
+
+    float fraction = position - tile;
+    hit = a;
+    hit.distance = 1.0f / inverse;
+    hit.mapX = mapX;
+    hit.mapY = mapY;
+    hit.cell = map.at(mapX, mapY);
+    hit.texX = (a.face == FACE_WEST || a.face == FACE_SOUTH) ? 1.0f - fraction : fraction;
+    return true;
+}
+
+// Raycasts columns 'column(0)' to 'column(count - 1)' of 'camera' in
+// parallel, each into 'hits[column(i)]'
+template<typename Column>
+static void cast_column_rays(const Map &map, float playerX, float playerY, const Camera &camera,
+                             Raycaster raycaster, ThreadPool &pool, int count, Column column, RayHit *hits)
+{
+    pool.parallel_for(count, COLUMN_TILE_SIZE, [&](int begin, int end)
+    {
+        float rayX[COLUMN_TILE_SIZE];
+        float rayY[COLUMN_TILE_SIZE];
+        RayHit tile_hits[COLUMN_TILE_SIZE];
+        for (int first = begin; first < end; first += COLUMN_TILE_SIZE)
+        {
+            int tile_count = std::min(end - first, COLUMN_TILE_SIZE);
+            for (int i = 0; i < tile_count; ++i)
+            {
+                rayX[i] = camera.rayX[column(first + i)];
+                rayY[i] = camera.rayY[column(first + i)];
+            }
+            cast_rays(map, playerX, playerY, rayX, rayY, tile_count, raycaster, tile_hits);
+            for (int i = 0; i < tile_count; ++i)
+            {
+                hits[column(first + i)] = tile_hits[i];
+            }
+        }
+    });
+}
+
+// Raycasts every 'step' columns of the view (and the last one) and fills in
+// the ones in between, see ADAPTIVE RESOLUTION in view.h
+static void raycast_column_subset(const Map &map, float playerX, float playerY, const Camera &camera,
+                                  const ViewSettings &settings, int step, int view_height, ThreadPool &pool,
+                                  ViewBuffers &buffers)
+{
+    int view_width = camera.width;
+    int traced = (view_width - 1 + step - 1) / step + 1;
+    auto traced_column = [&](int i) { return std::min(i * step, view_width - 1); };
+    std::vector<RayHit> &hits = buffers.hits;
+    std::vector<ColumnResult> &columns = buffers.columns;
+    hits.resize(view_width);
+    cast_column_rays(map, playerX, playerY, camera, settings.raycaster, pool, traced, traced_column, hits.data());
+
+    // Each gap between two raycast columns is filled in on its own
+    pool.parallel_for(traced, COLUMN_TILE_SIZE, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            int left = traced_column(i);
+            compute_column(hits[left], settings.colored_output, view_height, settings.lights, columns[left]);
+            if (i + 1 == traced)
+            {
+                break;
+            }
+            int right = traced_column(i + 1);
+            for (int x = left + 1; x < right; ++x)
+            {
+                float t = (float)(x - left) / (right - left);
+                RayHit hit;
+                if (!interpolate_hit(map, hits[left], hits[right], t, hit))
+                {
+                    // Same as the closest raycast column (halfway, the one with the nearer wall)
+                    bool use_left = t < 0.5f || (t == 0.5f && hits[left].distance <= hits[right].distance);
+                    hit = hits[use_left ? left : right];
+                }
+                compute_column(hit, settings.colored_output, view_height, settings.lights, columns[x]);
+            }
+        }
+    });
+}
+
+// Which side of ray 'aX', 'aY' ray 'bX', 'bY' is on: less than 0 if it is
+// to the right (further right on screen), more than 0 if to the left
+static inline float ray_side(float aX, float aY, float bX, float bY)
+{
+    return aX * bY - aY * bX;
+}
+
+// Fills in 'hit' for ray 'rayX', 'rayY' from 'originX', 'originY', in
+// between last frame's rays 'aX', 'aY' and 'bX', 'bY' that hit 'a' and 'b'
+// from there, see REUSING COLUMNS in view.h. Returns false if they didn't
+// hit the same flat wall less than a tile apart.
+static bool reuse_hit(const Map &map, float originX, float originY, float rayX, float rayY,
+                      const RayHit &a, float aX, float aY, const RayHit &b, float bX, float bY, RayHit &hit)
+{
+    bool across_x = (a.face == FACE_WEST || a.face == FACE_EAST);
+    if (!a.hit || !b.hit || a.face != b.face || (across_x ? a.mapX != b.mapX : a.mapY != b.mapY) ||
+        aX * rayX + aY * rayY <= 0.0f || bX * rayX + bY * rayY <= 0.0f)
+    {
+        return false;
+    }
+    // Where along the wall they hit it
+    float along_a = across_x ? originY + a.distance * aY : originX + a.distance * aX;
+    float along_b = across_x ? originY + b.distance * bY : originX + b.distance * bX;
+    if (fabsf(along_a - along_b) >= 1.0f)
+    {
+        return false;
+    }
+
+    // The ray has to come at the wall from the same side (FACE_WEST and
+    // FACE_NORTH are hit going along +x and +y), the same way 'fill_ray_hit' works it out
+    float ray = across_x ? rayX : rayY;
+    bool positive = across_x ? (a.face == FACE_WEST) : (a.face == FACE_NORTH);
+    if ((ray >= 0) != positive)
+    {
+        return false;
+    }
+    int wall = across_x ? a.mapX : a.mapY;
+    float distance = (wall + (ray >= 0 ? 0.0f : 1.0f) - (across_x ? originX : originY)) / ray;
+    float along = across_x ? originY + distance * rayY : originX + distance * rayX;
+    int tile = (int)floorf(along);
+    if (!(distance < MAX_RAY_DEPTH) ||
+        (tile != (across_x ? a.mapY : a.mapX) && tile != (across_x ? b.mapY : b.mapX)))
+    {
+        return false;
+    }
+    // Right by the border between two tiles the raycasters can come out on
+    // the other side of it, those are raycast
+    float fraction = along - tile;
+    if (fraction < REUSE_TILE_MARGIN || fraction > 1.0f - REUSE_TILE_MARGIN)
+    {
+        return false;
+    }
+    fill_ray_hit(hit, map, originX, originY, rayX, rayY, true, distance,
+                 across_x ? wall : tile, across_x ? tile : wall, across_x);
+    return true;
+}
+
+// Fills in 'buffers.hits' for the columns that can reuse last frame's rays,
+// and lists the ones that can't in 'cast_columns' (room for every column).
+// Returns how many can't.
+static int reuse_columns(const Map &map, float playerX, float playerY, const Camera &camera, ViewBuffers &buffers,
+                         int *cast_columns)
+{
+    const float *lastX = buffers.last_rayX.data();
+    const float *lastY = buffers.last_rayY.data();
+    const RayHit *last_hits = buffers.last_hits.data();
+    int last_count = (int)buffers.last_hits.size();
+    int cast_count = 0;
+
+    // Last frame's rays go left to right as well, so the two around each ray
+    // are found going through both in step
+    int j = 0;
+    for (int x = 0; x < camera.width; ++x)
+    {
+        float rayX = camera.rayX[x];
+        float rayY = camera.rayY[x];
+        while (j + 1 < last_count && ray_side(lastX[j + 1], lastY[j + 1], rayX, rayY) <= 0.0f)
+        {
+            ++j;
+        }
+        bool between = j + 1 < last_count && ray_side(lastX[j], lastY[j], rayX, rayY) <= 0.0f &&
+                       ray_side(rayX, rayY, lastX[j + 1], lastY[j + 1]) < 0.0f;
+        if (!between || !reuse_hit(map, playerX, playerY, rayX, rayY, last_hits[j], lastX[j], lastY[j],
+                                   last_hits[j + 1], lastX[j + 1], lastY[j + 1], buffers.hits[x]))
+        {
+            cast_columns[cast_count++] = x;
+        }
+    }
+    buffers.columns_reused = camera.width - cast_count;
+    return cast_count;
+}
+
+void render_view(const Map &map, float playerX, float playerY, const Camera &camera,
+                 const ViewSettings &settings, ThreadPool &pool,
+                 ViewBuffers &buffers, FrameBuffer &fb)
+{
+    SubcellMode subcells = view_subcells(settings);
+    int view_width = screen_width * subcell_columns(subcells);
+    int view_height = screen_height * subcell_rows(subcells);
+    assert(camera.width == view_width);
+    arena_reset(buffers.arena);
+
+    std::vector<ColumnResult> &columns = buffers.columns;
+    columns.resize(view_width);
+    shade_tables_resize(screen_height);
+    if (subcells != SUBCELL_NONE)
+    {
+        pixel_tables_resize(view_height);
+        pixel_buffer_resize(buffers.pixels, view_width, view_height);
+    }
+
+    // Raycast all screen columns. Columns are independent of each other,
+    // so they are split up in tiles across the threads in the pool.
+    // (No ncurses calls in here, ncurses is not thread safe)
+    int column_step = std::max(settings.column_step, 1);
+    buffers.columns_reused = 0;
+    if (column_step > 1)
+    {
+        ScopedTimer raycast_timer(STAGE_RAYCAST);
+        raycast_column_subset(map, playerX, playerY, camera, settings, column_step, view_height, pool, buffers);
+        buffers.last_map = nullptr;
+    }
+    else
+    {
+        ScopedTimer raycast_timer(STAGE_RAYCAST);
+        std::vector<RayHit> &hits = buffers.hits;
+        hits.resize(view_width);
+        // Swapped with 'hits' below, both keep room for every column
+        buffers.last_hits.reserve(view_width);
+        if (settings.reuse_columns && buffers.last_map == &map && buffers.last_x == playerX &&
+            buffers.last_y == playerY)
+        {
+            // Only turned since last frame, only raycast what can't be reused
+            int *cast = arena_array<int>(buffers.arena, view_width);
+            int cast_count = reuse_columns(map, playerX, playerY, camera, buffers, cast);
+            cast_column_rays(map, playerX, playerY, camera, settings.raycaster, pool,
+                             cast_count, [cast](int i) { return cast[i]; }, hits.data());
+            pool.parallel_for(view_width, COLUMN_TILE_SIZE, [&](int begin, int end)
+            {
+                for (int x = begin; x < end; ++x)
+                {
+                    compute_column(hits[x], settings.colored_output, view_height, settings.lights, columns[x]);
+                }
+            });
+        }
+        else
+        {
+            pool.parallel_for(view_width, COLUMN_TILE_SIZE, [&](int begin, int end)
+            {
+                // Neighbouring columns are cast together, so the packet
+                // raycasters get rays that stay close to each other
+                for (int first = begin; first < end; first += COLUMN_TILE_SIZE)
+                {
+                    int count = std::min(end - first, COLUMN_TILE_SIZE);
+                    cast_rays(map, playerX, playerY, &camera.rayX[first], &camera.rayY[first],
+                              count, settings.raycaster, &hits[first]);
+                    for (int i = 0; i < count; ++i)
+                    {
+                        compute_column(hits[first + i], settings.colored_output, view_height, settings.lights,
+                                       columns[first + i]);
+                    }
+                }
+            });
+        }
+
+        // Kept for the next frame to reuse
+        buffers.last_map = nullptr;
+        if (settings.reuse_columns)
+        {
+            buffers.last_map = &map;
+            buffers.last_x = playerX;
+            buffers.last_y = playerY;
+            buffers.last_rayX.assign(camera.rayX.begin(), camera.rayX.end());
+            buffers.last_rayY.assign(camera.rayY.begin(), camera.rayY.end());
+            buffers.last_hits.swap(hits);
+        }
+    }
+
+    // Draw the columns
+    {
+        ScopedTimer shade_timer(STAGE_SHADE);
+        for (int x = 0; x < view_width; ++x)
+        {
+            const ColumnResult &column = columns[x];
+            const Texel *texels = nullptr;
+            int texture_size = 0;
+            if (settings.textures != nullptr && column.cell != CELL_EMPTY)
+            {
+                // Biggest mip level that isn't taller than the wall on screen
+                int level = texture_level(column.wall_height);
+                texels = texture_texels(*settings.textures, column.cell, level);
+                texture_size = TEXTURE_SIZE >> level;
+            }
+
+            if (subcells != SUBCELL_NONE)
+            {
+                pixels_draw_wall_column(x, column, texels, texture_size, buffers.pixels);
+            }
+            else if (texels != nullptr)
+            {
+                textured_draw_wall_column(x, column, texels, texture_size, settings.colored_output, fb);
+            }
+            else if (settings.colored_output)
+            {
+                colored_draw_wall_column(x, column.ceiling, column.floor, column.shade, fb);
+            }
+            else
+            {
+                ascii_shade_column(x, column.ceiling, column.floor, (char)column.shade, fb);
+            }
+        }
+    }
+
+    if (settings.sprites != nullptr)
+    {
+        ScopedTimer sprites_timer(STAGE_SPRITES);
+        // Room for all of them in view, so a frame with more in view than
+        // any before doesn't have to allocate
+        buffers.visible_sprites.reserve(settings.sprites->x.size());
+        find_visible_sprites(*settings.sprites, playerX, playerY, camera.dirX, camera.dirY,
+                             camera.planeX, camera.planeY, settings.sprite_grid,
+                             buffers.visible_sprites, buffers.sprites_considered);
+        float plane_length = sqrtf(camera.planeX * camera.planeX + camera.planeY * camera.planeY);
+        for (const VisibleSprite &sprite : buffers.visible_sprites)
+        {
+            const SpriteImage &image = sprite_images[settings.sprites->kind[sprite.index]];
+            SpriteRect rect = project_sprite(sprite, image, plane_length, view_width, view_height);
+            // Lit by the light on the floor it stands on, like walls are
+            int shade_index = shade_table_index(sprite.depth);
+            if (settings.lights != nullptr)
+            {
+                uint8_t level = light_floor_level(*settings.lights, settings.sprites->x[sprite.index],
+                                                  settings.sprites->y[sprite.index]);
+                shade_index = std::max(shade_index - light_shade_offset(level), 0);
+            }
+            if (subcells != SUBCELL_NONE)
+            {
+                pixels_draw_sprite(rect, image, sprite.depth, shade_index, columns.data(), buffers.pixels);
+            }
+            else
+            {
+                draw_sprite(rect, image, sprite.depth, shade_index, columns.data(), settings.colored_output, fb);
+            }
+        }
+    }
+
+    if (subcells != SUBCELL_NONE)
+    {
+        ScopedTimer pack_timer(STAGE_PACK);
+        pack_pixels(subcells, buffers.pixels, fb);
+    }
+}
+
+void draw_map_overlay(const Map &map, float playerX, float playerY, FrameBuffer &fb)
+{
+    ScopedTimer map_timer(STAGE_MAP);
+
+    // Big maps don't fit, so then only the part of the map around the player is drawn
+    int view_width = std::min(map.width, screen_width / 2);
+    int view_height = std::min(map.height, screen_height / 2);
+    int left = std::min(std::max((int)playerX - view_width / 2, 0), map.width - view_width);
+    int top = std::min(std::max((int)playerY - view_height / 2, 0), map.height - view_height);
+    for (int y = 0; y < view_height; ++y)
+    {
+        for (int x = 0; x < view_width; ++x)
+        {
+            int mapX = left + x;
+            int mapY = top + y;
+            char glyph = (map.at(mapX, mapY) == CELL_EMPTY) ? '.' : '#';
+            if (mapX == (int)playerX && mapY == (int)playerY)
+            {
+                glyph = 'P';
+            }
+            fb.at(x, y) = Cell{glyph, 0};
+        }
+    }
+}
@@ -0,0 +1,152 @@
+// view.h - Renders what the player sees, the 3D view, into a frame buffer.
+//          Used both by the game loop and the benchmark mode.
+
+#ifndef VIEW_H
+#define VIEW_H
+
+#include "arena.h" // FrameArena
+#include "framebuffer.h"
+#include "raycast.h" // Raycaster, RayHit
+#include "rendering.h" // ColumnResult
+#include "sprite.h" // Sprites, VisibleSprite
+#include "subcell.h" // SubcellMode, PixelBuffer
+#include <vector> // vector
+
+class Map;
+class ThreadPool;
+struct Camera;
+struct LightMap;
+struct TextureAtlas;
+
+// How the view is rendered
+struct ViewSettings
+{
+    Raycaster raycaster = RAYCASTER_AUTO;   // How the screen columns are raycast
+    bool colored_output = true;             // Colored, or pure ascii
+    const TextureAtlas *textures = nullptr; // Textures to draw walls with, flat shaded if nullptr
+    SubcellMode subcells = SUBCELL_NONE;    // Draw at a higher resolution than the terminal,
+                                            // with block characters (colored output only)
+    const Sprites *sprites = nullptr;       // Sprites to draw, none if nullptr
+    bool sprite_grid = true;                // Find the sprites in view through their grid, or
+                                            // check every one (only there to check the grid against)
+    int column_step = 1;                    // Raycast every this many columns (and the last
+                                            // one), the ones in between are filled in from
+                                            // their neighbours, see ADAPTIVE RESOLUTION below
+    bool reuse_columns = true;              // Reuse what the last frame's rays hit when the
+                                            // player only turned, see REUSING COLUMNS below
+    const LightMap *lights = nullptr;       // Light baked for the map (see light.h), unlit
+                                            // (shaded by distance only) if nullptr
+};
+
+// Scratch space for 'render_view', kept from one frame to the next
+struct ViewBuffers
+{
+    std::vector<ColumnResult> columns; // Raycasting result of every column
+    std::vector<RayHit> hits;          // What the ray of every column hit (or of the
+                                       // raycast columns, when not every column is raycast)
+    PixelBuffer pixels;                // The view in pixels, when drawing sub-cells
+    std::vector<VisibleSprite> visible_sprites; // Sprites in view, far to near
+    int sprites_considered = 0;        // Sprites in the grid cells looked at for them
+
+    // The last frame's rays and what they hit, see REUSING COLUMNS below.
+    // 'last_map' is nullptr if there is nothing to reuse.
+    const Map *last_map = nullptr;
+    float last_x = 0.0f;               // Where the rays started
+    float last_y = 0.0f;
+    std::vector<float> last_rayX;
+    std::vector<float> last_rayY;
+    std::vector<RayHit> last_hits;
+    int columns_reused = 0;            // Columns reused this frame
+
+    FrameArena arena;                  // Scratch memory for one frame, given back at
+                                       // the start of the next 'render_view' call
+};
+
+// ---- REUSING COLUMNS: ----
+// When the player turns without moving, most rays of the new frame point in
+// between two rays of the last one. Where those two hit the same flat wall
+// less than a tile apart, nothing can be in between them (a wall tile is
+// too big to fit without one of them hitting it), so the new ray hits that
+// wall too, and where is worked out straight from the wall's border instead
+// of walking the map. Only the columns turned into view, and the ones at
+// corners and edges of walls, are raycast. The distance to a wall always
+// comes from the border the ray crossed (see 'fill_ray_hit'), so a reused
+// column is exactly the same as a raycast one.
+// Which tile of the wall is hit is the one exception: the raycasters add
+// up the distances to each border they cross, and with the rounding of
+// every addition they can end up a hair over the border between two tiles
+// (up to about 0.0003 of a tile seen so far, at 200 tiles away). Columns
+// hitting the wall within REUSE_TILE_MARGIN of such a border are raycast.
+// --bench-turn checks every reused column against raycasting it.
+
+// Closest a reused column may hit the wall to the border between two of its
+// tiles, in tiles. Each of the at most MAX_RAY_DEPTH (256) additions rounds
+// off at most 2^-15 of a tile, 1/128 in all.
+#define REUSE_TILE_MARGIN (1.0f / 64)
+
+// ---- ADAPTIVE RESOLUTION: ----
+// When frames take longer than they should (slow or busy machine), only every
+// second, third or fourth column is raycast ('ViewSettings::column_step').
+// The columns in between are filled in from the raycast columns on either
+// side: if both rays hit the same flat stretch of wall, where it hits in
+// between is interpolated (1 / distance, and the spot along the wall divided
+// by the distance, go linearly across the screen, so this is exact for a flat
+// wall), as long as the map has an exposed wall there too. Otherwise (a corner,
+// or the edge of a wall in front of another) the column copies the closest
+// of the two. 'AdaptiveResolution' picks the step from how long frames take.
+
+// Most columns 'AdaptiveResolution' goes up to between raycast ones
+#define ADAPTIVE_MAX_STEP 4
+// Frames in a row over the target frame time before raycasting fewer columns
+#define ADAPTIVE_SLOW_FRAMES 3
+// Frames in a row that would still fit in this share of the target frame time
+// with more columns raycast, before raycasting more
+#define ADAPTIVE_HEADROOM 0.8
+#define ADAPTIVE_FAST_FRAMES 30
+
+// Picks the column step for the next frame, see ADAPTIVE RESOLUTION above
+struct AdaptiveResolution
+{
+    double target_ms = 0.0; // Frame time to hold, in milliseconds
+    int column_step = 1;    // For 'ViewSettings::column_step'
+    int slow_frames = 0;    // Frames in a row over the target
+    int fast_frames = 0;    // Frames in a row with room to raycast more columns
+};
+
+// Updates 'adaptive.column_step' from 'frame_ms', how long the last frame
+// took to render and print (not counting sleeping)
+void adaptive_resolution_update(AdaptiveResolution &adaptive, double frame_ms);
+
+// Number of columns 'render_view' raycasts for 'settings' ('screen_width', or
+// more when drawing sub-cells), what the camera must be built for
+int view_columns(const ViewSettings &settings);
+
+// Works out how a screen column should be drawn from what its ray hit.
+// (Only reads shared state, so it is safe to call for different columns in parallel)
+// PARAMETERS:
+// rayHit [in]                    = What the ray through the column hit
+// colored_output [in]            = True if 'column.shade' should be a color pair, otherwise an ascii character
+// view_height [in]               = Rows (or pixels, when drawing sub-cells) the view is high,
+//                                  a multiple of 'screen_height'
+// lights [in]                    = Light baked for the map, unlit if nullptr
+// column [out]                   = Result for this column
+void compute_column(const RayHit &rayHit, bool colored_output, int view_height, const LightMap *lights,
+                    ColumnResult &column);
+
+// Renders the view (top 'screen_height' rows of 'fb') for a player standing
+// at 'playerX', 'playerY' looking through 'camera' (built for 'view_columns(settings)').
+// - Columns are raycast in parallel on 'pool' into 'buffers.columns', then drawn into 'fb'.
+//   Only every 'settings.column_step' columns is raycast, see ADAPTIVE RESOLUTION.
+// - Sprites in view are drawn over them, far to near, where they are nearer
+//   than the wall of the column.
+// - When drawing sub-cells they are drawn into 'buffers.pixels' first, which
+//   is then packed into 'fb'.
+void render_view(const Map &map, float playerX, float playerY, const Camera &camera,
+                 const ViewSettings &settings, ThreadPool &pool,
+                 ViewBuffers &buffers, FrameBuffer &fb);
+
+// Draws the map in the top left corner of the view, with the player at
+// 'playerX', 'playerY' marked as 'P'
+void draw_map_overlay(const Map &map, float playerX, float playerY, FrameBuffer &fb);
+
+#endif